@@ -0,0 +1,12 @@
+# the interactive application
+TEMPLATE = app
+TARGET = Animation-Cycles
+
+QT += opengl widgets
+greaterThan(QT_MAJOR_VERSION, 5): QT += openglwidgets
+LIBS += -lGLU
+
+include(core.pri)
+
+HEADERS += AnimationCycleWidget.h
+SOURCES += AnimationCycleWidget.cpp main.cpp
@@ -22,25 +22,58 @@
 #include <GL/glu.h>
 #endif
 
+#include <stdio.h>
+#include <QPainter>
+
 #include "AnimationCycleWidget.h"
+#include "FrameProfiler.h"
+
+// where the C key writes the frame timings, the J key the trace, and the V key the frames
+static const char *phaseCSVName = "./frame-phases.csv";
+static const char *traceName = "./frame-trace.json";
+static const char *capturePrefix = "./capture-";
 
 // constructor
 AnimationCycleWidget::AnimationCycleWidget(QWidget *parent, SceneModel *TheScene)
 	: _GEOMETRIC_WIDGET_PARENT_CLASS(parent),
-	theScene(TheScene)
+	theScene(TheScene),
+	showTimings(false),
+	redrawEveryTick(FrameProfiler::enabled.load())
 	{ // constructor
-	// we want to create a timer for forcing animation
-	animationTimer = new QTimer(this);
-	// connect it to the desired slot
-	connect(animationTimer, SIGNAL(timeout()), this, SLOT(nextFrame()));
-	// set the timer to fire 24 times a second
-	animationTimer->start((double)41.6667);
+#if (QT_VERSION < 0x060000)
+	// we swap the buffers ourselves, so that the swap can be timed
+	setAutoBufferSwap(false);
+#endif
+	// the scene steps itself on a thread of its own, 24 times a second, and we redraw
+	// only after a tick that changed something: a still scene costs no frames at all
+	// (the call is queued, since it comes from the simulation thread, and Qt merges
+	// requests that arrive before the last one has been drawn)
+	theScene->snapshotPublished = [this](bool changed)
+		{ // snapshotPublished
+		if (changed || redrawEveryTick.load(std::memory_order_relaxed))
+			QMetaObject::invokeMethod(this, "nextFrame", Qt::QueuedConnection);
+		}; // snapshotPublished
+	theScene->StartSimulation(24.0);
 	} // constructor
 
 // destructor
 AnimationCycleWidget::~AnimationCycleWidget()
 	{ // destructor
-	// nothing yet
+	// stop stepping the scene before anything goes away
+	theScene->StopSimulation();
+	theScene->snapshotPublished = nullptr;
+
+	// write out whatever frames are still waiting
+	capture.Finish();
+
+	// and free what the scene gave OpenGL while its context is still there
+	makeCurrent();
+	theScene->ReleaseBuffers();
+	doneCurrent();
+
+	// flush whatever timings have been written
+	FrameProfiler::CloseCSV();
+	FrameProfiler::StopTrace();
 	} // destructor																	
 
 // called when OpenGL context is set up
@@ -76,66 +109,204 @@ void AnimationCycleWidget::paintGL()
 	{ // AnimationCycleWidget::paintGL()
 	// call the scene to render itself
 	theScene->Render();
+
+	// the capture is of the scene alone, so is taken before anything is drawn over it
+	if (capture.Active())
+		{ // capture
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		capture.Capture(viewport[2], viewport[3]);
+		} // capture
+
+	// the timings go on top
+	if (showTimings)
+		PaintTimings();
+
+#if (QT_VERSION < 0x060000)
+	{ // swap
+	ScopedPhase timer(PHASE_SWAP);
+	swapBuffers();
+	} // swap
+#endif
+
+	// and this frame's timings are complete
+	if (FrameProfiler::enabled.load(std::memory_order_relaxed))
+		FrameProfiler::EndFrame();
 	} // AnimationCycleWidget::paintGL()
 
+// draw the frame timings over the scene
+void AnimationCycleWidget::PaintTimings()
+	{ // PaintTimings()
+	// QPainter changes OpenGL state behind the scene's back, so keep it all
+	glPushAttrib(GL_ALL_ATTRIB_BITS);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+
+	QPainter painter(this);
+	painter.setFont(QFont("Monospace", 9));
+	painter.setPen(Qt::white);
+	QFontMetrics metrics = painter.fontMetrics();
+	int line = metrics.height();
+	int y = line;
+
+	painter.drawText(8, y, QString("phase       mean ms  p99 ms  (%1 frames)").arg(qMin(FrameProfiler::FramesGathered(), (long) FrameProfiler::HISTORY_FRAMES)));
+	for (int phase = 0; phase < N_PHASES; phase++)
+		{ // per phase
+		y += line;
+		painter.drawText(8, y, QString("%1 %2 %3")
+			.arg(FrameProfiler::PhaseName(phase), -10)
+			.arg(FrameProfiler::AverageMilliseconds(phase), 8, 'f', 3)
+			.arg(FrameProfiler::Percentile99Milliseconds(phase), 7, 'f', 3));
+		} // per phase
+	y += line;
+	const SkinnedMesh &mesh = theScene->characterMesh;
+	if (mesh.Bound())
+		painter.drawText(8, y, QString("%1 characters, %2 draw calls, %3 vertices skinned at %4 M / s")
+			.arg(theScene->charactersDrawn)
+			.arg(mesh.drawCalls)
+			.arg(mesh.verticesSkinned)
+			.arg(1E-6 * mesh.VerticesPerSecond(), 0, 'f', 1));
+	else
+		painter.drawText(8, y, QString("%1 characters, %2 draw calls, %3 vertices")
+			.arg(theScene->charactersDrawn)
+			.arg(theScene->bones.drawCalls)
+			.arg(theScene->bones.verticesSubmitted));
+	if (FrameProfiler::WritingCSV())
+		{ // CSV
+		y += line;
+		painter.drawText(8, y, QString("writing %1").arg(phaseCSVName));
+		} // CSV
+	if (FrameProfiler::Tracing())
+		{ // trace
+		y += line;
+		painter.drawText(8, y, "tracing");
+		} // trace
+	if (capture.Active())
+		{ // capture
+		y += line;
+		painter.drawText(8, y, QString("capturing: %1 frames written, %2 dropped, %3 frames / s")
+			.arg(capture.FramesWritten())
+			.arg(capture.FramesDropped())
+			.arg(capture.FramesPerSecond(), 0, 'f', 1));
+		} // capture
+	painter.end();
+
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	glPopAttrib();
+	} // PaintTimings()
+
+// the profiler runs while anything wants its results
+void AnimationCycleWidget::UpdateInstrumentation()
+	{ // UpdateInstrumentation()
+	FrameProfiler::enabled.store(showTimings || FrameProfiler::WritingCSV() || FrameProfiler::Tracing());
+	// and while it runs, or frames are captured, every tick is drawn, so that none are missed
+	redrawEveryTick.store(FrameProfiler::enabled.load() || capture.Active());
+	update();
+	} // UpdateInstrumentation()
+
 // called when a key is pressed
 void AnimationCycleWidget::keyPressEvent(QKeyEvent *event)
 	{ // keyPressEvent()
-	// just do a big switch statement
+	// just do a big switch statement: the scene is stepped on its own thread,
+	// so anything that changes it is posted for the next tick to apply
 	switch (event->key())
 		{ // end of key switch
-		// exit the program
+		// exit the program: closing the window ends the event loop, so that the destructor
+		// stops the simulation, finishes the capture and frees the buffers before anything is torn down
 		case Qt::Key_X:
-			exit(0);
+			close();
 			break;
 	
 		// camera controls
 		case Qt::Key_W:
-			theScene->EventCameraForward();
+			theScene->PostEvent(SceneModel::EVENT_CAMERA_FORWARD);
 			break;
 		case Qt::Key_A:
-			theScene->EventCameraLeft();
+			theScene->PostEvent(SceneModel::EVENT_CAMERA_LEFT);
 			break;
 		case Qt::Key_S:
-			theScene->EventCameraBackward();
+			theScene->PostEvent(SceneModel::EVENT_CAMERA_BACKWARD);
 			break;
 		case Qt::Key_D:
-			theScene->EventCameraRight();
+			theScene->PostEvent(SceneModel::EVENT_CAMERA_RIGHT);
 			break;
 		case Qt::Key_F:
-			theScene->EventCameraDown();
+			theScene->PostEvent(SceneModel::EVENT_CAMERA_DOWN);
 			break;
 		case Qt::Key_R:
-			theScene->EventCameraUp();
+			theScene->PostEvent(SceneModel::EVENT_CAMERA_UP);
 			break;
 		case Qt::Key_Q:
-			theScene->EventCameraTurnLeft();
+			theScene->PostEvent(SceneModel::EVENT_CAMERA_TURN_LEFT);
 			break;
 		case Qt::Key_E:
-			theScene->EventCameraTurnRight();
+			theScene->PostEvent(SceneModel::EVENT_CAMERA_TURN_RIGHT);
 			break;
 			
 		// resets the character's position and orientation
 		case Qt::Key_P:
-			theScene->EventCharacterReset();
+			theScene->PostEvent(SceneModel::EVENT_CHARACTER_RESET);
+			break;
+
+		// switches how the character's mesh is skinned
+		case Qt::Key_K:
+			theScene->PostEvent(SceneModel::EVENT_CHARACTER_SKINNING);
 			break;
 			
 		// keys for engaging character animation
 		case Qt::Key_Up:
-			theScene->EventCharacterForward();
+			theScene->PostEvent(SceneModel::EVENT_CHARACTER_FORWARD);
 			break;
 		case Qt::Key_Down:
-			theScene->EventCharacterBackward();
+			theScene->PostEvent(SceneModel::EVENT_CHARACTER_BACKWARD);
 			break;
 		case Qt::Key_Left:
-			theScene->EventCharacterTurnLeft();
+			theScene->PostEvent(SceneModel::EVENT_CHARACTER_TURN_LEFT);
 			break;
 		case Qt::Key_Right:
-			theScene->EventCharacterTurnRight();
+			theScene->PostEvent(SceneModel::EVENT_CHARACTER_TURN_RIGHT);
 			break;
         case Qt::Key_Control:
-            theScene->EventCharacterWalk();
+            theScene->PostEvent(SceneModel::EVENT_CHARACTER_WALK);
             break;
+
+		// frame timings: T shows them, C writes them to a CSV file, J traces them
+		case Qt::Key_T:
+			showTimings = !showTimings;
+			UpdateInstrumentation();
+			break;
+		case Qt::Key_C:
+			if (FrameProfiler::WritingCSV())
+				FrameProfiler::CloseCSV();
+			else
+				FrameProfiler::OpenCSV(phaseCSVName);
+			UpdateInstrumentation();
+			break;
+		case Qt::Key_J:
+			if (FrameProfiler::Tracing())
+				FrameProfiler::StopTrace();
+			else
+				FrameProfiler::StartTrace(traceName);
+			UpdateInstrumentation();
+			break;
+
+		// frame capture: V starts and stops it, dropping frames rather than stalling if the disk cannot keep up
+		case Qt::Key_V:
+			if (capture.Active())
+				{ // stop
+				capture.Finish();
+				printf("captured %ld frames to %s onwards, %ld dropped, %ld not written, %.1f frames / s\n",
+					capture.FramesWritten(), capture.FileName(0).c_str(), capture.FramesDropped(), capture.WriteFailures(), capture.FramesPerSecond());
+				} // stop
+			else
+				capture.Start(capturePrefix, FrameCapture::PNG, FrameCapture::DROP, 2, 8);
+			UpdateInstrumentation();
+			break;
 		
 		// just in case
 		default:
@@ -164,10 +335,8 @@ void AnimationCycleWidget::keyReleaseEvent(QKeyEvent* event)
 
 void AnimationCycleWidget::nextFrame()
 	{ // nextFrame()
-	// each time this gets called, we will update the scene
-	theScene->Update();
-
-	// now force an update
+	// the scene updates itself, so we only need to draw whatever it last published
+	// (update() waits for the next paint, which the swap keeps to the display's refresh)
 	update();
 	} // nextFrame()
 
@@ -26,10 +26,12 @@
 #define _GEOMETRIC_WIDGET_PARENT_CLASS QOpenGLWidget
 #define _GL_WIDGET_UPDATE_CALL update
 #endif
-#include <QTimer>
 #include <QMouseEvent>
 
+#include <atomic>
+
 #include "SceneModel.h"
+#include "FrameCapture.h"
 
 class AnimationCycleWidget : public _GEOMETRIC_WIDGET_PARENT_CLASS										
 	{ // class AnimationCycleWidget
@@ -38,8 +40,15 @@ class AnimationCycleWidget : public _GEOMETRIC_WIDGET_PARENT_CLASS
 	// we have a single model encapsulating the scene
 	SceneModel *theScene;
 
-	// a timer for animation
-	QTimer *animationTimer;
+	// whether the frame timings are drawn over the scene
+	bool showTimings;
+
+	// set while every tick should be drawn, changed or not, so that the timings keep coming
+	// and the capture has every frame
+	std::atomic<bool> redrawEveryTick;
+
+	// records the frames drawn as a sequence of images, while it is active
+	FrameCapture capture;
 
 	// constructor
 	AnimationCycleWidget(QWidget *parent, SceneModel *TheScene);
@@ -59,8 +68,16 @@ class AnimationCycleWidget : public _GEOMETRIC_WIDGET_PARENT_CLASS
 	void keyPressEvent(QKeyEvent *event) override;
 	void keyReleaseEvent(QKeyEvent* event) override;
 
+	private:
+	// draw the frame timings over the scene
+	void PaintTimings();
+
+	// the profiler runs while anything wants its results, and every tick is drawn
+	// while it runs or frames are being captured
+	void UpdateInstrumentation();
+
 	public slots:
-	// slot that gets called when it's time for the next frame
+	// slot that gets called when the scene has published something new to draw
 	void nextFrame();
 	}; // class AnimationCycleWidget
 
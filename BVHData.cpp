@@ -1,4 +1,6 @@
 #include "BVHData.h"
+#include "Retarget.h"
+#include "FrameProfiler.h"
 #include <math.h>
 
 // constructor
@@ -10,6 +12,8 @@ BVHData::BVHData()
 // a basic recursive-descent parser
 bool BVHData::ReadFileBVH(const char* fileName)
 	{ // ReadFileBVH()
+	ScopedPhase timer(PHASE_LOAD_CLIP);
+
 	// open a file stream and check validity
 	std::ifstream inFile(fileName);
 	if (inFile.bad())
@@ -211,13 +215,18 @@ void BVHData::Render(Matrix4& viewMatrix, float scale, int frame, float groundHe
 	} // Render()
 
 
-void BVHData::RenderBlend(Matrix4 &viewMatrix, float scale, int frame, float groundHeight, BVHData &blend, float t, int blendFrame)
+void BVHData::RenderBlend(Matrix4 &viewMatrix, float scale, int frame, float groundHeight, BVHData &blend, float t, int blendFrame, const Retarget& blendMap)
 {
     //Set initial Height of the ground
     Matrix4 initialHeight = Matrix4::Translate({0, groundHeight, 0});
 
+    //Sample the blend animation onto this skeleton once per frame
+    //Joints the other rig doesn't have keep this animation's rotation
+    std::vector<Cartesian3> blendRotations = boneRotations[frame % frame_count];
+    blendMap.SampleRotations(blend, blendFrame, blendRotations);
+
     //Pass all other information to RenderBlendJoint
-    RenderBlendedJoint(viewMatrix, initialHeight, &this->root, &blend.root, blend.boneRotations, blendFrame, blend.frame_count, t, scale, frame);
+    RenderBlendedJoint(viewMatrix, initialHeight, &this->root, blendRotations, t, scale, frame);
 }
 
 // render a single joint for a given frame
@@ -291,13 +300,11 @@ void BVHData::RenderJoint(Matrix4& viewMatrix, Matrix4 parentMatrix, Joint* join
       }
 	} // RenderJoint()
 
-void BVHData::RenderBlendedJoint(Matrix4 &viewMatrix, Matrix4 parentMatrix, Joint *joint, Joint *blendJoint, std::vector<std::vector<Cartesian3>> &blendBoneRotations, int blendFrame, int blendFrameCount, float t, float scale, int frame)
+void BVHData::RenderBlendedJoint(Matrix4 &viewMatrix, Matrix4 parentMatrix, Joint *joint, std::vector<Cartesian3> &blendRotations, float t, float scale, int frame)
 {
     //Get which frame to render
     int framePos = frame % frame_count;
 
-    int blendedFramePos = blendFrame % blendFrameCount;
-
     //The position of the joint in its own coordinate system is (0,0,0)
     Cartesian3 jointPosition = {0,0,0};
 
@@ -315,7 +322,7 @@ void BVHData::RenderBlendedJoint(Matrix4 &viewMatrix, Matrix4 parentMatrix, Join
     jointRotations = jointRotations * t;
 
     //Now get the rotations from the second animation and do the same
-    Cartesian3 blendJointRotations = -Cartesian3(blendBoneRotations[blendedFramePos][blendJoint->id].x, blendBoneRotations[blendedFramePos][blendJoint->id].y, blendBoneRotations[blendedFramePos][blendJoint->id].z);
+    Cartesian3 blendJointRotations = -blendRotations[joint->id];
 
     //Interpolate the angles
     blendJointRotations = blendJointRotations * (1-t);
@@ -340,7 +347,6 @@ void BVHData::RenderBlendedJoint(Matrix4 &viewMatrix, Matrix4 parentMatrix, Join
     jointPosition = jointTransformMatrix * jointPosition;
 
     //Loop through all children
-    //Use numbers since we want access to both current and blend joint
     for(int i = 0; i < joint->Children.size(); i++)
     {
         //The child is at {0,0,0} in its own coordinate system
@@ -357,7 +363,7 @@ void BVHData::RenderBlendedJoint(Matrix4 &viewMatrix, Matrix4 parentMatrix, Join
         childRotations = childRotations * t;
 
         //Get blend animation's rotations
-        Cartesian3 blendChildRotations = -Cartesian3(blendBoneRotations[blendedFramePos][blendJoint->Children[i].id].x, blendBoneRotations[blendedFramePos][blendJoint->Children[i].id].y, blendBoneRotations[blendedFramePos][blendJoint->Children[i].id].z);
+        Cartesian3 blendChildRotations = -blendRotations[joint->Children[i].id];
 
         blendChildRotations = blendChildRotations * (1-t);
 
@@ -382,102 +388,64 @@ void BVHData::RenderBlendedJoint(Matrix4 &viewMatrix, Matrix4 parentMatrix, Join
         RenderCylinder(viewMatrix, jointPosition, childPosition);
 
         //Recursively call for each child
-        RenderBlendedJoint(viewMatrix, jointTransformMatrix, &joint->Children[i], &blendJoint->Children[i], blendBoneRotations, blendFrame, blendFrameCount, t, scale, frame);
+        RenderBlendedJoint(viewMatrix, jointTransformMatrix, &joint->Children[i], blendRotations, t, scale, frame);
     }
 
 
 }
 
-// render cylinder given the start position and the end position
-void BVHData::RenderCylinder(Matrix4& viewMatrix, Cartesian3 start, Cartesian3 end)
-	{ // RenderCylinder()
-
-    //Rotate so the character stands upright
-    Matrix4 view = viewMatrix * Matrix4::RotateX(270);
+// compute every joint's transform for a pose without rendering anything
+void BVHData::EvaluatePose(const std::vector<Cartesian3>& rotations, const Matrix4& rootMatrix, float scale, std::vector<Matrix4>& jointTransforms)
+	{ // EvaluatePose()
+	jointTransforms.resize(this->all_joints.size());
 
-    //Calculate the vector between the two points
-    Cartesian3 difference = end - start;
+	// joints are stored in depth-first order, so a parent is always done before its children
+	for (size_t i = 0; i < this->all_joints.size(); i++)
+		{ // per joint
+		Joint* joint = this->all_joints[i];
+		int parent = this->parentBones[joint->id];
 
-    //Translate the start to be the origin
-    Cartesian3 endTranslated = Matrix4::Translate(-start) * end;
-    Cartesian3 zAxis = {0,0,1};
+		// translate by the offset, exactly as RenderJoint() does
+		Cartesian3 jointOffset = Cartesian3(joint->joint_offset[0], joint->joint_offset[1], joint->joint_offset[2]) * scale;
 
-    //Get the rotation between the z axis and the endVector
-    Matrix4 rotation = Matrix4::GetRotation(zAxis, endTranslated);
+		// negate the angles to go from the file's right-handed system to Matrix4's
+		Cartesian3 jointRotations = -rotations[joint->id];
+		Matrix4 jointRotateMatrix = Matrix4::RotateX(jointRotations.x) * Matrix4::RotateY(jointRotations.y) * Matrix4::RotateZ(jointRotations.z);
 
-    //Set up transformation matrix
-    Matrix4 transformMatrix = rotation;
-    transformMatrix = Matrix4::Translate(start) * transformMatrix;
+		// and chain onto the parent (or the root matrix at the top of the tree)
+		const Matrix4& parentMatrix = (parent == -1) ? rootMatrix : jointTransforms[parent];
+		jointTransforms[joint->id] = parentMatrix * Matrix4::Translate(jointOffset) * jointRotateMatrix;
+		} // per joint
+	} // EvaluatePose()
 
-    Matrix4 finalMatrix = view * transformMatrix;
+// queue a pose computed by EvaluatePose(), with a cylinder from each joint to its parent
+void BVHData::RenderPose(Matrix4& viewMatrix, const std::vector<Matrix4>& jointTransforms, BoneRenderer& bones)
+	{ // RenderPose()
+	bones.SetView(viewMatrix);
+	for (size_t joint = 0; joint < jointTransforms.size(); joint++)
+		{ // per joint
+		int parent = this->parentBones[joint];
+		if (parent == -1)
+			continue;
+		// each joint sits at the origin of its own coordinate system
+		Cartesian3 start = jointTransforms[parent] * Cartesian3(0, 0, 0);
+		Cartesian3 end = jointTransforms[joint] * Cartesian3(0, 0, 0);
+		bones.AddBone(start, end);
+		} // per joint
+	} // RenderPose()
 
-    //We make the cylinder have a radius of 0.2, with 8 slices
-    Cylinder(finalMatrix, 0.2, difference.length(), 8);
+// the renderer RenderCylinder() draws with
+BoneRenderer BVHData::cylinderBones;
 
+// render cylinder given the start position and the end position
+void BVHData::RenderCylinder(Matrix4& viewMatrix, Cartesian3 start, Cartesian3 end)
+	{ // RenderCylinder()
+	// a batch of one: the cylinder itself is only ever built once
+	cylinderBones.SetView(viewMatrix);
+	cylinderBones.AddBone(start, end);
+	cylinderBones.Draw();
 	} // RenderCylinder()
 
-// render a single cylinder given radius, length and vertical slices
-void BVHData::Cylinder(Matrix4& viewMatrix, float radius, float Length, int slices)
-	{  // Cylinder()
-	// start a set of triangles
-	glBegin(GL_TRIANGLES);
-	// loop through the given number of slices
-	for (int i = 0; i < slices; i++) 
-		{ // per slice
-		// work out the angles around the main axis for the start and end of the slice
-		float theta = (float)(i * 2.0f * M_PI / slices);
-		float nextTheta = (float)((i + 1) * 2.0f * M_PI / slices);
-		float midTheta = 0.5 * (theta + nextTheta);
-
-		// the top vertex is always in the same place
-		Homogeneous4 center_up = viewMatrix * Homogeneous4(0.0, 0.0, Length, 1);
-		// we have two points on the upper circle of the cylinder
-		Homogeneous4 c_edge1 = viewMatrix * Homogeneous4(radius * cos(theta), radius * sin(theta), Length, 1);
-		Homogeneous4 c_edge2 = viewMatrix * Homogeneous4(radius * cos(nextTheta), radius * sin(nextTheta), Length, 1);
-		// and two points on the bottom circle
-		Homogeneous4 c_edge3 = viewMatrix * Homogeneous4(radius * cos(nextTheta), radius * sin(nextTheta), 0, 1);
-		Homogeneous4 c_edge4 = viewMatrix * Homogeneous4(radius * cos(theta), radius * sin(theta), 0, 1);
-		// and a point in the middle of the bottom
-		Homogeneous4 center_bottom = viewMatrix * Homogeneous4(0.0, 0.0, 0, 1);
-
-		// normal vectors are tricky because we need to AVOID using the translation
-		// We can either use a triangle face normal, or we can do a hack ;-)
-		// because we know that they are from the origin to given points
-
-		// we have three normals: one for the top
-		Cartesian3 normal_up = viewMatrix * Cartesian3(0, 0, 1.0) - viewMatrix * Cartesian3(0.0, 0.0, 0.0);
-		// one for the middle
-		Cartesian3 normal_edge = viewMatrix * Cartesian3(cos(midTheta), sin(midTheta), 0.0) - viewMatrix * Cartesian3(0.0, 0.0, 0.0);
-		// and one for the bottom
-		Cartesian3 normal_bottom = viewMatrix * Cartesian3(0, 0, -1.0) - viewMatrix * Cartesian3(0.0, 0.0, 0.0);
-
-		// render the top triangle
-		glNormal3fv(&normal_up.x);
-		glVertex4fv(&center_up.x);
-		glVertex4fv(&c_edge1.x);
-		glVertex4fv(&c_edge2.x);
-
-		// and the side triangles
-		glNormal3fv(&normal_edge.x);
-		glVertex4fv(&c_edge2.x);
-        glVertex4fv(&c_edge1.x);
-		glVertex4fv(&c_edge4.x);
-
-		glNormal3fv(&normal_edge.x);
-		glVertex4fv(&c_edge2.x);
-		glVertex4fv(&c_edge4.x);
-		glVertex4fv(&c_edge3.x);
-
-		// and the bottom triangle
-		glNormal3fv(&normal_bottom.x);
-		glVertex4fv(&c_edge3.x);
-		glVertex4fv(&c_edge4.x);
-		glVertex4fv(&center_bottom.x);
-
-		}
-	glEnd();
-	} // Cylinder()
-
 // get all joints in a sequence by searching the tree structure and store it into this class
 void BVHData::GetAllJoints(Joint& joint, std::vector<Joint*>& joint_list)
 	{ // GetAllJoints()
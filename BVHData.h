@@ -32,10 +32,14 @@
 #include <sstream>
 #include "Cartesian3.h"
 #include "Matrix4.h"
+#include "BoneRenderer.h"
 #include <fstream>
 #include <map>
 #include <math.h>
 
+// the joint mapping used to blend clips from different rigs
+class Retarget;
+
 // A class for each joint
 class Joint
 	{ // class Joint
@@ -110,16 +114,28 @@ public:
     void RenderJoint(Matrix4& viewMatrix, Matrix4 parentMatrix, Joint* joint, float scale, int frame);
 
     //Render 2 BVH animations being blended together
-    void RenderBlend(Matrix4& viewMatrix, float scale, int frame, float groundHeight, BVHData& blend, float t, int blendFrame);
+    //blendMap maps the blend clip's rig onto this one, so the two need not share a topology
+    void RenderBlend(Matrix4& viewMatrix, float scale, int frame, float groundHeight, BVHData& blend, float t, int blendFrame, const Retarget& blendMap);
 
     //Blend the positions of two joints together
-    void RenderBlendedJoint(Matrix4& viewMatrix, Matrix4 parentMatrix, Joint* joint, Joint* blendJoint, std::vector<std::vector<Cartesian3>>& blendBoneRotations, int blendFrame, int blendFrameCount, float t, float scale, int frame);
+    //blendRotations holds the blend clip's rotations, already remapped onto this rig
+    void RenderBlendedJoint(Matrix4& viewMatrix, Matrix4 parentMatrix, Joint* joint, std::vector<Cartesian3>& blendRotations, float t, float scale, int frame);
+
+	// compute every joint's transform for a pose without rendering anything
+	// rotations holds one entry per joint id, and jointTransforms[id] maps that joint's
+	// coordinate system into the one rootMatrix is expressed in
+	void EvaluatePose(const std::vector<Cartesian3>& rotations, const Matrix4& rootMatrix, float scale, std::vector<Matrix4>& jointTransforms);
+
+	// queue a pose computed by EvaluatePose(), with a cylinder from each joint to its parent
+	// nothing is drawn until bones.Draw(), so several characters can share one batch
+	void RenderPose(Matrix4& viewMatrix, const std::vector<Matrix4>& jointTransforms, BoneRenderer& bones);
 
-	// render cylinder given the start position and the end position
-	void RenderCylinder(Matrix4& viewMatrix, Cartesian3 start, Cartesian3 end);
+	// render cylinder given the start position and the end position, straight away
+	// (static, since baked clips draw their bones the same way)
+	static void RenderCylinder(Matrix4& viewMatrix, Cartesian3 start, Cartesian3 end);
 
-	// render a single cylinder given radius, length and vertical slices
-    void Cylinder(Matrix4& viewMatrix, float radius, float Length, int slices);
+	// the renderer RenderCylinder() draws with, which baked clips also batch their bones in
+	static BoneRenderer cylinderBones;
 
 	// get all joints in a sequence by searching the tree structure and store it into this class
 	void GetAllJoints(Joint&, std::vector<Joint*>&);
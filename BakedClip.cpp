@@ -0,0 +1,254 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	BakedClip.cpp
+//	------------------------
+//
+//	A clip with every frame already evaluated: for each
+//	frame and joint we keep the joint's position and
+//	orientation in the character's coordinate system, so
+//	playing it back needs one lookup per joint per frame
+//	instead of walking the hierarchy
+//
+//	The .bake file is little-endian, and laid out as:
+//		"BAKE", int version, int joints, int frames,
+//		float frame time, float scale,
+//		int parent[joints],
+//		BakedJoint joint[frames][joints]
+//
+///////////////////////////////////////////////////
+
+#include "BakedClip.h"
+#include <fstream>
+#include <cstring>
+#include <math.h>
+
+// tag and version at the start of every .bake file
+static const char bakedMagic[4] = { 'B', 'A', 'K', 'E' };
+static const int bakedVersion = 1;
+
+// constructor will initialise to an empty clip
+BakedClip::BakedClip()
+	:
+	frame_count(0),
+	frame_time(0.0f),
+	scale(1.0f)
+	{ // constructor
+	} // constructor
+
+// evaluate every frame of a loaded clip at the given scale
+void BakedClip::Bake(BVHData& clip, float Scale)
+	{ // Bake()
+	frame_count = clip.frame_count;
+	frame_time = clip.frame_time;
+	scale = Scale;
+	parentBones = clip.parentBones;
+
+	int nJoints = JointCount();
+	joints.resize((size_t) frame_count * nJoints);
+
+	// evaluate the whole hierarchy once per frame
+	std::vector<Matrix4> pose;
+	for (int frame = 0; frame < frame_count; frame++)
+		{ // per frame
+		clip.EvaluatePose(clip.boneRotations[frame], Matrix4::Identity(), scale, pose);
+		BakedJoint* baked = &joints[(size_t) frame * nJoints];
+		for (int joint = 0; joint < nJoints; joint++)
+			{ // per joint
+			// the translation column is the joint's position
+			baked[joint].position[0] = pose[joint][0][3];
+			baked[joint].position[1] = pose[joint][1][3];
+			baked[joint].position[2] = pose[joint][2][3];
+			PackOrientation(pose[joint], baked[joint].orientation);
+			} // per joint
+		} // per frame
+	} // Bake()
+
+// number of joints on each frame
+int BakedClip::JointCount() const
+	{ // JointCount()
+	return (int) parentBones.size();
+	} // JointCount()
+
+// the baked joints for a frame
+const BakedJoint* BakedClip::Frame(int frame) const
+	{ // Frame()
+	return &joints[(size_t) (frame % frame_count) * JointCount()];
+	} // Frame()
+
+// rebuild every joint's transform for a frame
+void BakedClip::JointTransforms(int frame, std::vector<Matrix4>& transforms) const
+	{ // JointTransforms()
+	const BakedJoint* pose = Frame(frame);
+	int nJoints = JointCount();
+	transforms.resize(nJoints);
+	for (int joint = 0; joint < nJoints; joint++)
+		{ // per joint
+		// the orientation, with the position as the translation column
+		Matrix4 &transform = transforms[joint];
+		transform = UnpackOrientation(pose[joint].orientation);
+		for (int row = 0; row < 3; row++)
+			transform[row][3] = pose[joint].position[row];
+		} // per joint
+	} // JointTransforms()
+
+// render a frame, drawing a bone from each joint to its parent
+void BakedClip::Render(Matrix4& viewMatrix, int frame, float groundHeight)
+	{ // Render()
+	const BakedJoint* pose = Frame(frame);
+
+	// the bones all go in one batch, drawn together at the end
+	BVHData::cylinderBones.SetView(viewMatrix);
+	// the only per-frame work is a lookup per joint and the height offset
+	for (int joint = 0; joint < JointCount(); joint++)
+		{ // per joint
+		int parent = parentBones[joint];
+		if (parent == -1)
+			continue;
+		Cartesian3 start(pose[parent].position[0], pose[parent].position[1] + groundHeight, pose[parent].position[2]);
+		Cartesian3 end(pose[joint].position[0], pose[joint].position[1] + groundHeight, pose[joint].position[2]);
+		BVHData::cylinderBones.AddBone(start, end);
+		} // per joint
+	BVHData::cylinderBones.Draw();
+	} // Render()
+
+// write in the binary .bake format
+bool BakedClip::WriteFileBaked(const char* fileName)
+	{ // WriteFileBaked()
+	std::ofstream outFile(fileName, std::ios::binary);
+	if (!outFile.good())
+		return false;
+
+	int nJoints = JointCount();
+	outFile.write(bakedMagic, sizeof(bakedMagic));
+	outFile.write((const char*) &bakedVersion, sizeof(int));
+	outFile.write((const char*) &nJoints, sizeof(int));
+	outFile.write((const char*) &frame_count, sizeof(int));
+	outFile.write((const char*) &frame_time, sizeof(float));
+	outFile.write((const char*) &scale, sizeof(float));
+	outFile.write((const char*) parentBones.data(), nJoints * sizeof(int));
+	outFile.write((const char*) joints.data(), joints.size() * sizeof(BakedJoint));
+	return outFile.good();
+	} // WriteFileBaked()
+
+// read a file written by WriteFileBaked()
+bool BakedClip::ReadFileBaked(const char* fileName)
+	{ // ReadFileBaked()
+	std::ifstream inFile(fileName, std::ios::binary);
+	if (!inFile.good())
+		return false;
+
+	// check the tag and version before trusting anything else
+	char magic[4];
+	int version = 0, nJoints = 0, nFrames = 0;
+	inFile.read(magic, sizeof(magic));
+	inFile.read((char*) &version, sizeof(int));
+	if (!inFile.good() || memcmp(magic, bakedMagic, sizeof(magic)) != 0 || version != bakedVersion)
+		return false;
+
+	float frameTime = 0.0f, bakedScale = 0.0f;
+	inFile.read((char*) &nJoints, sizeof(int));
+	inFile.read((char*) &nFrames, sizeof(int));
+	inFile.read((char*) &frameTime, sizeof(float));
+	inFile.read((char*) &bakedScale, sizeof(float));
+	if (!inFile.good() || nJoints <= 0 || nFrames <= 0)
+		return false;
+
+	// the rest of the file must hold the parents and every joint of every frame, before we allocate for them
+	std::streamoff headerEnd = inFile.tellg();
+	inFile.seekg(0, std::ios::end);
+	std::streamoff remaining = inFile.tellg() - headerEnd;
+	inFile.seekg(headerEnd);
+	if ((double) nJoints * sizeof(int) + (double) nFrames * nJoints * sizeof(BakedJoint) > (double) remaining)
+		return false;
+
+	// and Render() looks up each joint's parent, which must come before it
+	std::vector<int> parents(nJoints);
+	inFile.read((char*) parents.data(), nJoints * sizeof(int));
+	if (!inFile.good())
+		return false;
+	for (int joint = 0; joint < nJoints; joint++)
+		if (parents[joint] < -1 || parents[joint] >= joint)
+			return false;
+
+	std::vector<BakedJoint> frames((size_t) nFrames * nJoints);
+	inFile.read((char*) frames.data(), frames.size() * sizeof(BakedJoint));
+	if (!inFile.good())
+		return false;
+
+	// nothing changes until the whole file has been read
+	frame_count = nFrames;
+	frame_time = frameTime;
+	scale = bakedScale;
+	parentBones.swap(parents);
+	joints.swap(frames);
+	return true;
+	} // ReadFileBaked()
+
+// convert a rotation matrix to a packed quaternion
+void BakedClip::PackOrientation(const Matrix4& m, short orientation[4])
+	{ // PackOrientation()
+	// the standard trace method, choosing the largest component to divide by
+	float q[4];
+	float trace = m[0][0] + m[1][1] + m[2][2];
+	if (trace > 0.0f)
+		{ // w is largest
+		float s = 0.5f / sqrt(trace + 1.0f);
+		q[3] = 0.25f / s;
+		q[0] = (m[2][1] - m[1][2]) * s;
+		q[1] = (m[0][2] - m[2][0]) * s;
+		q[2] = (m[1][0] - m[0][1]) * s;
+		} // w is largest
+	else if (m[0][0] > m[1][1] && m[0][0] > m[2][2])
+		{ // x is largest
+		float s = 2.0f * sqrt(1.0f + m[0][0] - m[1][1] - m[2][2]);
+		q[3] = (m[2][1] - m[1][2]) / s;
+		q[0] = 0.25f * s;
+		q[1] = (m[0][1] + m[1][0]) / s;
+		q[2] = (m[0][2] + m[2][0]) / s;
+		} // x is largest
+	else if (m[1][1] > m[2][2])
+		{ // y is largest
+		float s = 2.0f * sqrt(1.0f + m[1][1] - m[0][0] - m[2][2]);
+		q[3] = (m[0][2] - m[2][0]) / s;
+		q[0] = (m[0][1] + m[1][0]) / s;
+		q[1] = 0.25f * s;
+		q[2] = (m[1][2] + m[2][1]) / s;
+		} // y is largest
+	else
+		{ // z is largest
+		float s = 2.0f * sqrt(1.0f + m[2][2] - m[0][0] - m[1][1]);
+		q[3] = (m[1][0] - m[0][1]) / s;
+		q[0] = (m[0][2] + m[2][0]) / s;
+		q[1] = (m[1][2] + m[2][1]) / s;
+		q[2] = 0.25f * s;
+		} // z is largest
+
+	// normalise, then scale to 16 bits
+	float length = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	for (int i = 0; i < 4; i++)
+		orientation[i] = (short) lrintf(32767.0f * q[i] / length);
+	} // PackOrientation()
+
+// and unpack a quaternion back into a rotation matrix
+Matrix4 BakedClip::UnpackOrientation(const short orientation[4])
+	{ // UnpackOrientation()
+	float x = orientation[0] / 32767.0f, y = orientation[1] / 32767.0f;
+	float z = orientation[2] / 32767.0f, w = orientation[3] / 32767.0f;
+
+	// renormalise to take out the quantization error
+	float length = sqrt(x * x + y * y + z * z + w * w);
+	x /= length; y /= length; z /= length; w /= length;
+
+	Matrix4 result = Matrix4::Identity();
+	result[0][0] = 1.0f - 2.0f * (y * y + z * z);
+	result[0][1] = 2.0f * (x * y - z * w);
+	result[0][2] = 2.0f * (x * z + y * w);
+	result[1][0] = 2.0f * (x * y + z * w);
+	result[1][1] = 1.0f - 2.0f * (x * x + z * z);
+	result[1][2] = 2.0f * (y * z - x * w);
+	result[2][0] = 2.0f * (x * z - y * w);
+	result[2][1] = 2.0f * (y * z + x * w);
+	result[2][2] = 1.0f - 2.0f * (x * x + y * y);
+	return result;
+	} // UnpackOrientation()
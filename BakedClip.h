@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	BakedClip.h
+//	------------------------
+//
+//	A clip with every frame already evaluated: for each
+//	frame and joint we keep the joint's position and
+//	orientation in the character's coordinate system, so
+//	playing it back needs one lookup per joint per frame
+//	instead of walking the hierarchy
+//
+///////////////////////////////////////////////////
+
+#ifndef _BAKED_CLIP_H
+#define _BAKED_CLIP_H
+
+#include <vector>
+
+#include "BVHData.h"
+
+// one joint on one frame: 20 bytes
+class BakedJoint
+	{ // class BakedJoint
+	public:
+	// position of the joint
+	float position[3];
+	// orientation as a unit quaternion (x, y, z, w), each scaled to a signed 16-bit value
+	short orientation[4];
+	}; // class BakedJoint
+
+class BakedClip
+	{ // class BakedClip
+	public:
+	// bvh frame count
+	int frame_count;
+
+	// frame rate of the animation
+	float frame_time;
+
+	// the scale the clip was baked at
+	float scale;
+
+	// the parent of each joint (-1 for the root)
+	std::vector<int> parentBones;
+
+	// frame_count * parentBones.size() joints, frame-major
+	std::vector<BakedJoint> joints;
+
+	// constructor will initialise to an empty clip
+	BakedClip();
+
+	// evaluate every frame of a loaded clip at the given scale
+	void Bake(BVHData& clip, float Scale);
+
+	// number of joints on each frame
+	int JointCount() const;
+
+	// the baked joints for a frame (the frame number wraps around)
+	const BakedJoint* Frame(int frame) const;
+
+	// rebuild every joint's transform for a frame from its orientation and position, as
+	// BVHData::EvaluatePose() would have computed it, e.g. for SkinnedMesh::AddPose()
+	void JointTransforms(int frame, std::vector<Matrix4>& transforms) const;
+
+	// render a frame, drawing a bone from each joint to its parent
+	void Render(Matrix4& viewMatrix, int frame, float groundHeight);
+
+	// Routines for file I/O
+	// write in the binary .bake format, returns false on failure
+	bool WriteFileBaked(const char* fileName);
+
+	// read a file written by WriteFileBaked(), returns false on failure, including when the
+	// sizes are more than the file holds or a joint's parent does not come before it
+	bool ReadFileBaked(const char* fileName);
+
+	// convert a rotation matrix to a packed quaternion
+	static void PackOrientation(const Matrix4& matrix, short orientation[4]);
+
+	// and unpack a quaternion back into a rotation matrix
+	static Matrix4 UnpackOrientation(const short orientation[4]);
+	}; // class BakedClip
+
+#endif
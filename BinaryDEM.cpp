@@ -0,0 +1,199 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	BinaryDEM.cpp
+//	------------------------
+//
+//	A binary heightfield file, mapped into memory rather
+//	than parsed.
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <math.h>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "BinaryDEM.h"
+
+// the header must be exactly the 64 bytes the samples follow
+static_assert(sizeof(BinaryDEMHeader) == 64, "BinaryDEMHeader must be 64 bytes");
+
+// constructor will initialise to safe values
+BinaryDEM::BinaryDEM()
+	:
+	floatSamples(NULL),
+	quantizedSamples(NULL),
+	mapping(NULL),
+	mappedBytes(0),
+	fileHandle(NULL),
+	mappingHandle(NULL)
+	{ // constructor
+	memset(&header, 0, sizeof(header));
+	} // constructor
+
+// unmaps the file
+BinaryDEM::~BinaryDEM()
+	{ // destructor
+	Close();
+	} // destructor
+
+// true if the file starts with a binary heightfield header
+bool BinaryDEM::IsBinary(const char *fileName)
+	{ // IsBinary()
+	FILE *file = fopen(fileName, "rb");
+	if (file == NULL)
+		return false;
+	uint32_t magic = 0;
+	bool binary = fread(&magic, sizeof(magic), 1, file) == 1 && magic == MAGIC;
+	fclose(file);
+	return binary;
+	} // IsBinary()
+
+// map the file
+bool BinaryDEM::Open(const char *fileName)
+	{ // Open()
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	HANDLE view = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart >= (LONGLONG) sizeof(BinaryDEMHeader))
+		view = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (view == NULL)
+		{ // failed
+		CloseHandle(file);
+		return false;
+		} // failed
+	fileHandle = file;
+	mappingHandle = view;
+	mappedBytes = (size_t) size.QuadPart;
+	mapping = MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+#else
+	int file = open(fileName, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size < (off_t) sizeof(BinaryDEMHeader))
+		{ // failed
+		close(file);
+		return false;
+		} // failed
+	mappedBytes = (size_t) status.st_size;
+	mapping = mmap(NULL, mappedBytes, PROT_READ, MAP_SHARED, file, 0);
+	// the mapping keeps the file open for us
+	close(file);
+	if (mapping == MAP_FAILED)
+		mapping = NULL;
+#endif
+	if (mapping == NULL)
+		{ // failed
+		Close();
+		return false;
+		} // failed
+
+	// check the header describes a grid that fits in the file
+	memcpy(&header, mapping, sizeof(header));
+	size_t sampleBytes = (header.sampleType == QUANTIZED_SAMPLES) ? sizeof(uint16_t) : sizeof(float);
+	bool valid = header.magic == MAGIC && header.version == VERSION
+		&& (header.sampleType == FLOAT_SAMPLES || header.sampleType == QUANTIZED_SAMPLES)
+		&& header.nRows > 0 && header.nColumns > 0
+		&& (uint64_t) header.nRows <= (mappedBytes - sizeof(header)) / sampleBytes / (uint64_t) header.nColumns;
+	if (!valid)
+		{ // invalid
+		Close();
+		return false;
+		} // invalid
+
+	const char *samples = (const char *) mapping + sizeof(header);
+	if (header.sampleType == FLOAT_SAMPLES)
+		floatSamples = (const float *) samples;
+	else
+		quantizedSamples = (const uint16_t *) samples;
+	return true;
+	} // Open()
+
+// unmap the file
+void BinaryDEM::Close()
+	{ // Close()
+#ifdef _WIN32
+	if (mapping != NULL)
+		UnmapViewOfFile(mapping);
+	if (mappingHandle != NULL)
+		CloseHandle((HANDLE) mappingHandle);
+	if (fileHandle != NULL)
+		CloseHandle((HANDLE) fileHandle);
+#else
+	if (mapping != NULL)
+		munmap(mapping, mappedBytes);
+#endif
+	mapping = NULL;
+	mappedBytes = 0;
+	fileHandle = mappingHandle = NULL;
+	floatSamples = NULL;
+	quantizedSamples = NULL;
+	memset(&header, 0, sizeof(header));
+	} // Close()
+
+// expand every sample into heights
+void BinaryDEM::Expand(float *heights) const
+	{ // Expand()
+	long count = header.nRows * header.nColumns;
+	if (floatSamples != NULL)
+		memcpy(heights, floatSamples, count * sizeof(float));
+	else if (quantizedSamples != NULL)
+		for (long sample = 0; sample < count; sample++)
+			heights[sample] = header.minimum + quantizedSamples[sample] * header.step;
+	} // Expand()
+
+// write heights to a file, quantizing them to 16 bits if asked
+bool BinaryDEM::Write(const char *fileName, const float *heights, long nRows, long nColumns, bool quantize)
+	{ // Write()
+	if (nRows <= 0 || nColumns <= 0)
+		return false;
+	FILE *file = fopen(fileName, "wb");
+	if (file == NULL)
+		return false;
+
+	long count = nRows * nColumns;
+	BinaryDEMHeader written;
+	memset(&written, 0, sizeof(written));
+	written.magic = MAGIC;
+	written.version = VERSION;
+	written.sampleType = quantize ? QUANTIZED_SAMPLES : FLOAT_SAMPLES;
+	written.nRows = nRows;
+	written.nColumns = nColumns;
+
+	bool ok;
+	if (!quantize)
+		ok = fwrite(&written, sizeof(written), 1, file) == 1 && (long) fwrite(heights, sizeof(float), count, file) == count;
+	else
+		{ // quantized
+		// spread the 65536 values evenly from the lowest height to the highest
+		float lowest = *std::min_element(heights, heights + count), highest = *std::max_element(heights, heights + count);
+		written.minimum = lowest;
+		written.step = (highest - lowest) / 65535.0f;
+		std::vector<uint16_t> samples(count);
+		for (long sample = 0; sample < count; sample++)
+			samples[sample] = (written.step > 0.0f) ? (uint16_t) std::min(floorf((heights[sample] - lowest) / written.step + 0.5f), 65535.0f) : 0;
+		ok = fwrite(&written, sizeof(written), 1, file) == 1 && (long) fwrite(&samples[0], sizeof(uint16_t), count, file) == count;
+		} // quantized
+
+	// a failed close means the data did not all reach the disk
+	if (fclose(file) != 0)
+		ok = false;
+	return ok;
+	} // Write()
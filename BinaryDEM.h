@@ -0,0 +1,97 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	BinaryDEM.h
+//	------------------------
+//
+//	A binary heightfield file, mapped into memory rather
+//	than parsed, so that opening one takes the same time
+//	however large it is: pages are read in by the OS as
+//	the heights are first touched.
+//
+//	The file is a 64 byte header followed by the heights,
+//	row by row from the top, as in a .dem file. They are
+//	either raw floats, which can be used where they lie,
+//	or 16-bit values quantized between the lowest and the
+//	highest height, which take half the space but must be
+//	expanded before use. Everything is little-endian.
+//
+///////////////////////////////////////////////////
+
+#ifndef _BINARY_DEM_H
+#define _BINARY_DEM_H
+
+#include <cstddef>
+#include <cstdint>
+
+// the header at the start of the file
+class BinaryDEMHeader
+	{ // class BinaryDEMHeader
+	public:
+	// BinaryDEM::MAGIC, and the version of the layout
+	uint32_t magic, version;
+
+	// BinaryDEM::FLOAT_SAMPLES or BinaryDEM::QUANTIZED_SAMPLES
+	uint32_t sampleType, reserved;
+
+	// the size of the grid
+	int64_t nRows, nColumns;
+
+	// a quantized sample q stands for minimum + q * step
+	float minimum, step;
+
+	// padding up to 64 bytes, so that the samples start aligned
+	uint32_t padding[6];
+	}; // class BinaryDEMHeader
+
+class BinaryDEM
+	{ // class BinaryDEM
+	public:
+	// "BDEM" read as a little-endian 32-bit value, and the version this code writes
+	enum { MAGIC = 0x4D454442, VERSION = 1 };
+
+	// the kinds of sample
+	enum { FLOAT_SAMPLES = 0, QUANTIZED_SAMPLES = 1 };
+
+	// the header of the open file
+	BinaryDEMHeader header;
+
+	// the samples, where they lie in the mapping: one of these is set while a file is open
+	const float *floatSamples;
+	const uint16_t *quantizedSamples;
+
+	// the mapping itself
+	void *mapping;
+	size_t mappedBytes;
+
+	// on Windows, the file and the mapping object
+	void *fileHandle, *mappingHandle;
+
+	// constructor will initialise to safe values
+	BinaryDEM();
+
+	// unmaps the file
+	~BinaryDEM();
+
+	// a mapping belongs to one object only
+	BinaryDEM(const BinaryDEM &) = delete;
+	BinaryDEM &operator=(const BinaryDEM &) = delete;
+
+	// true if the file starts with a binary heightfield header
+	static bool IsBinary(const char *fileName);
+
+	// map the file: returns false if it cannot be opened or is not a valid binary heightfield
+	bool Open(const char *fileName);
+
+	// unmap the file
+	void Close();
+
+	// expand every sample into heights, which must have room for nRows * nColumns floats
+	void Expand(float *heights) const;
+
+	// write heights (nRows * nColumns of them, row by row) to a file, quantizing them to
+	// 16 bits if asked: returns false if the file cannot be written
+	static bool Write(const char *fileName, const float *heights, long nRows, long nColumns, bool quantize);
+	}; // class BinaryDEM
+
+#endif
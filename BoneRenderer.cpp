@@ -0,0 +1,427 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	BoneRenderer.cpp
+//	------------------------
+//
+//	Draws the cylinders that stand for a character's bones,
+//	as one cached unit cylinder and a matrix per bone.
+//
+///////////////////////////////////////////////////
+
+#include "GLSupport.h"
+#include <cstdio>
+#include <math.h>
+
+#include "BoneRenderer.h"
+#include "ParallelFor.h"
+
+// the radius BVHData has always drawn bones with
+const float BoneRenderer::radius = 0.2f;
+
+// the generic attributes the instancing shader reads: the matrix takes four in a row
+enum { POSITION_ATTRIBUTE = 0, NORMAL_ATTRIBUTE = 1, MATRIX_ATTRIBUTE = 2 };
+
+// transforms the unit cylinder by the bone's matrix, then lights it as the fixed pipeline
+// would with GL_LIGHT0 and the front material (the scene uses no specular), once per
+// triangle at its last vertex, just as GL_FLAT does
+static const char *vertexShaderSource =
+	"#version 130\n"
+	"in vec3 position;\n"
+	"in vec3 normal;\n"
+	"in mat4 boneMatrix;\n"
+	"flat out vec4 colour;\n"
+	"void main()\n"
+	"	{\n"
+	"	vec4 eye = gl_ModelViewMatrix * (boneMatrix * vec4(position, 1.0));\n"
+	"	// the bone only scales along and across its axis, which the normals are aligned with,\n"
+	"	// so its own matrix takes them to the right direction\n"
+	"	vec3 unitNormal = normalize(gl_NormalMatrix * (mat3(boneMatrix) * normal));\n"
+	"	vec4 light = gl_LightSource[0].position;\n"
+	"	vec3 toLight = normalize(light.w == 0.0 ? light.xyz : light.xyz / light.w - eye.xyz / eye.w);\n"
+	"	vec4 lit = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient\n"
+	"		+ max(dot(unitNormal, toLight), 0.0) * gl_FrontLightProduct[0].diffuse;\n"
+	"	colour = clamp(vec4(lit.rgb, gl_FrontMaterial.diffuse.a), 0.0, 1.0);\n"
+	"	gl_Position = gl_ProjectionMatrix * eye;\n"
+	"	}\n";
+
+static const char *fragmentShaderSource =
+	"#version 130\n"
+	"flat in vec4 colour;\n"
+	"void main()\n"
+	"	{\n"
+	"	gl_FragColor = colour;\n"
+	"	}\n";
+
+// constructor will initialise to safe values
+BoneRenderer::BoneRenderer()
+	:
+	drawMode(AUTOMATIC),
+	uprightMatrix(Matrix4::Identity()),
+	meshVertexCount(0),
+	initialised(false),
+	displayList(0),
+	meshBuffer(0),
+	instanceBuffer(0),
+	streamBuffer(0),
+	program(0),
+	drawCalls(0),
+	bonesDrawn(0),
+	verticesSubmitted(0)
+	{ // constructor
+	BuildMesh();
+	} // constructor
+
+// set the view matrix for the bones that follow
+void BoneRenderer::SetView(const Matrix4 &viewMatrix)
+	{ // SetView()
+	// rotate so the character stands upright
+	uprightMatrix = viewMatrix * Matrix4::RotateX(270);
+	} // SetView()
+
+// queue a bone from start to end
+void BoneRenderer::AddBone(const Cartesian3 &start, const Cartesian3 &end)
+	{ // AddBone()
+	Cartesian3 along = end - start;
+	float length = along.length();
+	// a bone of no length has no direction, and would not be seen anyway
+	if (length == 0.0f)
+		return;
+
+	// the rotation taking the z axis onto the bone, as Matrix4::GetRotation() builds it,
+	// but written out for a unit z axis so that it needs no pow() and no second sqrt()
+	float dx = along.x / length, dy = along.y / length, dz = along.z / length;
+	float rotation[3][3];
+	if (dz > -0.999999f)
+		{ // about the axis z x bone
+		float k = 1.0f / (1.0f + dz);
+		rotation[0][0] = dz + dy * dy * k;	rotation[0][1] = -dx * dy * k;		rotation[0][2] = dx;
+		rotation[1][0] = -dx * dy * k;		rotation[1][1] = dz + dx * dx * k;	rotation[1][2] = dy;
+		rotation[2][0] = -dx;				rotation[2][1] = -dy;				rotation[2][2] = dz;
+		} // about the axis z x bone
+	else
+		{ // straight down
+		// the axis is undefined, so turn half way round x
+		rotation[0][0] = 1.0f;	rotation[0][1] = 0.0f;	rotation[0][2] = 0.0f;
+		rotation[1][0] = 0.0f;	rotation[1][1] = -1.0f;	rotation[1][2] = 0.0f;
+		rotation[2][0] = 0.0f;	rotation[2][1] = 0.0f;	rotation[2][2] = -1.0f;
+		} // straight down
+
+	// the bone's matrix is uprightMatrix * Translate(start) * rotation * scale(radius, radius, length):
+	// the first two columns are the rotation's scaled by the radius, the third is the bone itself
+	// and the last is where it starts
+	float columns[3][3] =
+		{
+		{ radius * rotation[0][0], radius * rotation[1][0], radius * rotation[2][0] },
+		{ radius * rotation[0][1], radius * rotation[1][1], radius * rotation[2][1] },
+		{ along.x, along.y, along.z }
+		};
+	size_t first = boneMatrices.size();
+	boneMatrices.resize(first + 16);
+	float *out = &boneMatrices[first];
+	for (int column = 0; column < 3; column++)
+		{ // per column
+		for (int row = 0; row < 3; row++)
+			out[4 * column + row] = uprightMatrix.coordinates[row][0] * columns[column][0]
+				+ uprightMatrix.coordinates[row][1] * columns[column][1]
+				+ uprightMatrix.coordinates[row][2] * columns[column][2];
+		out[4 * column + 3] = 0.0f;
+		} // per column
+	for (int row = 0; row < 4; row++)
+		out[12 + row] = uprightMatrix.coordinates[row][0] * start.x + uprightMatrix.coordinates[row][1] * start.y
+			+ uprightMatrix.coordinates[row][2] * start.z + uprightMatrix.coordinates[row][3];
+	} // AddBone()
+
+// build the unit cylinder, with the same triangles and normals BVHData used to draw
+void BoneRenderer::BuildMesh()
+	{ // BuildMesh()
+	meshVertices.clear();
+	for (int i = 0; i < slices; i++)
+		{ // per slice
+		// work out the angles around the main axis for the start and end of the slice
+		float theta = (float)(i * 2.0f * M_PI / slices);
+		float nextTheta = (float)((i + 1) * 2.0f * M_PI / slices);
+		float midTheta = 0.5 * (theta + nextTheta);
+
+		// two points on the upper circle, two on the lower, and the middles of the ends
+		Cartesian3 top(0, 0, 1), bottom(0, 0, 0);
+		Cartesian3 edge1(cos(theta), sin(theta), 1), edge2(cos(nextTheta), sin(nextTheta), 1);
+		Cartesian3 edge3(cos(nextTheta), sin(nextTheta), 0), edge4(cos(theta), sin(theta), 0);
+
+		// a normal for the top, one for the side and one for the bottom
+		Cartesian3 up(0, 0, 1), side(cos(midTheta), sin(midTheta), 0), down(0, 0, -1);
+
+		// the top triangle, the two side triangles and the bottom triangle
+		const Cartesian3 *triangles[4][4] =
+			{
+			{ &up, &top, &edge1, &edge2 },
+			{ &side, &edge2, &edge1, &edge4 },
+			{ &side, &edge2, &edge4, &edge3 },
+			{ &down, &edge3, &edge4, &bottom }
+			};
+		for (int triangle = 0; triangle < 4; triangle++)
+			for (int vertex = 1; vertex < 4; vertex++)
+				{ // per vertex
+				const Cartesian3 &position = *triangles[triangle][vertex], &normal = *triangles[triangle][0];
+				float values[6] = { position.x, position.y, position.z, normal.x, normal.y, normal.z };
+				meshVertices.insert(meshVertices.end(), values, values + 6);
+				} // per vertex
+		} // per slice
+	meshVertexCount = (long) meshVertices.size() / 6;
+	} // BuildMesh()
+
+// create the OpenGL objects and settle on a draw mode
+void BoneRenderer::Initialise()
+	{ // Initialise()
+	initialised = true;
+
+	// software renderers transform every vertex on the CPU anyway, so instancing gains them nothing,
+	// and streaming only adds a copy: under llvmpipe the display list is the quickest of the three
+	if (drawMode == AUTOMATIC)
+		{ // choose
+		if (GLSupport::IsSoftware())
+			drawMode = DISPLAY_LIST;
+		else
+			drawMode = GLSupport::HasInstancing() ? INSTANCED : STREAMED;
+		} // choose
+	if (drawMode == INSTANCED && !BuildProgram())
+		drawMode = STREAMED;
+
+	if (drawMode == DISPLAY_LIST)
+		{ // display list
+		displayList = glGenLists(1);
+		glNewList(displayList, GL_COMPILE);
+		glBegin(GL_TRIANGLES);
+		for (long vertex = 0; vertex < meshVertexCount; vertex++)
+			{ // per vertex
+			glNormal3fv(&meshVertices[6 * vertex + 3]);
+			glVertex3fv(&meshVertices[6 * vertex]);
+			} // per vertex
+		glEnd();
+		glEndList();
+		} // display list
+	} // Initialise()
+
+// compile and link the instancing shaders: returns false if they cannot be used
+bool BoneRenderer::BuildProgram()
+	{ // BuildProgram()
+#ifdef GL_SUPPORT_INSTANCING
+	if (!GLSupport::HasInstancing())
+		return false;
+
+	// compile each stage, reporting why if it fails
+	const char *sources[2] = { vertexShaderSource, fragmentShaderSource };
+	GLenum stages[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	GLuint shaders[2];
+	GLint ok = GL_TRUE;
+	for (int stage = 0; stage < 2; stage++)
+		{ // per stage
+		shaders[stage] = glCreateShader(stages[stage]);
+		glShaderSource(shaders[stage], 1, &sources[stage], NULL);
+		glCompileShader(shaders[stage]);
+		GLint compiled = GL_FALSE;
+		glGetShaderiv(shaders[stage], GL_COMPILE_STATUS, &compiled);
+		if (compiled != GL_TRUE)
+			{ // failed
+			char log[1024] = "";
+			glGetShaderInfoLog(shaders[stage], sizeof(log), NULL, log);
+			printf("BoneRenderer: shader failed to compile: %s\n", log);
+			ok = GL_FALSE;
+			} // failed
+		} // per stage
+
+	// then link them, with the attributes where DrawInstanced() expects them
+	program = glCreateProgram();
+	for (int stage = 0; stage < 2; stage++)
+		{ // per stage
+		glAttachShader(program, shaders[stage]);
+		// the program keeps them for as long as it needs them
+		glDeleteShader(shaders[stage]);
+		} // per stage
+	glBindAttribLocation(program, POSITION_ATTRIBUTE, "position");
+	glBindAttribLocation(program, NORMAL_ATTRIBUTE, "normal");
+	glBindAttribLocation(program, MATRIX_ATTRIBUTE, "boneMatrix");
+	if (ok == GL_TRUE)
+		{ // compiled
+		glLinkProgram(program);
+		glGetProgramiv(program, GL_LINK_STATUS, &ok);
+		} // compiled
+	if (ok != GL_TRUE)
+		{ // failed
+		glDeleteProgram(program);
+		program = 0;
+		return false;
+		} // failed
+
+	// the cylinder goes up once, while the matrices are streamed every frame
+	glGenBuffers(1, &meshBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, meshBuffer);
+	glBufferData(GL_ARRAY_BUFFER, meshVertices.size() * sizeof(float), meshVertices.data(), GL_STATIC_DRAW);
+	glGenBuffers(1, &instanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+#else
+	return false;
+#endif
+	} // BuildProgram()
+
+// draw every queued bone, and empty the queue
+void BoneRenderer::Draw()
+	{ // Draw()
+	bonesDrawn = BoneCount();
+	verticesSubmitted = bonesDrawn * meshVertexCount;
+	drawCalls = 0;
+	if (boneMatrices.empty())
+		return;
+	if (!initialised)
+		Initialise();
+
+	if (drawMode == INSTANCED)
+		DrawInstanced();
+	else if (drawMode == STREAMED)
+		DrawStreamed();
+	else
+		DrawDisplayList();
+	boneMatrices.clear();
+	} // Draw()
+
+// free the OpenGL objects
+void BoneRenderer::ReleaseBuffers()
+	{ // ReleaseBuffers()
+	if (displayList != 0)
+		glDeleteLists(displayList, 1);
+#ifdef GL_SUPPORT_BUFFERS
+	unsigned int buffers[] = { meshBuffer, instanceBuffer, streamBuffer };
+	for (unsigned int buffer : buffers)
+		if (buffer != 0)
+			glDeleteBuffers(1, &buffer);
+#endif
+#ifdef GL_SUPPORT_INSTANCING
+	if (program != 0)
+		glDeleteProgram(program);
+#endif
+	displayList = meshBuffer = instanceBuffer = streamBuffer = program = 0;
+	initialised = false;
+	} // ReleaseBuffers()
+
+// draw the batch as one instanced call
+void BoneRenderer::DrawInstanced()
+	{ // DrawInstanced()
+#ifdef GL_SUPPORT_INSTANCING
+	glUseProgram(program);
+
+	// the cylinder, the same for every instance
+	glBindBuffer(GL_ARRAY_BUFFER, meshBuffer);
+	glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+	glEnableVertexAttribArray(NORMAL_ATTRIBUTE);
+	glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (const void *) 0);
+	glVertexAttribPointer(NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (const void *) (3 * sizeof(float)));
+
+	// and one matrix per instance, a column in each of four attributes
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, boneMatrices.size() * sizeof(float), boneMatrices.data(), GL_STREAM_DRAW);
+	for (int column = 0; column < 4; column++)
+		{ // per column
+		glEnableVertexAttribArray(MATRIX_ATTRIBUTE + column);
+		glVertexAttribPointer(MATRIX_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (const void *) (4 * column * sizeof(float)));
+		glVertexAttribDivisor(MATRIX_ATTRIBUTE + column, 1);
+		} // per column
+
+	glDrawArraysInstanced(GL_TRIANGLES, 0, meshVertexCount, BoneCount());
+	drawCalls = 1;
+
+	// then put everything back the way we found it
+	for (int column = 0; column < 4; column++)
+		{ // per column
+		glVertexAttribDivisor(MATRIX_ATTRIBUTE + column, 0);
+		glDisableVertexAttribArray(MATRIX_ATTRIBUTE + column);
+		} // per column
+	glDisableVertexAttribArray(NORMAL_ATTRIBUTE);
+	glDisableVertexAttribArray(POSITION_ATTRIBUTE);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glUseProgram(0);
+#endif
+	} // DrawInstanced()
+
+// draw the batch as one vertex array, transformed here and streamed to OpenGL
+void BoneRenderer::DrawStreamed()
+	{ // DrawStreamed()
+	long bones = BoneCount();
+	streamVertices.resize(6 * bones * meshVertexCount);
+	ParallelFor(bones, 64, [this](long begin, long end)
+		{ // transform
+		for (long bone = begin; bone < end; bone++)
+			{ // per bone
+			const float *matrix = &boneMatrices[16 * bone];
+			// the first three columns are at right angles, so each mesh normal, which lies along
+			// them, only needs them made unit length to come out as a unit normal of the bone
+			float axes[3][3];
+			for (int column = 0; column < 3; column++)
+				{ // per column
+				const float *c = matrix + 4 * column;
+				float scale = 1.0f / sqrtf(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+				axes[column][0] = c[0] * scale;	axes[column][1] = c[1] * scale;	axes[column][2] = c[2] * scale;
+				} // per column
+
+			float *out = &streamVertices[6 * bone * meshVertexCount];
+			for (long vertex = 0; vertex < meshVertexCount; vertex++, out += 6)
+				{ // per vertex
+				const float *in = &meshVertices[6 * vertex];
+				for (int row = 0; row < 3; row++)
+					{ // per coordinate
+					out[row] = matrix[row] * in[0] + matrix[4 + row] * in[1] + matrix[8 + row] * in[2] + matrix[12 + row];
+					out[3 + row] = axes[0][row] * in[3] + axes[1][row] * in[4] + axes[2][row] * in[5];
+					} // per coordinate
+				} // per vertex
+			} // per bone
+		}); // transform
+
+	// point at a buffer object, or at our own copy if there isn't one
+	const char *base = (const char *) streamVertices.data();
+#ifdef GL_SUPPORT_BUFFERS
+	if (GLSupport::HasBuffers())
+		{ // buffer object
+		if (streamBuffer == 0)
+			glGenBuffers(1, &streamBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, streamBuffer);
+		// fresh storage every frame, so the driver can let last frame's draw finish
+		// with the old storage rather than make us wait for it
+		glBufferData(GL_ARRAY_BUFFER, streamVertices.size() * sizeof(float), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, streamVertices.size() * sizeof(float), streamVertices.data());
+		base = NULL;
+		} // buffer object
+#endif
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), base);
+	glNormalPointer(GL_FLOAT, 6 * sizeof(float), base + 3 * sizeof(float));
+
+	glDrawArrays(GL_TRIANGLES, 0, bones * meshVertexCount);
+	drawCalls = 1;
+
+	// then put everything back the way we found it
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+#ifdef GL_SUPPORT_BUFFERS
+	if (streamBuffer != 0)
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+	} // DrawStreamed()
+
+// draw the batch by calling the display list once per bone
+void BoneRenderer::DrawDisplayList()
+	{ // DrawDisplayList()
+	// the bones are scaled, so OpenGL must renormalise the normals
+	glPushAttrib(GL_ENABLE_BIT);
+	glEnable(GL_NORMALIZE);
+	glMatrixMode(GL_MODELVIEW);
+	for (long bone = 0; bone < BoneCount(); bone++)
+		{ // per bone
+		glPushMatrix();
+		glMultMatrixf(&boneMatrices[16 * bone]);
+		glCallList(displayList);
+		glPopMatrix();
+		} // per bone
+	glPopAttrib();
+	drawCalls = BoneCount();
+	} // DrawDisplayList()
@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	BoneRenderer.h
+//	------------------------
+//
+//	Draws the cylinders that stand for a character's bones.
+//	There is one unit cylinder, sent to OpenGL once, and
+//	each bone is just the matrix that stretches it from one
+//	joint to the next. Bones are queued with AddBone() and
+//	all drawn by one Draw(), so every bone of every
+//	character can go in a single batch.
+//
+//	Where the context has instancing, the whole batch is
+//	one instanced draw call. Otherwise every bone's cylinder
+//	is transformed on the CPU into one vertex array, which
+//	is streamed to OpenGL and drawn with a single call.
+//	Under a software renderer, which gains nothing from
+//	either, the cylinder is a display list called once per
+//	bone.
+//
+///////////////////////////////////////////////////
+
+#ifndef _BONE_RENDERER_H
+#define _BONE_RENDERER_H
+
+#include <vector>
+
+#include "Cartesian3.h"
+#include "Matrix4.h"
+
+class BoneRenderer
+	{ // class BoneRenderer
+	public:
+	// how Draw() draws: AUTOMATIC picks one of the others the first time it is called
+	enum { AUTOMATIC, INSTANCED, STREAMED, DISPLAY_LIST };
+	int drawMode;
+
+	// every bone has this radius, and the cylinder this many slices round its axis
+	static const float radius;
+	static const int slices = 8;
+
+	// the view matrix set by SetView(), already turned so that the character stands upright
+	Matrix4 uprightMatrix;
+
+	// the queued bones: a column-major matrix of 16 floats each, taking the unit cylinder to the bone
+	std::vector<float> boneMatrices;
+
+	// the unit cylinder: three floats of position then three of normal per vertex
+	std::vector<float> meshVertices;
+	long meshVertexCount;
+
+	// the whole batch transformed for STREAMED, laid out as meshVertices is
+	std::vector<float> streamVertices;
+
+	// the OpenGL objects, created the first time Draw() is called
+	bool initialised;
+	unsigned int displayList;
+	unsigned int meshBuffer, instanceBuffer, streamBuffer;
+	unsigned int program;
+
+	// what the last Draw() sent: draw calls, bones, and the vertices the calls covered
+	long drawCalls, bonesDrawn, verticesSubmitted;
+
+	// constructor will initialise to safe values
+	BoneRenderer();
+
+	// set the view matrix for the bones that follow, as RenderCylinder() takes it
+	void SetView(const Matrix4 &viewMatrix);
+
+	// queue a bone from start to end
+	void AddBone(const Cartesian3 &start, const Cartesian3 &end);
+
+	// how many bones are queued
+	long BoneCount() const { return (long) boneMatrices.size() / 16; }
+
+	// draw every queued bone, and empty the queue (there must be a current context)
+	void Draw();
+
+	// free the OpenGL objects while the context they were made in is still current: the next
+	// Draw() creates them again, and settles on a draw mode again if it was left AUTOMATIC
+	void ReleaseBuffers();
+
+	private:
+	// build the unit cylinder, with the same triangles and normals BVHData used to draw
+	void BuildMesh();
+
+	// create the OpenGL objects and settle on a draw mode
+	void Initialise();
+
+	// compile and link the instancing shaders: returns false if they cannot be used
+	bool BuildProgram();
+
+	// the three ways to draw the batch
+	void DrawInstanced();
+	void DrawStreamed();
+	void DrawDisplayList();
+	}; // class BoneRenderer
+
+#endif
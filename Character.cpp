@@ -0,0 +1,234 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Character.cpp
+//	------------------------
+//
+//	A single animated character: which cycle it is playing,
+//	how far through a blend it is, and where it is standing.
+//	Step() advances the character by one tick without any
+//	GL calls; Render() only draws the pose Step() produced.
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <limits>
+
+#include "Character.h"
+#include "FrameProfiler.h"
+
+// characters are drawn at 1/10th of the size in the file
+const float Character::scale = 0.1;
+
+// and turned so that they stand upright, as BoneRenderer::SetView() turns them
+static const Matrix4 uprightRotation = Matrix4::RotateX(270);
+
+// constructor puts the character at the origin in the rest pose
+Character::Character()
+    :
+    currentAnim(REST),
+    previousAnim(REST),
+    currentlyBlending(false),
+    t(0.0),
+    blendFrame(0),
+    frameNumber(0),
+    move(false),
+    walk(false),
+    turn(0),
+    skinning(SkinnedMesh::LINEAR_BLEND),
+    groundHeight(0.0),
+    poseClip(NULL),
+    poseChanged(true),
+    wasStill(false)
+    { // constructor
+    Reset();
+    } // constructor
+
+// start blending to another animation
+bool Character::StartAnimation(int anim, bool Move, bool Walk, int Turn)
+    { // StartAnimation()
+
+    //Only allow action if blending is not occuring, and when changing animations
+    if(currentlyBlending || (currentAnim == anim))
+        return false;
+
+    currentlyBlending = true;
+    previousAnim = currentAnim;
+    currentAnim = anim;
+    move = Move;
+    walk = Walk;
+    turn = Turn;
+    blendFrame = 0;
+    t = 1.0;
+    return true;
+
+    } // StartAnimation()
+
+// reset character to original position
+void Character::Reset()
+	{ // Reset()
+	characterLocation = Cartesian3(0, 0, 0);
+	characterRotation = Matrix4::Identity();
+    characterTransform = Matrix4::Identity();
+    // we may have moved, so the next Step() cannot count on the pose it left last time
+    wasStill = false;
+	} // Reset()
+
+// advance by one tick
+void Character::Step(std::vector<BVHData*>& cycles, std::vector<std::vector<Retarget>>& retargetMaps, Terrain& ground)
+    { // Step()
+    //Standing still in a single-frame clip gives the same result every tick, once any blend into it has
+    //finished: but the first such tick still follows a different pose, so only the ones after it change nothing,
+    //and then only if the ground under it stays put, which a streamed terrain's does not as its tiles come in
+    bool still = !move && turn == 0 && !currentlyBlending && cycles[currentAnim]->frame_count <= 1;
+    poseChanged = !(still && wasStill);
+    wasStill = still;
+
+	// increment the frame counter
+    frameNumber++;
+
+    //If the character is moving, update its position
+    if(move){
+        //Go slower if the character is turning
+        if (turn == 1 || turn == 2)
+            characterLocation.y = -0.35;
+        //Slowest pace when walking
+        else if(walk)
+            characterLocation.y = -0.2;
+        //Go quickest when running
+        else
+            characterLocation.y = -0.5;
+    }
+    else
+        characterLocation.y = 0;
+
+    //Turn the character if necessary
+    if(turn == 1)
+        characterRotation = Matrix4::RotateZ(355); //Left
+    else if (turn == 2)
+        characterRotation = Matrix4::RotateZ(5); // Right
+    else
+        characterRotation = Matrix4::Identity(); // No turn
+
+    //Apply the movement and orientation changes to the character's position
+    characterTransform = characterTransform * Matrix4::Translate(characterLocation) * characterRotation;
+
+    //Get the character's position in the ground's coordinate system, so we can get the terrain height
+    Cartesian3 characterPos = characterTransform * Cartesian3(0,0,0);
+    float previousHeight = groundHeight;
+    groundHeight = ground.getHeight(characterPos.x, characterPos.z);
+    if (groundHeight != previousHeight)
+        poseChanged = true;
+
+    //While blending, the skeleton is still the one we are blending away from
+    poseClip = cycles[currentlyBlending ? previousAnim : currentAnim];
+    poseRotations = poseClip->boneRotations[frameNumber % poseClip->frame_count];
+
+    if(currentlyBlending)
+    {
+        ScopedPhase timer(PHASE_BLEND);
+
+        //Sample the animation we are blending to onto our skeleton
+        //Joints the other rig doesn't have keep this animation's rotation
+        blendRotations = poseRotations;
+        retargetMaps[previousAnim][currentAnim].SampleRotations(*cycles[currentAnim], blendFrame, blendRotations);
+
+        //Interpolate the angles
+        for (size_t joint = 0; joint < poseRotations.size(); joint++)
+            poseRotations[joint] = poseRotations[joint] * t + blendRotations[joint] * (1-t);
+    }
+
+    //Evaluate the pose, standing on the ground
+    ScopedPhase poseTimer(PHASE_POSE);
+    poseClip->EvaluatePose(poseRotations, Matrix4::Translate({0, groundHeight, 0}), scale, jointTransforms);
+
+    //Find the box the bones lie in, placed as Render() places them, so the scene can skip us when out of view
+    //Each joint sits at the origin of its own coordinate system, so its position is its transform's last column
+    Matrix4 upright = characterTransform * uprightRotation;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float lowest = std::numeric_limits<float>::max(), highest = -lowest;
+        for (size_t joint = 0; joint < jointTransforms.size(); joint++)
+        {
+            const Matrix4& transform = jointTransforms[joint];
+            float position = upright.coordinates[axis][0] * transform.coordinates[0][3] + upright.coordinates[axis][1] * transform.coordinates[1][3]
+                + upright.coordinates[axis][2] * transform.coordinates[2][3] + upright.coordinates[axis][3];
+            lowest = std::min(lowest, position);
+            highest = std::max(highest, position);
+        }
+        boundsMinimum[axis] = lowest;
+        boundsMaximum[axis] = highest;
+    }
+    Cartesian3 pad(BoneRenderer::radius, BoneRenderer::radius, BoneRenderer::radius);
+    boundsMinimum = boundsMinimum - pad;
+    boundsMaximum = boundsMaximum + pad;
+
+    if(currentlyBlending)
+    {
+        //Update values for next iteration
+        blendFrame += 1;
+
+        //The animation blend lasts for 0.5s (i.e. 12 frames out of the 24fps)
+        t -= (1.0 / 12.0);
+
+        //Check whether to stop blending
+        if(t < 0)
+        {
+            //Make the blended animation the current one
+            currentlyBlending = false;
+            frameNumber = blendFrame;
+        }
+    }
+
+    } // Step()
+
+// queue the pose computed by the last Step() in bones, for bones.Draw() to draw
+void Character::Render(Matrix4& viewMatrix, BoneRenderer& bones)
+    { // Render()
+    // nothing to draw until we have been stepped once
+    if (poseClip == NULL)
+        return;
+
+    Matrix4 characterPosition = viewMatrix * characterTransform;
+    poseClip->RenderPose(characterPosition, jointTransforms, bones);
+    } // Render()
+
+// constructor will initialise to safe values
+CharacterPose::CharacterPose()
+    :
+    poseClip(NULL),
+    skinning(SkinnedMesh::LINEAR_BLEND)
+    { // constructor
+    } // constructor
+
+// copy the pose from a character
+void CharacterPose::Capture(const Character& character)
+    { // Capture()
+    poseClip = character.poseClip;
+    characterTransform = character.characterTransform;
+    jointTransforms.assign(character.jointTransforms.begin(), character.jointTransforms.end());
+    boundsMinimum = character.boundsMinimum;
+    boundsMaximum = character.boundsMaximum;
+    skinning = character.skinning;
+    } // Capture()
+
+// queue the pose in bones, for bones.Draw() to draw
+void CharacterPose::Render(Matrix4& viewMatrix, BoneRenderer& bones) const
+    { // Render()
+    // nothing to draw until the character has been stepped once
+    if (poseClip == NULL)
+        return;
+
+    Matrix4 characterPosition = viewMatrix * characterTransform;
+    poseClip->RenderPose(characterPosition, jointTransforms, bones);
+    } // Render()
+
+// queue the pose in mesh, placed as Render() places the bones
+void CharacterPose::Skin(SkinnedMesh& mesh) const
+    { // Skin()
+    // nothing to skin until the character has been stepped once
+    if (poseClip == NULL)
+        return;
+
+    mesh.AddPose(poseClip, jointTransforms, characterTransform * uprightRotation, skinning);
+    } // Skin()
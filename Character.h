@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Character.h
+//	------------------------
+//
+//	A single animated character: which cycle it is playing,
+//	how far through a blend it is, and where it is standing.
+//	Step() advances the character by one tick without any
+//	GL calls; Render() only draws the pose Step() produced.
+//
+//	A CharacterPose is a copy of just what Render() needs,
+//	so that the pose can be drawn on one thread while the
+//	character is stepped on another.
+//
+///////////////////////////////////////////////////
+
+#ifndef _CHARACTER_H
+#define _CHARACTER_H
+
+#include <vector>
+
+#include "BVHData.h"
+#include "Retarget.h"
+#include "SkinnedMesh.h"
+#include "Terrain.h"
+#include "Matrix4.h"
+
+class Character
+	{ // class Character
+	public:
+    enum
+    {
+        REST,
+        RUNNING,
+        WALKING,
+        TURN_LEFT,
+        TURN_RIGHT,
+        N_ANIMATIONS
+    };
+
+    //Characters are drawn at this fraction of the size in their files
+    static const float scale;
+
+    //Which animation is playing (or being blended to)
+    int currentAnim;
+
+    //The animation being blended away from
+    int previousAnim;
+
+    //Blend state: t runs from 1 (all previousAnim) down to 0 (all currentAnim)
+    bool currentlyBlending;
+    float t;
+    int blendFrame;
+
+	// the frame number of the animation that is playing
+	unsigned long frameNumber;
+
+	// location & orientation of character
+    Matrix4 characterTransform;
+	Cartesian3 characterLocation;
+	Matrix4 characterRotation;
+    bool move;
+    bool walk;
+    int turn;
+
+	// how the character's mesh is skinned: SkinnedMesh::LINEAR_BLEND or DUAL_QUATERNION
+	int skinning;
+
+	// the results of the last Step(), which is all that Render() needs
+	// height of the ground under the character
+	float groundHeight;
+	// the clip whose skeleton the pose belongs to
+	BVHData* poseClip;
+	// every joint's transform in the character's coordinate system
+	std::vector<Matrix4> jointTransforms;
+	// the box the bones lie in, in the coordinates Render()'s viewMatrix is applied to
+	Cartesian3 boundsMinimum, boundsMaximum;
+	// false when the last Step() left everything above exactly as it was, the ground height included,
+	// so there is nothing new to draw
+	bool poseChanged;
+
+	// constructor puts the character at the origin in the rest pose
+	Character();
+
+	// start blending to another animation: returns false if a blend is already running
+	// or the character is already playing it
+	bool StartAnimation(int anim, bool Move, bool Walk, int Turn);
+
+	// reset character to original position
+	void Reset();
+
+	// advance by one tick: movement, ground height, pose evaluation and blend progression
+	// retargetMaps[to][from] maps cycle "from" onto the rig of cycle "to"
+	void Step(std::vector<BVHData*>& cycles, std::vector<std::vector<Retarget>>& retargetMaps, Terrain& ground);
+
+	// queue the pose computed by the last Step() in bones, for bones.Draw() to draw
+	void Render(Matrix4& viewMatrix, BoneRenderer& bones);
+
+	private:
+	// scratch space for the pose, kept to avoid reallocating every tick
+	std::vector<Cartesian3> poseRotations;
+	std::vector<Cartesian3> blendRotations;
+	// true if the last Step() found the character standing still in a single-frame clip
+	bool wasStill;
+	}; // class Character
+
+// the results of a character's last Step(), as Character::Render() draws them
+class CharacterPose
+	{ // class CharacterPose
+	public:
+	// the clip whose skeleton the pose belongs to (NULL until the character has been stepped)
+	BVHData* poseClip;
+	// where the character stands, and every joint's transform relative to that
+	Matrix4 characterTransform;
+	std::vector<Matrix4> jointTransforms;
+	// the box the bones lie in, in the coordinates Render()'s viewMatrix is applied to
+	Cartesian3 boundsMinimum, boundsMaximum;
+	// how the mesh is skinned to the pose
+	int skinning;
+
+	// constructor will initialise to safe values
+	CharacterPose();
+
+	// copy the pose from a character (reusing the storage already here)
+	void Capture(const Character& character);
+
+	// queue the pose in bones, for bones.Draw() to draw
+	void Render(Matrix4& viewMatrix, BoneRenderer& bones) const;
+
+	// queue the pose in mesh, placed as Render() places the bones and skinned as the character
+	// asked, for mesh.Skin() to skin
+	void Skin(SkinnedMesh& mesh) const;
+	}; // class CharacterPose
+
+#endif
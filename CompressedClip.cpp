@@ -0,0 +1,260 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	CompressedClip.cpp
+//	------------------------
+//
+//	A compact, lossy copy of a BVH clip: each joint's
+//	rotation is a track of 16-bit keys quantized over the
+//	track's own range, with every key that linear
+//	interpolation can reproduce within an angular error
+//	bound removed. A track too short to gain from that is
+//	kept as raw values instead
+//
+///////////////////////////////////////////////////
+
+#include "CompressedClip.h"
+#include <algorithm>
+#include <math.h>
+
+// the largest quantized value
+static const float quantizationSteps = 65535.0f;
+
+// constructor will initialise to an empty track
+CompressedTrack::CompressedTrack()
+	{ // constructor
+	for (int channel = 0; channel < 3; channel++)
+		minimum[channel] = extent[channel] = 0.0f;
+	} // constructor
+
+// decode a single key
+Cartesian3 CompressedTrack::Key(size_t key) const
+	{ // Key()
+	const unsigned short* values = &keyValues[3 * key];
+	return Cartesian3(	minimum[0] + extent[0] * (values[0] / quantizationSteps),
+						minimum[1] + extent[1] * (values[1] / quantizationSteps),
+						minimum[2] + extent[2] * (values[2] / quantizationSteps));
+	} // Key()
+
+// decode the value of the track at a given frame
+Cartesian3 CompressedTrack::Sample(int frame) const
+	{ // Sample()
+	// raw tracks have every frame
+	if (!rawValues.empty())
+		return rawValues[std::min(std::max(frame, 0), (int) rawValues.size() - 1)];
+
+	// constant tracks have a single key
+	if (keyFrames.size() == 1 || frame <= keyFrames.front())
+		return Key(0);
+	if (frame >= keyFrames.back())
+		return Key(keyFrames.size() - 1);
+
+	// find the pair of keys either side of the frame
+	size_t next = std::upper_bound(keyFrames.begin(), keyFrames.end(), (unsigned short) frame) - keyFrames.begin();
+	size_t previous = next - 1;
+
+	// and interpolate linearly between them
+	float t = (float) (frame - keyFrames[previous]) / (float) (keyFrames[next] - keyFrames[previous]);
+	return Key(previous) * (1.0f - t) + Key(next) * t;
+	} // Sample()
+
+// bytes used by the track
+size_t CompressedTrack::MemoryBytes() const
+	{ // MemoryBytes()
+	if (!rawValues.empty())
+		return rawValues.size() * sizeof(Cartesian3);
+	return sizeof(minimum) + sizeof(extent) + keyFrames.size() * sizeof(unsigned short) + keyValues.size() * sizeof(unsigned short);
+	} // MemoryBytes()
+
+// constructor will initialise to an empty clip
+CompressedClip::CompressedClip()
+	:
+	frame_count(0),
+	frame_time(0.0f),
+	maxAngularError(0.0f),
+	maxTranslationError(0.0f)
+	{ // constructor
+	} // constructor
+
+// the angle in degrees between two rotations given as Euler angles in the file's convention
+float CompressedClip::AngleBetween(const Cartesian3& a, const Cartesian3& b)
+	{ // AngleBetween()
+	// build both rotations the same way BVHData::EvaluatePose() does
+	Matrix4 rotationA = Matrix4::RotateX(-a.x) * Matrix4::RotateY(-a.y) * Matrix4::RotateZ(-a.z);
+	Matrix4 rotationB = Matrix4::RotateX(-b.x) * Matrix4::RotateY(-b.y) * Matrix4::RotateZ(-b.z);
+
+	// the trace of A^T B is 1 + 2 cos(angle)
+	float trace = 0.0f;
+	for (int row = 0; row < 3; row++)
+		for (int column = 0; column < 3; column++)
+			trace += rotationA[row][column] * rotationB[row][column];
+	float cosine = std::max(-1.0f, std::min(1.0f, 0.5f * (trace - 1.0f)));
+	return acos(cosine) * 180.0f / M_PI;
+	} // AngleBetween()
+
+// build a track from one value per frame, dropping keys within the error bound
+void CompressedClip::CompressTrack(const std::vector<Cartesian3>& values, bool angular, float bound, CompressedTrack& track)
+	{ // CompressTrack()
+	int nFrames = values.size();
+
+	// range reduction: find the bounds of each channel over the whole track
+	for (int channel = 0; channel < 3; channel++)
+		{ // per channel
+		float low = values[0][channel], high = values[0][channel];
+		for (int frame = 1; frame < nFrames; frame++)
+			{ // per frame
+			low = std::min(low, values[frame][channel]);
+			high = std::max(high, values[frame][channel]);
+			} // per frame
+		track.minimum[channel] = low;
+		track.extent[channel] = high - low;
+		} // per channel
+
+	// quantize every frame up front: the error test below must see what the decoder will see
+	std::vector<unsigned short> quantized(3 * nFrames);
+	for (int frame = 0; frame < nFrames; frame++)
+		for (int channel = 0; channel < 3; channel++)
+			{ // per channel
+			float extent = track.extent[channel];
+			float normalised = (extent > 0.0f) ? (values[frame][channel] - track.minimum[channel]) / extent : 0.0f;
+			quantized[3 * frame + channel] = (unsigned short) (normalised * quantizationSteps + 0.5f);
+			} // per channel
+
+	// we decode through a scratch track so that we use exactly the same arithmetic as Sample()
+	CompressedTrack scratch = track;
+	scratch.keyValues = quantized;
+	std::vector<Cartesian3> decoded(nFrames);
+	for (int frame = 0; frame < nFrames; frame++)
+		decoded[frame] = scratch.Key(frame);
+
+	// a track that never moves only needs its first key, and there is nothing to search for
+	bool constant = true;
+	for (int frame = 1; frame < nFrames && constant; frame++)
+		for (int channel = 0; channel < 3; channel++)
+			if (quantized[3 * frame + channel] != quantized[channel])
+				constant = false;
+
+	// greedily extend each segment for as long as linear interpolation stays within the bound,
+	// up to MAX_SEGMENT_FRAMES, so that each segment costs at most a fixed number of error tests
+	std::vector<int> keys(1, 0);
+	int start = constant ? nFrames - 1 : 0;
+	while (start < nFrames - 1)
+		{ // per segment
+		int end = start + 1;
+		int last = std::min(start + MAX_SEGMENT_FRAMES, nFrames - 1);
+		for (int candidate = start + 2; candidate <= last; candidate++)
+			{ // try a longer segment
+			bool withinBound = true;
+			for (int frame = start + 1; frame < candidate && withinBound; frame++)
+				{ // per interior frame
+				float t = (float) (frame - start) / (float) (candidate - start);
+				Cartesian3 interpolated = decoded[start] * (1.0f - t) + decoded[candidate] * t;
+				float error = angular ? AngleBetween(interpolated, values[frame]) : (interpolated - values[frame]).length();
+				withinBound = (error <= bound);
+				} // per interior frame
+			if (!withinBound)
+				break;
+			end = candidate;
+			} // try a longer segment
+		keys.push_back(end);
+		start = end;
+		} // per segment
+
+	// the keys do not pay for their ranges when the track is short: keep the raw values instead
+	if (sizeof(track.minimum) + sizeof(track.extent) + 4 * sizeof(unsigned short) * keys.size() >= nFrames * sizeof(Cartesian3))
+		{ // raw
+		track.rawValues = values;
+		track.keyFrames.clear();
+		track.keyValues.clear();
+		return;
+		} // raw
+
+	// and copy out the surviving keys
+	track.rawValues.clear();
+	track.keyFrames.resize(keys.size());
+	track.keyValues.resize(3 * keys.size());
+	for (size_t key = 0; key < keys.size(); key++)
+		{ // per key
+		track.keyFrames[key] = (unsigned short) keys[key];
+		for (int channel = 0; channel < 3; channel++)
+			track.keyValues[3 * key + channel] = quantized[3 * keys[key] + channel];
+		} // per key
+	} // CompressTrack()
+
+// compress a loaded clip
+bool CompressedClip::Compress(BVHData& clip, float angularError, float translationError)
+	{ // Compress()
+	// frame numbers are stored in 16 bits
+	if (clip.frame_count <= 0 || clip.frame_count > 65535 || (int) clip.boneRotations.size() < clip.frame_count)
+		return false;
+
+	frame_count = clip.frame_count;
+	frame_time = clip.frame_time;
+	maxAngularError = angularError;
+	maxTranslationError = translationError;
+
+	// rearrange the rotations joint-major, one track at a time
+	size_t nJoints = clip.all_joints.size();
+	rotationTracks.resize(nJoints);
+	std::vector<Cartesian3> values(frame_count);
+	for (size_t joint = 0; joint < nJoints; joint++)
+		{ // per joint
+		for (int frame = 0; frame < frame_count; frame++)
+			values[frame] = clip.boneRotations[frame][joint];
+		CompressTrack(values, true, angularError, rotationTracks[joint]);
+		} // per joint
+
+	// the root's position channels are always the first ones in the frame
+	const std::vector<std::string>& channels = clip.root.joint_channel;
+	for (int frame = 0; frame < frame_count; frame++)
+		{ // per frame
+		values[frame] = Cartesian3(0.0, 0.0, 0.0);
+		for (size_t k = 0; k < channels.size() && k < clip.frames[frame].size(); k++)
+			{ // per channel
+			if (channels[k] == "Xposition")
+				values[frame].x = clip.frames[frame][k];
+			else if (channels[k] == "Yposition")
+				values[frame].y = clip.frames[frame][k];
+			else if (channels[k] == "Zposition")
+				values[frame].z = clip.frames[frame][k];
+			} // per channel
+		} // per frame
+	CompressTrack(values, false, translationError, rootTranslation);
+
+	return true;
+	} // Compress()
+
+// decode the rotations of every joint for a frame
+void CompressedClip::SampleRotations(int frame, std::vector<Cartesian3>& rotations) const
+	{ // SampleRotations()
+	frame = frame % frame_count;
+	rotations.resize(rotationTracks.size());
+	for (size_t joint = 0; joint < rotationTracks.size(); joint++)
+		rotations[joint] = rotationTracks[joint].Sample(frame);
+	} // SampleRotations()
+
+// decode the root translation for a frame
+Cartesian3 CompressedClip::SampleRootTranslation(int frame) const
+	{ // SampleRootTranslation()
+	return rootTranslation.Sample(frame % frame_count);
+	} // SampleRootTranslation()
+
+// bytes used by the compressed clip
+size_t CompressedClip::MemoryBytes() const
+	{ // MemoryBytes()
+	size_t bytes = sizeof(frame_count) + sizeof(frame_time) + rootTranslation.MemoryBytes();
+	for (size_t joint = 0; joint < rotationTracks.size(); joint++)
+		bytes += rotationTracks[joint].MemoryBytes();
+	return bytes;
+	} // MemoryBytes()
+
+// bytes used by the uncompressed channels of a loaded clip
+size_t CompressedClip::RawMemoryBytes(BVHData& clip)
+	{ // RawMemoryBytes()
+	size_t bytes = 0;
+	for (size_t frame = 0; frame < clip.frames.size(); frame++)
+		bytes += clip.frames[frame].size() * sizeof(float);
+	for (size_t frame = 0; frame < clip.boneRotations.size(); frame++)
+		bytes += clip.boneRotations[frame].size() * sizeof(Cartesian3);
+	return bytes;
+	} // RawMemoryBytes()
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	CompressedClip.h
+//	------------------------
+//
+//	A compact, lossy copy of a BVH clip: each joint's
+//	rotation is a track of 16-bit keys quantized over the
+//	track's own range, with every key that linear
+//	interpolation can reproduce within an angular error
+//	bound removed. A track too short to gain from that is
+//	kept as raw values instead
+//
+///////////////////////////////////////////////////
+
+#ifndef _COMPRESSED_CLIP_H
+#define _COMPRESSED_CLIP_H
+
+#include <vector>
+
+#include "BVHData.h"
+
+// a single three-channel track (a joint's rotation, or the root's translation)
+class CompressedTrack
+	{ // class CompressedTrack
+	public:
+	// the range that the 16-bit values are spread over, per channel
+	float minimum[3];
+	float extent[3];
+
+	// the frames that have a key, in increasing order (always includes the first and last frame)
+	std::vector<unsigned short> keyFrames;
+
+	// three quantized values per key
+	std::vector<unsigned short> keyValues;
+
+	// or, when the keys would take more room than the frames themselves, one raw value per frame
+	// (and no keys)
+	std::vector<Cartesian3> rawValues;
+
+	// constructor will initialise to an empty track
+	CompressedTrack();
+
+	// decode the value of the track at a given frame
+	Cartesian3 Sample(int frame) const;
+
+	// decode a single key
+	Cartesian3 Key(size_t key) const;
+
+	// the number of values stored, keys or raw
+	size_t KeyCount() const { return rawValues.empty() ? keyFrames.size() : rawValues.size(); }
+
+	// bytes used by the track
+	size_t MemoryBytes() const;
+	}; // class CompressedTrack
+
+class CompressedClip
+	{ // class CompressedClip
+	public:
+	// bvh frame count
+	int frame_count;
+
+	// frame rate of the animation
+	float frame_time;
+
+	// one rotation track per joint id
+	std::vector<CompressedTrack> rotationTracks;
+
+	// the root translation, if the root has position channels
+	CompressedTrack rootTranslation;
+
+	// the bounds the clip was compressed with
+	float maxAngularError;
+	float maxTranslationError;
+
+	// constructor will initialise to an empty clip
+	CompressedClip();
+
+	// compress a loaded clip: angular error is in degrees, translation error in file units
+	// returns false if the clip is too long to index with 16-bit frame numbers
+	bool Compress(BVHData& clip, float angularError, float translationError);
+
+	// decode the rotations of every joint for a frame (resizes rotations if necessary)
+	void SampleRotations(int frame, std::vector<Cartesian3>& rotations) const;
+
+	// decode the root translation for a frame
+	Cartesian3 SampleRootTranslation(int frame) const;
+
+	// bytes used by the compressed clip
+	size_t MemoryBytes() const;
+
+	// bytes used by the uncompressed channels of a loaded clip (frames and boneRotations)
+	static size_t RawMemoryBytes(BVHData& clip);
+
+	// the angle in degrees between two rotations given as Euler angles in the file's convention
+	static float AngleBetween(const Cartesian3& a, const Cartesian3& b);
+
+	private:
+	// the longest run of frames one pair of keys may span, which bounds the cost of the search for them
+	static const int MAX_SEGMENT_FRAMES = 64;
+
+	// build a track from one value per frame, dropping keys within the error bound
+	// when angular is true the error is measured as a rotation angle, otherwise as a distance
+	static void CompressTrack(const std::vector<Cartesian3>& values, bool angular, float bound, CompressedTrack& track);
+	}; // class CompressedClip
+
+#endif
@@ -0,0 +1,359 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	FrameCapture.cpp
+//	------------------------
+//
+//	Records rendered frames as numbered images, encoded
+//	and written by a pool of worker threads.
+//
+///////////////////////////////////////////////////
+
+#include "GLSupport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#include "FrameCapture.h"
+
+// seconds on the steady clock
+static double SecondsNow()
+	{ // SecondsNow()
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	} // SecondsNow()
+
+// constructor will initialise to safe values
+FrameCapture::FrameCapture()
+	:
+	format(PPM),
+	policy(DROP),
+	stopping(false),
+	framesCaptured(0),
+	framesWritten(0),
+	framesDropped(0),
+	writeFailures(0),
+	peakQueued(0),
+	bytesWritten(0.0),
+	startSeconds(0.0),
+	finishSeconds(0.0)
+	{ // constructor
+	} // constructor
+
+// destructor finishes writing whatever is queued
+FrameCapture::~FrameCapture()
+	{ // destructor
+	Finish();
+	} // destructor
+
+// start writing frames
+bool FrameCapture::Start(const std::string &Prefix, int Format, int Policy, int nWorkers, int nBuffers)
+	{ // Start()
+	if (Active())
+		return false;
+	prefix = Prefix;
+	format = Format;
+	policy = Policy;
+
+	// every buffer starts free: the pixels are allocated the first time each is filled
+	buffers.assign(std::max(nBuffers, 1), CaptureBuffer());
+	freeBuffers.clear();
+	queuedBuffers.clear();
+	for (int buffer = (int) buffers.size() - 1; buffer >= 0; buffer--)
+		freeBuffers.push_back(buffer);
+
+	stopping = false;
+	framesCaptured = framesWritten = framesDropped = writeFailures = peakQueued = 0;
+	bytesWritten = 0.0;
+	startSeconds = SecondsNow();
+	finishSeconds = 0.0;
+	for (int worker = 0; worker < std::max(nWorkers, 1); worker++)
+		workers.push_back(std::thread(&FrameCapture::WorkerLoop, this));
+	return true;
+	} // Start()
+
+// read back the frame and queue it for writing
+bool FrameCapture::Capture(int width, int height)
+	{ // Capture()
+	if (!Active() || width < 1 || height < 1)
+		return false;
+
+	// take a free buffer, or if there is none, drop the frame or wait for one
+	int buffer;
+	{ // lock
+	std::unique_lock<std::mutex> guard(lock);
+	if (freeBuffers.empty() && policy == DROP)
+		{ // behind
+		framesDropped++;
+		return false;
+		} // behind
+	bufferFreed.wait(guard, [this]() { return !freeBuffers.empty(); });
+	buffer = freeBuffers.back();
+	freeBuffers.pop_back();
+	} // lock
+
+	// the read back is the one part the rendering thread has to wait for
+	CaptureBuffer &capture = buffers[buffer];
+	capture.pixels.resize(3L * width * height);
+	capture.width = width;
+	capture.height = height;
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &capture.pixels[0]);
+
+	// and hand it to a worker
+	{ // lock
+	std::lock_guard<std::mutex> guard(lock);
+	capture.frame = framesCaptured++;
+	queuedBuffers.push_back(buffer);
+	peakQueued = std::max(peakQueued, (long) queuedBuffers.size());
+	} // lock
+	bufferQueued.notify_one();
+	return true;
+	} // Capture()
+
+// wait for every queued frame to be written, and stop the workers
+void FrameCapture::Finish()
+	{ // Finish()
+	if (!Active())
+		return;
+	{ // lock
+	std::lock_guard<std::mutex> guard(lock);
+	stopping = true;
+	} // lock
+	bufferQueued.notify_all();
+	for (size_t worker = 0; worker < workers.size(); worker++)
+		workers[worker].join();
+	workers.clear();
+	finishSeconds = SecondsNow();
+	} // Finish()
+
+// what a worker does until told to stop with nothing left to write
+void FrameCapture::WorkerLoop()
+	{ // WorkerLoop()
+	for (;;)
+		{ // per frame
+		// wait for a frame, oldest first
+		int buffer;
+		{ // lock
+		std::unique_lock<std::mutex> guard(lock);
+		bufferQueued.wait(guard, [this]() { return stopping || !queuedBuffers.empty(); });
+		if (queuedBuffers.empty())
+			return;
+		buffer = queuedBuffers.front();
+		queuedBuffers.erase(queuedBuffers.begin());
+		} // lock
+
+		// encode and write it with nothing held
+		CaptureBuffer &capture = buffers[buffer];
+		std::string fileName = FileName(capture.frame);
+		long bytes = (format == PNG)
+			? WritePNG(fileName.c_str(), &capture.pixels[0], capture.width, capture.height)
+			: WritePPM(fileName.c_str(), &capture.pixels[0], capture.width, capture.height);
+
+		// then give the buffer back
+		{ // lock
+		std::lock_guard<std::mutex> guard(lock);
+		if (bytes > 0)
+			{ // written
+			framesWritten++;
+			bytesWritten += bytes;
+			} // written
+		else
+			writeFailures++;
+		freeBuffers.push_back(buffer);
+		} // lock
+		bufferFreed.notify_one();
+		} // per frame
+	} // WorkerLoop()
+
+// frames queued since Start()
+long FrameCapture::FramesCaptured()
+	{ // FramesCaptured()
+	std::lock_guard<std::mutex> guard(lock);
+	return framesCaptured;
+	} // FramesCaptured()
+
+// frames written since Start()
+long FrameCapture::FramesWritten()
+	{ // FramesWritten()
+	std::lock_guard<std::mutex> guard(lock);
+	return framesWritten;
+	} // FramesWritten()
+
+// frames dropped because the workers were behind
+long FrameCapture::FramesDropped()
+	{ // FramesDropped()
+	std::lock_guard<std::mutex> guard(lock);
+	return framesDropped;
+	} // FramesDropped()
+
+// files that could not be written
+long FrameCapture::WriteFailures()
+	{ // WriteFailures()
+	std::lock_guard<std::mutex> guard(lock);
+	return writeFailures;
+	} // WriteFailures()
+
+// megabytes written since Start()
+double FrameCapture::MegabytesWritten()
+	{ // MegabytesWritten()
+	std::lock_guard<std::mutex> guard(lock);
+	return bytesWritten / 1048576.0;
+	} // MegabytesWritten()
+
+// the most frames ever waiting to be written at once
+long FrameCapture::PeakQueued()
+	{ // PeakQueued()
+	std::lock_guard<std::mutex> guard(lock);
+	return peakQueued;
+	} // PeakQueued()
+
+// frames written per second since Start()
+double FrameCapture::FramesPerSecond()
+	{ // FramesPerSecond()
+	double seconds = (Active() ? SecondsNow() : finishSeconds) - startSeconds;
+	return seconds > 0.0 ? FramesWritten() / seconds : 0.0;
+	} // FramesPerSecond()
+
+// the name a frame is written to
+std::string FrameCapture::FileName(long frame) const
+	{ // FileName()
+	char number[32];
+	snprintf(number, sizeof(number), "%05ld", frame);
+	return prefix + number + (format == PNG ? ".png" : ".ppm");
+	} // FileName()
+
+// write RGB pixels as a binary PPM, top row first
+long FrameCapture::WritePPM(const char *fileName, const unsigned char *pixels, int width, int height)
+	{ // WritePPM()
+	FILE *file = fopen(fileName, "wb");
+	if (file == NULL)
+		return 0;
+	long header = fprintf(file, "P6\n%d %d\n255\n", width, height);
+	long pixelsWritten = 0;
+	for (int row = height - 1; row >= 0; row--)
+		pixelsWritten += fwrite(pixels + 3L * width * row, 3, width, file);
+	return (fclose(file) == 0 && header > 0 && pixelsWritten == (long) width * height) ? header + 3 * pixelsWritten : 0;
+	} // WritePPM()
+
+// the table for the CRC that ends every PNG chunk, built once on first use
+class CRCTable
+	{ // class CRCTable
+	public:
+	uint32_t entries[256];
+
+	CRCTable()
+		{ // constructor
+		for (uint32_t entry = 0; entry < 256; entry++)
+			{ // per entry
+			uint32_t value = entry;
+			for (int bit = 0; bit < 8; bit++)
+				value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+			entries[entry] = value;
+			} // per entry
+		} // constructor
+	}; // class CRCTable
+
+// the CRC that ends every PNG chunk
+static uint32_t CRC32(const unsigned char *data, size_t length)
+	{ // CRC32()
+	// a local static is built exactly once, however many workers get here first
+	static const CRCTable table;
+	uint32_t crc = 0xFFFFFFFFu;
+	for (size_t byte = 0; byte < length; byte++)
+		crc = table.entries[(crc ^ data[byte]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+	} // CRC32()
+
+// the checksum that ends a zlib stream
+static uint32_t Adler32(const unsigned char *data, size_t length)
+	{ // Adler32()
+	uint32_t a = 1, b = 0;
+	while (length > 0)
+		{ // per run
+		// 5552 bytes is the most that can be summed before b could overflow
+		size_t run = std::min(length, (size_t) 5552);
+		for (size_t byte = 0; byte < run; byte++)
+			{ // per byte
+			a += data[byte];
+			b += a;
+			} // per byte
+		a %= 65521;
+		b %= 65521;
+		data += run;
+		length -= run;
+		} // per run
+	return (b << 16) | a;
+	} // Adler32()
+
+// a big-endian 32-bit value, as PNG stores them
+static void PutBigEndian(std::vector<unsigned char> &out, uint32_t value)
+	{ // PutBigEndian()
+	out.push_back(value >> 24);
+	out.push_back(value >> 16);
+	out.push_back(value >> 8);
+	out.push_back(value);
+	} // PutBigEndian()
+
+// append a chunk: length, type, data and CRC
+static void PutChunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &data)
+	{ // PutChunk()
+	PutBigEndian(out, (uint32_t) data.size());
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	PutBigEndian(out, CRC32(&out[start], out.size() - start));
+	} // PutChunk()
+
+// write RGB pixels as a PNG, top row first
+// the image data is stored in uncompressed deflate blocks, which any PNG reader takes, so that
+// no compression library is needed: the files are the size of a PPM, and as quick to write
+long FrameCapture::WritePNG(const char *fileName, const unsigned char *pixels, int width, int height)
+	{ // WritePNG()
+	// the rows, top first, each preceded by its filter type (0, none)
+	size_t rowBytes = 3L * width + 1;
+	std::vector<unsigned char> raw(rowBytes * height);
+	for (int row = 0; row < height; row++)
+		{ // per row
+		raw[rowBytes * row] = 0;
+		std::copy(pixels + 3L * width * (height - 1 - row), pixels + 3L * width * (height - row), &raw[rowBytes * row + 1]);
+		} // per row
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	std::vector<unsigned char> png(signature, signature + 8);
+
+	// 8 bits per channel, RGB, no interlacing
+	std::vector<unsigned char> header;
+	PutBigEndian(header, width);
+	PutBigEndian(header, height);
+	unsigned char settings[5] = { 8, 2, 0, 0, 0 };
+	header.insert(header.end(), settings, settings + 5);
+	PutChunk(png, "IHDR", header);
+
+	// a zlib stream of stored blocks of at most 65535 bytes, then the checksum of the raw data
+	std::vector<unsigned char> data;
+	data.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	data.push_back(0x78);
+	data.push_back(0x01);
+	for (size_t written = 0; written < raw.size(); )
+		{ // per block
+		size_t block = std::min(raw.size() - written, (size_t) 65535);
+		data.push_back(written + block == raw.size() ? 1 : 0);
+		data.push_back(block & 0xFF);
+		data.push_back(block >> 8);
+		data.push_back(~block & 0xFF);
+		data.push_back((~block >> 8) & 0xFF);
+		data.insert(data.end(), raw.begin() + written, raw.begin() + written + block);
+		written += block;
+		} // per block
+	PutBigEndian(data, Adler32(&raw[0], raw.size()));
+	PutChunk(png, "IDAT", data);
+	PutChunk(png, "IEND", std::vector<unsigned char>());
+
+	FILE *file = fopen(fileName, "wb");
+	if (file == NULL)
+		return 0;
+	size_t bytes = fwrite(&png[0], 1, png.size(), file);
+	return (fclose(file) == 0 && bytes == png.size()) ? (long) bytes : 0;
+	} // WritePNG()
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	FrameCapture.h
+//	------------------------
+//
+//	Records rendered frames as a numbered sequence of PPM
+//	or PNG images. Capture() reads the frame back into one
+//	of a fixed number of buffers and queues it; a small pool
+//	of worker threads encodes the queued frames and writes
+//	them to disk, so the thread that renders only ever pays
+//	for the read back.
+//
+//	When every buffer is still waiting to be written, the
+//	workers have fallen behind: Capture() then either drops
+//	the frame and counts it (DROP, for a window, which must
+//	not stall) or waits for a buffer to come free (WAIT,
+//	for a batch run, which wants every frame).
+//
+///////////////////////////////////////////////////
+
+#ifndef _FRAME_CAPTURE_H
+#define _FRAME_CAPTURE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FrameCapture
+	{ // class FrameCapture
+	public:
+	// the image formats, and what to do when the workers fall behind
+	enum { PPM, PNG };
+	enum { DROP, WAIT };
+
+	// constructor will initialise to safe values: nothing is captured until Start()
+	FrameCapture();
+
+	// destructor finishes writing whatever is queued
+	~FrameCapture();
+
+	// start writing frames to prefix00000.ppm (or .png) and onwards, with the given number of
+	// worker threads and of frame buffers: returns false if already started
+	bool Start(const std::string &prefix, int format, int policy, int nWorkers, int nBuffers);
+
+	// read back the width x height frame in the current context's read buffer and queue it
+	// for writing: returns false if it was dropped (there must be a current context)
+	bool Capture(int width, int height);
+
+	// wait for every queued frame to be written, and stop the workers
+	void Finish();
+
+	// true between Start() and Finish()
+	bool Active() const { return !workers.empty(); }
+
+	// what has happened since Start(): frames queued, written and dropped, files that could
+	// not be written, bytes written, and the most frames ever waiting at once
+	long FramesCaptured();
+	long FramesWritten();
+	long FramesDropped();
+	long WriteFailures();
+	double MegabytesWritten();
+	long PeakQueued();
+
+	// frames written per second since Start() (until Finish(), then over the whole capture)
+	double FramesPerSecond();
+
+	// the name a frame is written to
+	std::string FileName(long frame) const;
+
+	// write RGB pixels, bottom row first as OpenGL reads them, as an image: returns the bytes written, or 0 on failure
+	static long WritePPM(const char *fileName, const unsigned char *pixels, int width, int height);
+	static long WritePNG(const char *fileName, const unsigned char *pixels, int width, int height);
+
+	private:
+	// a frame waiting to be written, or a buffer waiting to be filled
+	class CaptureBuffer
+		{ // class CaptureBuffer
+		public:
+		std::vector<unsigned char> pixels;
+		int width, height;
+		long frame;
+		}; // class CaptureBuffer
+
+	// what a worker does until told to stop with nothing left to write
+	void WorkerLoop();
+
+	// where, in what form, and what to do when full
+	std::string prefix;
+	int format, policy;
+
+	// the buffers, and which are free to fill and which are waiting to be written, under the lock
+	std::vector<CaptureBuffer> buffers;
+	std::vector<int> freeBuffers;
+	std::vector<int> queuedBuffers;
+	std::mutex lock;
+	std::condition_variable bufferQueued, bufferFreed;
+	bool stopping;
+
+	std::vector<std::thread> workers;
+
+	// the counts, under the lock
+	long framesCaptured, framesWritten, framesDropped, writeFailures, peakQueued;
+	double bytesWritten;
+	double startSeconds, finishSeconds;
+	}; // class FrameCapture
+
+#endif
@@ -0,0 +1,310 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	FrameProfiler.cpp
+//	------------------------
+//
+//	Times the phases of a frame, with a lock-free ring of
+//	samples per thread that is gathered once per frame,
+//	and written as Chrome trace events when tracing.
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#include "FrameProfiler.h"
+
+// nothing is recorded unless this is set
+std::atomic<bool> FrameProfiler::enabled(false);
+
+// the names of the phases, in the order of the enum
+static const char *phaseNames[N_TRACED_PHASES] = { "update", "pose", "blend", "render", "terrain", "bones", "skin", "swap", "load_clip", "load_terrain", "load_mesh" };
+
+// every ring ever handed out: threads only take the lock the first time they record,
+// and EndFrame() holds it while it reads, so that a ring is never reused mid-read
+static std::mutex ringsMutex;
+static std::vector<PhaseRing *> rings;
+
+// everything below is only touched by EndFrame(), the trace calls and the calls that
+// read the results, which all happen on the thread that draws the frames
+// each phase's total per frame, for the last HISTORY_FRAMES frames
+static double history[N_PHASES][FrameProfiler::HISTORY_FRAMES];
+static long framesGathered = 0, samplesDropped = 0;
+static FILE *csvFile = NULL;
+
+// samples gathered since the last frame ended: stopping a trace gathers early
+static double frameTotals[N_PHASES];
+
+// the trace being written, when it started, how many events are in it, and how many tracks are named
+static FILE *traceFile = NULL;
+static int64_t traceStart = 0;
+static long traceEvents = 0;
+static size_t tracksNamed = 0;
+
+// the environment variable that names a trace to write from startup
+static const char *traceVariable = "ANIMATION_TRACE";
+
+// constructor will initialise to safe values
+PhaseRing::PhaseRing()
+	:
+	written(0),
+	read(0),
+	owned(true),
+	index(0)
+	{ // constructor
+	} // constructor
+
+// hands the ring back when its thread exits
+class PhaseRingOwner
+	{ // class PhaseRingOwner
+	public:
+	PhaseRing *ring;
+
+	PhaseRingOwner() : ring(NULL) {}
+	~PhaseRingOwner()
+		{ // destructor
+		if (ring != NULL)
+			ring->owned.store(false, std::memory_order_release);
+		} // destructor
+	}; // class PhaseRingOwner
+
+static thread_local PhaseRingOwner ringOwner;
+
+// the calling thread's ring, taking over one whose thread has gone if it has been read to the end
+static PhaseRing *ThisThreadRing()
+	{ // ThisThreadRing()
+	if (ringOwner.ring != NULL)
+		return ringOwner.ring;
+
+	std::lock_guard<std::mutex> guard(ringsMutex);
+	for (size_t ring = 0; ring < rings.size() && ringOwner.ring == NULL; ring++)
+		if (!rings[ring]->owned.load(std::memory_order_acquire) && rings[ring]->read == rings[ring]->written.load(std::memory_order_relaxed))
+			{ // free
+			rings[ring]->owned.store(true, std::memory_order_relaxed);
+			ringOwner.ring = rings[ring];
+			} // free
+	if (ringOwner.ring == NULL)
+		{ // new ring
+		ringOwner.ring = new PhaseRing;
+		ringOwner.ring->index = (int) rings.size();
+		rings.push_back(ringOwner.ring);
+		} // new ring
+	return ringOwner.ring;
+	} // ThisThreadRing()
+
+// the name of a phase
+const char *FrameProfiler::PhaseName(int phase)
+	{ // PhaseName()
+	return (phase >= 0 && phase < N_TRACED_PHASES) ? phaseNames[phase] : "unknown";
+	} // PhaseName()
+
+// note a timed block on the calling thread's ring
+void FrameProfiler::Record(int phase, int64_t start, int64_t end)
+	{ // Record()
+	PhaseRing *ring = ThisThreadRing();
+	uint64_t index = ring->written.load(std::memory_order_relaxed);
+	PhaseSample &sample = ring->samples[index % PhaseRing::CAPACITY];
+	sample.start = start;
+	sample.end = end;
+	sample.phase = phase;
+	// publish it: EndFrame() reads no further than this
+	ring->written.store(index + 1, std::memory_order_release);
+	} // Record()
+
+// write one event to the trace, separated from the one before
+static void TraceEvent(const char *format, ...)
+	{ // TraceEvent()
+	fprintf(traceFile, traceEvents++ == 0 ? "\n" : ",\n");
+	va_list args;
+	va_start(args, format);
+	vfprintf(traceFile, format, args);
+	va_end(args);
+	} // TraceEvent()
+
+// drain every thread's ring into the frame totals, and into the trace if there is one
+static void GatherSamples()
+	{ // GatherSamples()
+	std::lock_guard<std::mutex> guard(ringsMutex);
+
+	// each ring is a track of its own, named the first time it is seen
+	if (traceFile != NULL)
+		for (; tracksNamed < rings.size(); tracksNamed++)
+			TraceEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", (int) tracksNamed, (int) tracksNamed);
+
+	for (size_t r = 0; r < rings.size(); r++)
+		{ // per ring
+		PhaseRing *ring = rings[r];
+		// the slot of the oldest sample still in the ring is the next one the thread writes, and may be
+		// half written already, so it is left alone
+		uint64_t end = ring->written.load(std::memory_order_acquire);
+		uint64_t begin = std::max(ring->read, (end >= PhaseRing::CAPACITY) ? end - PhaseRing::CAPACITY + 1 : 0);
+		for (uint64_t index = begin; index < end; index++)
+			{ // per sample
+			PhaseSample sample = ring->samples[index % PhaseRing::CAPACITY];
+			// the thread may have lapped us while we copied it, in which case it is not what it was: once
+			// written has reached index + CAPACITY, the thread has started writing over this slot
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (ring->written.load(std::memory_order_relaxed) - index >= PhaseRing::CAPACITY)
+				{ // overwritten
+				samplesDropped++;
+				continue;
+				} // overwritten
+			if (sample.phase >= 0 && sample.phase < N_PHASES)
+				frameTotals[sample.phase] += 1E-6 * (sample.end - sample.start);
+			// times in a trace are microseconds from its start
+			if (traceFile != NULL && sample.start >= traceStart && sample.phase >= 0 && sample.phase < N_TRACED_PHASES)
+				TraceEvent("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					phaseNames[sample.phase], sample.phase < N_PHASES ? "frame" : "load", ring->index,
+					1E-3 * (sample.start - traceStart), 1E-3 * (sample.end - sample.start));
+			} // per sample
+		samplesDropped += begin - ring->read;
+		ring->read = end;
+		} // per ring
+	} // GatherSamples()
+
+// gather every thread's samples into this frame's totals
+void FrameProfiler::EndFrame()
+	{ // EndFrame()
+	GatherSamples();
+	double totals[N_PHASES];
+	for (int phase = 0; phase < N_PHASES; phase++)
+		{ // per phase
+		totals[phase] = frameTotals[phase];
+		frameTotals[phase] = 0.0;
+		} // per phase
+
+	// mark the end of the frame across every track
+	if (traceFile != NULL)
+		TraceEvent("{\"name\":\"frame %ld\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f}", framesGathered + 1, 1E-3 * (Now() - traceStart));
+
+	long slot = framesGathered % HISTORY_FRAMES;
+	for (int phase = 0; phase < N_PHASES; phase++)
+		history[phase][slot] = totals[phase];
+	framesGathered++;
+
+	if (csvFile != NULL)
+		{ // CSV row
+		fprintf(csvFile, "%ld", framesGathered);
+		for (int phase = 0; phase < N_PHASES; phase++)
+			fprintf(csvFile, ",%.4f", totals[phase]);
+		fprintf(csvFile, "\n");
+		} // CSV row
+	} // EndFrame()
+
+// the mean of a phase's time per frame over the history
+double FrameProfiler::AverageMilliseconds(int phase)
+	{ // AverageMilliseconds()
+	long frames = std::min(framesGathered, (long) HISTORY_FRAMES);
+	if (frames == 0 || phase < 0 || phase >= N_PHASES)
+		return 0.0;
+	double sum = 0.0;
+	for (long frame = 0; frame < frames; frame++)
+		sum += history[phase][frame];
+	return sum / frames;
+	} // AverageMilliseconds()
+
+// the 99th percentile of a phase's time per frame over the history
+double FrameProfiler::Percentile99Milliseconds(int phase)
+	{ // Percentile99Milliseconds()
+	long frames = std::min(framesGathered, (long) HISTORY_FRAMES);
+	if (frames == 0 || phase < 0 || phase >= N_PHASES)
+		return 0.0;
+	// the smallest value that at least 99% of frames are no slower than
+	std::vector<double> sorted(history[phase], history[phase] + frames);
+	long rank = std::min(frames - 1, (long) (0.99 * frames));
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	return sorted[rank];
+	} // Percentile99Milliseconds()
+
+// frames gathered so far
+long FrameProfiler::FramesGathered()
+	{ // FramesGathered()
+	return framesGathered;
+	} // FramesGathered()
+
+// samples lost because a ring filled up before it was read
+long FrameProfiler::SamplesDropped()
+	{ // SamplesDropped()
+	return samplesDropped;
+	} // SamplesDropped()
+
+// start writing a row per frame to a CSV file
+bool FrameProfiler::OpenCSV(const char *fileName)
+	{ // OpenCSV()
+	CloseCSV();
+	csvFile = fopen(fileName, "w");
+	if (csvFile == NULL)
+		return false;
+	fprintf(csvFile, "frame");
+	for (int phase = 0; phase < N_PHASES; phase++)
+		fprintf(csvFile, ",%s_ms", phaseNames[phase]);
+	fprintf(csvFile, "\n");
+	return true;
+	} // OpenCSV()
+
+// stop writing, and close the file
+void FrameProfiler::CloseCSV()
+	{ // CloseCSV()
+	if (csvFile != NULL)
+		fclose(csvFile);
+	csvFile = NULL;
+	} // CloseCSV()
+
+// true while a CSV file is being written
+bool FrameProfiler::WritingCSV()
+	{ // WritingCSV()
+	return csvFile != NULL;
+	} // WritingCSV()
+
+// start writing a trace, enabling the profiler
+bool FrameProfiler::StartTrace(const char *fileName)
+	{ // StartTrace()
+	StopTrace();
+	traceFile = fopen(fileName, "w");
+	if (traceFile == NULL)
+		return false;
+	// whatever is waiting in the rings began before the trace, so is left out
+	traceStart = Now();
+	traceEvents = 0;
+	tracksNamed = 0;
+	fprintf(traceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	// a trace cut off by exit() would not parse, so it is finished then
+	static bool finishAtExit = false;
+	if (!finishAtExit)
+		atexit(StopTrace);
+	finishAtExit = true;
+
+	enabled.store(true);
+	return true;
+	} // StartTrace()
+
+// gather what is left, finish the trace and close it
+void FrameProfiler::StopTrace()
+	{ // StopTrace()
+	if (traceFile == NULL)
+		return;
+	GatherSamples();
+	fprintf(traceFile, "\n]}\n");
+	fclose(traceFile);
+	traceFile = NULL;
+	} // StopTrace()
+
+// true while a trace is being written
+bool FrameProfiler::Tracing()
+	{ // Tracing()
+	return traceFile != NULL;
+	} // Tracing()
+
+// start a trace if ANIMATION_TRACE names a file
+void FrameProfiler::StartTraceFromEnvironment()
+	{ // StartTraceFromEnvironment()
+	const char *fileName = getenv(traceVariable);
+	if (fileName != NULL && fileName[0] != '\0' && !StartTrace(fileName))
+		fprintf(stderr, "could not write the trace %s named by %s\n", fileName, traceVariable);
+	} // StartTraceFromEnvironment()
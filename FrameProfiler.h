@@ -0,0 +1,166 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	FrameProfiler.h
+//	------------------------
+//
+//	Times the phases of a frame: a ScopedPhase placed at
+//	the top of a block records how long the block took.
+//	Each thread writes its samples to a ring of its own,
+//	with no locks, and EndFrame() gathers them once per
+//	frame into totals per phase, kept for the last few
+//	seconds so that averages and 99th percentiles can be
+//	shown, and optionally written to a CSV file a row per
+//	frame.
+//
+//	The same samples can be written as a trace: every timed
+//	block becomes a Chrome trace event on its own thread's
+//	track, so that chrome://tracing or Perfetto shows how
+//	loading, update and render overlap. Setting
+//	ANIMATION_TRACE to a file name traces from startup.
+//
+//	Nothing is recorded until the profiler is enabled,
+//	and until then a ScopedPhase costs a single load.
+//
+///////////////////////////////////////////////////
+
+#ifndef _FRAME_PROFILER_H
+#define _FRAME_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// the phases a frame is broken into: the ones indented lie inside the one above
+enum
+	{
+	PHASE_UPDATE,		// SceneModel::Update()
+		PHASE_POSE,		// evaluating each character's pose
+		PHASE_BLEND,	// sampling and mixing in the clip being blended to
+	PHASE_RENDER,		// SceneModel::Render()
+		PHASE_TERRAIN,	// drawing the ground
+		PHASE_BONES,	// queueing and drawing the characters' bones, or their meshes
+		PHASE_SKIN,		// skinning the characters' meshes, inside bones
+	PHASE_SWAP,			// swapping the window's buffers
+	N_PHASES,
+	// phases outside the frame, which only appear in traces
+	PHASE_LOAD_CLIP = N_PHASES,	// BVHData::ReadFileBVH()
+	PHASE_LOAD_TERRAIN,			// Terrain::ReadFileTerrainData()
+	PHASE_LOAD_MESH,			// SkinnedMesh::ReadFileOBJ()
+	N_TRACED_PHASES
+	};
+
+// one timed block, in nanoseconds of the steady clock
+class PhaseSample
+	{ // class PhaseSample
+	public:
+	int64_t start, end;
+	int phase;
+	}; // class PhaseSample
+
+// a thread's samples: written only by that thread, and read only by FrameProfiler::EndFrame()
+class PhaseRing
+	{ // class PhaseRing
+	public:
+	// samples beyond this many unread are lost, oldest first
+	enum { CAPACITY = 4096 };
+	PhaseSample samples[CAPACITY];
+
+	// how many samples have ever been written, and how many of those have been read
+	std::atomic<uint64_t> written;
+	uint64_t read;
+
+	// cleared when the thread exits, so that the ring can be handed to another
+	std::atomic<bool> owned;
+
+	// where the ring is in the list of them, which names its track in a trace
+	int index;
+
+	// constructor will initialise to safe values
+	PhaseRing();
+	}; // class PhaseRing
+
+class FrameProfiler
+	{ // class FrameProfiler
+	public:
+	// frames of history kept for the averages and percentiles (ten seconds at 24fps)
+	enum { HISTORY_FRAMES = 240 };
+
+	// nothing is recorded unless this is set
+	static std::atomic<bool> enabled;
+
+	// the name of a phase, as shown and as written to the CSV header
+	static const char *PhaseName(int phase);
+
+	// nanoseconds on the steady clock
+	static int64_t Now()
+		{ // Now()
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		} // Now()
+
+	// note a timed block on the calling thread's ring
+	static void Record(int phase, int64_t start, int64_t end);
+
+	// gather every thread's samples into this frame's totals, and write its row to the CSV file
+	static void EndFrame();
+
+	// the mean and the 99th percentile of a phase's time per frame, in milliseconds, over the
+	// frames of history (0 until there are some)
+	static double AverageMilliseconds(int phase);
+	static double Percentile99Milliseconds(int phase);
+
+	// frames gathered so far, and samples lost because a ring filled up before it was read
+	static long FramesGathered();
+	static long SamplesDropped();
+
+	// start writing a row per frame to a CSV file: returns false if it cannot be opened
+	static bool OpenCSV(const char *fileName);
+
+	// stop writing, and close the file
+	static void CloseCSV();
+
+	// true while a CSV file is being written
+	static bool WritingCSV();
+
+	// start writing a trace, enabling the profiler: returns false if it cannot be opened
+	static bool StartTrace(const char *fileName);
+
+	// gather what is left, finish the trace and close it (the profiler is left enabled)
+	static void StopTrace();
+
+	// true while a trace is being written
+	static bool Tracing();
+
+	// start a trace if ANIMATION_TRACE names a file, before anything is loaded
+	static void StartTraceFromEnvironment();
+	}; // class FrameProfiler
+
+// times the block it is declared in, when the profiler is enabled
+class ScopedPhase
+	{ // class ScopedPhase
+	public:
+	// note the time, but only if anyone is listening
+	ScopedPhase(int Phase)
+		:
+		phase(Phase),
+		start(FrameProfiler::enabled.load(std::memory_order_relaxed) ? FrameProfiler::Now() : 0)
+		{ // constructor
+		} // constructor
+
+	// and record the block as it ends
+	~ScopedPhase()
+		{ // destructor
+		if (start != 0)
+			FrameProfiler::Record(phase, start, FrameProfiler::Now());
+		} // destructor
+
+	// a timer belongs to one block
+	ScopedPhase(const ScopedPhase &) = delete;
+	ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+	private:
+	int phase;
+	int64_t start;
+	}; // class ScopedPhase
+
+#endif
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Frustum.cpp
+//	------------------------
+//
+//	The six planes of a view frustum, taken from a
+//	combined projection * modelview matrix, with a test
+//	for axis-aligned boxes.
+//
+///////////////////////////////////////////////////
+
+#include <math.h>
+
+#include "Frustum.h"
+
+// constructor gives a frustum that contains everything
+Frustum::Frustum()
+	{ // constructor
+	// 0x + 0y + 0z + 1 >= 0 holds everywhere
+	for (int plane = 0; plane < 6; plane++)
+		{ // per plane
+		planes[plane][0] = planes[plane][1] = planes[plane][2] = 0.0f;
+		planes[plane][3] = 1.0f;
+		} // per plane
+	} // constructor
+
+// extract the planes from projection * modelview
+void Frustum::SetFromMatrix(const Matrix4& clipMatrix)
+	{ // SetFromMatrix()
+	// a point is visible when -w <= x, y, z <= w in clip space, and each of those six
+	// inequalities is a plane: the w row plus or minus the x, y or z row
+	for (int axis = 0; axis < 3; axis++)
+		for (int side = 0; side < 2; side++)
+			{ // per plane
+			float* plane = planes[2 * axis + side];
+			float sign = (side == 0) ? 1.0f : -1.0f;
+			for (int column = 0; column < 4; column++)
+				plane[column] = clipMatrix[3][column] + sign * clipMatrix[axis][column];
+
+			// normalise, so that the plane equation gives true distances
+			float length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			if (length > 0.0f)
+				for (int column = 0; column < 4; column++)
+					plane[column] /= length;
+			} // per plane
+	} // SetFromMatrix()
+
+// false only if the box is certainly outside
+bool Frustum::IntersectsBox(const Cartesian3& minimum, const Cartesian3& maximum) const
+	{ // IntersectsBox()
+	for (int plane = 0; plane < 6; plane++)
+		{ // per plane
+		// the corner furthest along the plane normal: if even that is outside, the whole box is
+		const float* p = planes[plane];
+		float x = (p[0] >= 0.0f) ? maximum.x : minimum.x;
+		float y = (p[1] >= 0.0f) ? maximum.y : minimum.y;
+		float z = (p[2] >= 0.0f) ? maximum.z : minimum.z;
+		if (p[0] * x + p[1] * y + p[2] * z + p[3] < 0.0f)
+			return false;
+		} // per plane
+	return true;
+	} // IntersectsBox()
+
+// a Matrix4 from the 16 column-major floats that OpenGL hands back
+Matrix4 Frustum::FromColumnMajor(const float* coordinates)
+	{ // FromColumnMajor()
+	Matrix4 result;
+	for (int row = 0; row < 4; row++)
+		for (int column = 0; column < 4; column++)
+			result[row][column] = coordinates[4 * column + row];
+	return result;
+	} // FromColumnMajor()
+
+// the projection gluPerspective() builds
+Matrix4 Frustum::Perspective(float fovy, float aspect, float zNear, float zFar)
+	{ // Perspective()
+	float focal = 1.0f / tan(DEG2RAD(fovy) / 2.0f);
+	Matrix4 result;
+	result[0][0] = focal / aspect;
+	result[1][1] = focal;
+	result[2][2] = (zFar + zNear) / (zNear - zFar);
+	result[2][3] = 2.0f * zFar * zNear / (zNear - zFar);
+	result[3][2] = -1.0f;
+	return result;
+	} // Perspective()
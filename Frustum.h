@@ -0,0 +1,45 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Frustum.h
+//	------------------------
+//
+//	The six planes of a view frustum, taken from a
+//	combined projection * modelview matrix, with a test
+//	for axis-aligned boxes so that whatever lies wholly
+//	outside the view can be skipped.
+//
+///////////////////////////////////////////////////
+
+#ifndef _FRUSTUM_H
+#define _FRUSTUM_H
+
+#include "Cartesian3.h"
+#include "Matrix4.h"
+
+class Frustum
+	{ // class Frustum
+	public:
+	// left, right, bottom, top, near, far: a point p is inside a plane
+	// when plane[0] * p.x + plane[1] * p.y + plane[2] * p.z + plane[3] >= 0
+	float planes[6][4];
+
+	// constructor gives a frustum that contains everything
+	Frustum();
+
+	// extract the planes from projection * modelview, so that they are
+	// in the coordinates the modelview matrix is applied to
+	void SetFromMatrix(const Matrix4& clipMatrix);
+
+	// false only if the box is certainly outside: a box near a corner
+	// of the frustum can be reported as visible when it is not
+	bool IntersectsBox(const Cartesian3& minimum, const Cartesian3& maximum) const;
+
+	// a Matrix4 from the 16 column-major floats that OpenGL hands back
+	static Matrix4 FromColumnMajor(const float* coordinates);
+
+	// the projection gluPerspective() builds, for code that has no context to ask
+	static Matrix4 Perspective(float fovy, float aspect, float zNear, float zFar);
+	}; // class Frustum
+
+#endif
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	GLSupport.cpp
+//	------------------------
+//
+//	Access to OpenGL entry points beyond 1.1 (buffer
+//	objects and so on), and checks for what the current
+//	context supports.
+//
+///////////////////////////////////////////////////
+
+#include "GLSupport.h"
+#include <cstdio>
+#include <cstring>
+
+// true if the current context is at least the given version
+bool GLSupport::HasVersion(int major, int minor)
+	{ // HasVersion()
+	// with no context (or no driver) there is no version string
+	const char* version = (const char*) glGetString(GL_VERSION);
+	if (version == NULL)
+		return false;
+
+	// the string starts "major.minor", possibly with a prefix such as "OpenGL ES "
+	int contextMajor = 0, contextMinor = 0;
+	while (*version != '\0' && (*version < '0' || *version > '9'))
+		version++;
+	if (sscanf(version, "%d.%d", &contextMajor, &contextMinor) != 2)
+		return false;
+	return (contextMajor > major) || (contextMajor == major && contextMinor >= minor);
+	} // HasVersion()
+
+// true if the current context advertises the named extension
+bool GLSupport::HasExtension(const char* name)
+	{ // HasExtension()
+	const char* extensions = (const char*) glGetString(GL_EXTENSIONS);
+	if (extensions == NULL)
+		return false;
+
+	// match whole words only, since some names are prefixes of others
+	size_t length = strlen(name);
+	for (const char* found = strstr(extensions, name); found != NULL; found = strstr(found + length, name))
+		if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == '\0'))
+			return true;
+	return false;
+	} // HasExtension()
+
+// true if vertex and index buffer objects can be used
+bool GLSupport::HasBuffers()
+	{ // HasBuffers()
+#ifdef GL_SUPPORT_BUFFERS
+	// we call the core entry points, so the ARB extension on its own is not enough
+	return HasVersion(1, 5);
+#else
+	return false;
+#endif
+	} // HasBuffers()
+
+// true if shaders with instanced arrays can be used
+bool GLSupport::HasInstancing()
+	{ // HasInstancing()
+#ifdef GL_SUPPORT_INSTANCING
+	// instanced arrays (glVertexAttribDivisor) became core in 3.3
+	return HasVersion(3, 3);
+#else
+	return false;
+#endif
+	} // HasInstancing()
+
+// true if the current context renders in software rather than on a GPU
+bool GLSupport::IsSoftware()
+	{ // IsSoftware()
+	const char* renderer = (const char*) glGetString(GL_RENDERER);
+	if (renderer == NULL)
+		return false;
+
+	// Mesa's rasterizers, Google's, and the one Windows falls back to without a driver
+	const char* software[] = { "llvmpipe", "softpipe", "Software Rasterizer", "SwiftShader", "GDI Generic" };
+	for (size_t name = 0; name < sizeof(software) / sizeof(software[0]); name++)
+		if (strstr(renderer, software[name]) != NULL)
+			return true;
+	return false;
+	} // IsSoftware()
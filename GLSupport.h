@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	GLSupport.h
+//	------------------------
+//
+//	Access to OpenGL entry points beyond 1.1 (buffer
+//	objects and so on), and checks for what the current
+//	context supports. Include this before anything else
+//	that includes GL, or the prototypes will be missing.
+//
+//	GL_SUPPORT_BUFFERS is defined when the platform headers
+//	declare the buffer object entry points; code that uses
+//	them must also check HasBuffers() at runtime, and in the
+//	same way GL_SUPPORT_INSTANCING is defined when they declare
+//	the shader and instanced drawing entry points (GL 3.3),
+//	which must be checked for with HasInstancing().
+//
+///////////////////////////////////////////////////
+
+#ifndef _GL_SUPPORT_H
+#define _GL_SUPPORT_H
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <OpenGL/glu.h>
+#define GL_SUPPORT_BUFFERS
+#else
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glext.h>
+#ifndef _WIN32
+#define GL_SUPPORT_BUFFERS
+#define GL_SUPPORT_INSTANCING
+#endif
+#endif
+
+class GLSupport
+	{ // class GLSupport
+	public:
+	// true if the current context is at least the given version
+	static bool HasVersion(int major, int minor);
+
+	// true if the current context advertises the named extension
+	static bool HasExtension(const char* name);
+
+	// true if vertex and index buffer objects can be used (GL 1.5 or later)
+	static bool HasBuffers();
+
+	// true if shaders with instanced arrays can be used (GL 3.3 or later)
+	static bool HasInstancing();
+
+	// true if the current context renders in software rather than on a GPU
+	static bool IsSoftware();
+	}; // class GLSupport
+
+#endif
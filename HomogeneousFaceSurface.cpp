@@ -17,24 +17,19 @@
 ///////////////////////////////////////////////////
 
 
+#include "GLSupport.h"
 #include "HomogeneousFaceSurface.h"
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <math.h>
-#ifdef _WIN32
-#include <windows.h>
-#endif
-#ifdef __APPLE__
-#include <OpenGL/gl.h>
-#include <OpenGL/glu.h>
-#else
-#include <GL/gl.h>
-#include <GL/glu.h>
-#endif
 
 // constructor will initialise to safe values
 HomogeneousFaceSurface::HomogeneousFaceSurface()
+	:
+	vertexBuffer(0),
+	renderVertexCount(0),
+	renderDirty(true)
 	{ // HomogeneousFaceSurface::HomogeneousFaceSurface()
 	// force the size to nil (should not be necessary, but . . .)
 	vertices.resize(0);
@@ -95,46 +90,101 @@ void HomogeneousFaceSurface::ComputeUnitNormalVectors()
 		// and store it as a homogeneous vector
 		normals[triangle] = Homogeneous4(normal.x, normal.y, normal.z, 0.0);			
 		} // per triangle
+
+	// the geometry has changed, so OpenGL's copy is out of date
+	renderDirty = true;
 	} // ComputeUnitNormalVectors()
 
+// lay out the triangles for OpenGL, and upload them if buffer objects are available
+void HomogeneousFaceSurface::BuildRenderBuffers()
+	{ // HomogeneousFaceSurface::BuildRenderBuffers()
+	// each vertex carries its own normal if there is one per vertex, otherwise its triangle's
+	renderVertexCount = 3 * (long) (vertices.size() / 3);
+	bool perVertex = normals.size() == vertices.size();
+	renderVertices.resize(6 * renderVertexCount);
+	for (long vertex = 0; vertex < renderVertexCount; vertex++)
+		{ // per vertex
+		Cartesian3 position = vertices[vertex].Point();
+		const Homogeneous4 &normal = normals[perVertex ? vertex : vertex / 3];
+		float *out = &renderVertices[6 * vertex];
+		out[0] = position.x;	out[1] = position.y;	out[2] = position.z;
+		out[3] = normal.x;		out[4] = normal.y;		out[5] = normal.z;
+		} // per vertex
+
+#ifdef GL_SUPPORT_BUFFERS
+	if (GLSupport::HasBuffers())
+		{ // buffer objects
+		// upload once, after which the CPU copy is no longer needed
+		if (vertexBuffer == 0)
+			glGenBuffers(1, &vertexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, renderVertices.size() * sizeof(float), renderVertices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		std::vector<float>().swap(renderVertices);
+		} // buffer objects
+#endif
+
+	renderDirty = false;
+	} // HomogeneousFaceSurface::BuildRenderBuffers()
+
 // routine to render
 void HomogeneousFaceSurface::Render(Matrix4 &viewMatrix)
 	{ // HomogeneousFaceSurface::Render()
-	// walk through the faces rendering each one
-	glBegin(GL_TRIANGLES);
-	
-	// we loop through all of the triangles
-	for (int triangle = 0; triangle < (int) normals.size(); triangle++)
-		{ // per triangle
-		// retrieve the vertices and the normal
-		Homogeneous4 vertexP 	= viewMatrix * vertices[3 * triangle		];
-		Homogeneous4 vertexQ 	= viewMatrix * vertices[3 * triangle + 1	];
-		Homogeneous4 vertexR 	= viewMatrix * vertices[3 * triangle + 2	];
-
-		// normal vector is tricky because we need NOT to apply the translation component
-		// so we create a temporary matrix and zero its translation elements
-		Matrix4 normalMatrix = viewMatrix;
-		normalMatrix[0][3] = normalMatrix[1][3] = normalMatrix[2][3] = 0.0;
-		
-		// now we multiply to get the correct normal		
-		Homogeneous4 normal 	= normalMatrix * normals[triangle];
-		
-		// this works because C++ guarantees that the POD data is in exactly
-		// the order stated in the class with no padding.
-		glNormal3fv(&normal.x);
-		glVertex4fv(&vertexP.x);
-		glVertex4fv(&vertexQ.x);
-		glVertex4fv(&vertexR.x);
-		} // per triangle
-	
-	glEnd();
+	// send the geometry to OpenGL the first time, or if it has changed
+	if (renderDirty)
+		BuildRenderBuffers();
+
+	// let OpenGL apply the view matrix, rather than transforming every vertex ourselves
+	// it also transforms the normals correctly, since the view matrix is rigid
+	columnMajorMatrix modelview = viewMatrix.columnMajor();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glMultMatrixf(modelview.coordinates);
+
+	// point at the buffer object, or at our own copy if there isn't one
+	const char *base = (const char *) renderVertices.data();
+#ifdef GL_SUPPORT_BUFFERS
+	if (vertexBuffer != 0)
+		{ // buffer object
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		base = NULL;
+		} // buffer object
+#endif
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 6 * sizeof(float), base);
+	glNormalPointer(GL_FLOAT, 6 * sizeof(float), base + 3 * sizeof(float));
+
+	// and draw every triangle in one call
+	glDrawArrays(GL_TRIANGLES, 0, renderVertexCount);
+
+	// then put everything back the way we found it
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+#ifdef GL_SUPPORT_BUFFERS
+	if (vertexBuffer != 0)
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+	glPopMatrix();
 	} // HomogeneousFaceSurface::Render()
 
+// free the buffer object, so that the next Render() uploads again
+void HomogeneousFaceSurface::ReleaseBuffers()
+	{ // HomogeneousFaceSurface::ReleaseBuffers()
+#ifdef GL_SUPPORT_BUFFERS
+	if (vertexBuffer != 0)
+		glDeleteBuffers(1, &vertexBuffer);
+#endif
+	vertexBuffer = 0;
+	renderDirty = true;
+	} // HomogeneousFaceSurface::ReleaseBuffers()
+
 // routine to dump out as triangle soup
 void HomogeneousFaceSurface::WriteTriangleSoup()
 	{ // HomogeneousFaceSurface::WriteTriangleSoup()
-	std::cout << normals.size() << std::endl;
-	for (int triangle = 0; triangle < (int) normals.size(); triangle++)
+	// normals may be per vertex, so the count comes from the vertices
+	std::cout << vertices.size() / 3 << std::endl;
+	for (int triangle = 0; triangle < (int) vertices.size() / 3; triangle++)
 		std::cout << std::fixed << vertices[3 * triangle] << "\t\t" << vertices[3 * triangle + 1] << "\t\t" << vertices[3 * triangle +2] << std::endl;
 	} // HomogeneousFaceSurface::WriteTriangleSoup()
 
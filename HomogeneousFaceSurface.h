@@ -31,9 +31,22 @@ class HomogeneousFaceSurface
 	// each three vertices will form a single triangle
 	std::vector<Homogeneous4> vertices;
 
-	// vector to hold corresponding normal vectors
+	// vector to hold corresponding normal vectors: one per triangle, or one per vertex
 	std::vector<Homogeneous4> normals;
 
+	// the triangles laid out for OpenGL: three floats of position then three of normal
+	// per vertex. Emptied once it has been uploaded to a buffer object
+	std::vector<float> renderVertices;
+
+	// the buffer object holding renderVertices, or 0 if there isn't one
+	unsigned int vertexBuffer;
+
+	// how many vertices Render() draws
+	long renderVertexCount;
+
+	// set whenever the geometry changes, so that Render() rebuilds what it sends to OpenGL
+	bool renderDirty;
+
 	// constructor will initialise to safe values
 	HomogeneousFaceSurface();
 	
@@ -44,7 +57,16 @@ class HomogeneousFaceSurface
 	void ComputeUnitNormalVectors();
 	
 	// routine to render
+	// the geometry is sent to OpenGL once, and viewMatrix is applied as the modelview matrix
 	void Render(Matrix4 &viewMatrix);
+
+	// lay out the triangles for OpenGL, and upload them if buffer objects are available
+	// called by Render() when needed, so there must be a current context
+	void BuildRenderBuffers();
+
+	// free the buffer object while the context it was made in is still current: the owner of
+	// the context calls this before destroying it, and the next Render() uploads again
+	void ReleaseBuffers();
 	
 	// routine to dump out as triangle soup
 	void WriteTriangleSoup();	
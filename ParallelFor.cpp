@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	ParallelFor.cpp
+//	------------------------
+//
+//	Runs a loop body over a range of indices on all the
+//	hardware threads, and waits for it to finish.
+//
+//	The helper threads are started on the first call and
+//	then wait for work, so that a loop run every frame
+//	does not pay to start and join threads every time.
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ParallelFor.h"
+
+// one call's loop, which the calling thread and any idle helpers share
+struct ParallelJob
+	{ // struct ParallelJob
+	const std::function<void(long, long)> *body;
+	long count, grain, ranges;
+
+	// the next range to hand out
+	std::atomic<long> next;
+
+	// helpers still working on it, and whether more may join: both guarded by the pool's mutex
+	long helpers;
+	bool listed;
+
+	// take the next range until there are none left
+	void Work()
+		{ // Work()
+		for (long range = next++; range < ranges; range = next++)
+			(*body)(range * grain, std::min((range + 1) * grain, count));
+		} // Work()
+	}; // struct ParallelJob
+
+// the helper threads, one fewer than the hardware has, since the calling thread works too
+class ParallelPool
+	{ // class ParallelPool
+	public:
+	std::mutex mutex;
+	std::condition_variable wake, finished;
+
+	// calls waiting for help: several threads may be running loops at once
+	std::list<ParallelJob *> jobs;
+
+	std::vector<std::thread> threads;
+	bool stopping;
+
+	ParallelPool()
+		:
+		stopping(false)
+		{ // constructor
+		unsigned nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		for (unsigned thread = 1; thread < nThreads; thread++)
+			threads.push_back(std::thread(&ParallelPool::Run, this));
+		} // constructor
+
+	~ParallelPool()
+		{ // destructor
+			{ // stop
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			} // stop
+		wake.notify_all();
+		for (size_t thread = 0; thread < threads.size(); thread++)
+			threads[thread].join();
+		} // destructor
+
+	// once a job's ranges have all been handed out, no one else need join it
+	void Unlist(ParallelJob &job)
+		{ // Unlist()
+		if (job.listed)
+			jobs.remove(&job);
+		job.listed = false;
+		} // Unlist()
+
+	// each helper joins the oldest job, works until its ranges run out, and goes back for more
+	void Run()
+		{ // Run()
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+			{ // per job
+			wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping)
+				return;
+			ParallelJob &job = *jobs.front();
+			job.helpers++;
+
+			lock.unlock();
+			job.Work();
+			lock.lock();
+
+			// the caller may not return until the last helper is out of its ranges
+			Unlist(job);
+			if (--job.helpers == 0)
+				finished.notify_all();
+			} // per job
+		} // Run()
+	}; // class ParallelPool
+
+// call body(begin, end) on ranges of at most grain indices that together cover [0, count)
+void ParallelFor(long count, long grain, const std::function<void(long, long)> &body)
+	{ // ParallelFor()
+	// started on the first call, and kept until the program exits
+	static ParallelPool pool;
+
+	grain = std::max(grain, 1L);
+	long ranges = (count + grain - 1) / grain;
+
+	// not worth waking a thread for
+	if (ranges <= 1 || pool.threads.empty())
+		{ // serial
+		if (count > 0)
+			body(0, count);
+		return;
+		} // serial
+
+	ParallelJob job;
+	job.body = &body;
+	job.count = count;
+	job.grain = grain;
+	job.ranges = ranges;
+	job.next = 0;
+	job.helpers = 0;
+	job.listed = true;
+
+		{ // offer the job
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.jobs.push_back(&job);
+		} // offer the job
+	pool.wake.notify_all();
+
+	// this thread works too, and then waits for any helper still finishing a range
+	job.Work();
+	std::unique_lock<std::mutex> lock(pool.mutex);
+	pool.Unlist(job);
+	pool.finished.wait(lock, [&job]() { return job.helpers == 0; });
+	} // ParallelFor()
@@ -0,0 +1,29 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	ParallelFor.h
+//	------------------------
+//
+//	Runs a loop body over a range of indices on all the
+//	hardware threads, and waits for it to finish. The
+//	range is handed out a grain at a time, so that uneven
+//	work still spreads evenly. The helper threads are
+//	started once, on the first call, and kept.
+//
+//	The body is called with [begin, end) ranges from
+//	several threads at once, so it must only write what
+//	belongs to its own indices.
+//
+///////////////////////////////////////////////////
+
+#ifndef _PARALLEL_FOR_H
+#define _PARALLEL_FOR_H
+
+#include <functional>
+
+// call body(begin, end) on ranges of at most grain indices that together cover [0, count)
+// small ranges, or a machine with one thread, run on the calling thread alone
+// it may be called from several threads at once, and from inside a body
+void ParallelFor(long count, long grain, const std::function<void(long, long)> &body);
+
+#endif
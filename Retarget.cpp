@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Retarget.cpp
+//	------------------------
+//
+//	A joint mapping between two skeletons, built once per
+//	pair of rigs, so that a clip captured on one rig can be
+//	sampled onto another with a flat lookup table
+//
+///////////////////////////////////////////////////
+
+#include "Retarget.h"
+#include <cctype>
+
+// constructor will initialise to an empty table
+Retarget::Retarget()
+	:
+	matchedJoints(0),
+	identity(false)
+	{ // constructor
+	} // constructor
+
+// reduce a joint name to the part that is common between rigs
+std::string Retarget::CanonicalName(const std::string& name)
+	{ // CanonicalName()
+	// drop any namespace prefix such as "mixamorig1:"
+	size_t colon = name.find_last_of(':');
+	std::string base = (colon == std::string::npos) ? name : name.substr(colon + 1);
+
+	// and compare case-insensitively
+	for (size_t i = 0; i < base.size(); i++)
+		base[i] = std::tolower((unsigned char) base[i]);
+	return base;
+	} // CanonicalName()
+
+// build the table that maps the source skeleton onto the target skeleton
+void Retarget::Build(BVHData& target, BVHData& source)
+	{ // Build()
+	size_t nTarget = target.all_joints.size();
+	size_t nSource = source.all_joints.size();
+
+	sourceJoint.assign(nTarget, -1);
+	matchedJoints = 0;
+
+	// index the source joints by canonical name, once
+	std::map<std::string, int> sourceByName;
+	for (size_t i = 0; i < nSource; i++)
+		sourceByName[CanonicalName(source.all_joints[i]->joint_name)] = source.all_joints[i]->id;
+
+	// remember which source joints are already driving something
+	std::vector<bool> used(nSource, false);
+
+	// joint ids are assigned in depth-first order, so a parent is always visited before its children
+	for (size_t i = 0; i < nTarget; i++)
+		{ // per target joint
+		Joint* joint = target.all_joints[i];
+		int match = -1;
+
+		// first choice: a source joint with the same name
+		std::map<std::string, int>::iterator named = sourceByName.find(CanonicalName(joint->joint_name));
+		if (named != sourceByName.end() && !used[named->second])
+			match = named->second;
+
+		// second choice: the same child slot under the source joint that drives our parent
+		int parent = target.parentBones[joint->id];
+		if (match == -1 && parent == -1 && nSource > 0 && !used[0])
+			match = 0;
+		else if (match == -1 && parent != -1 && sourceJoint[parent] != -1)
+			{ // topological match
+			Joint* targetParent = target.all_joints[parent];
+			Joint* sourceParent = source.all_joints[sourceJoint[parent]];
+			for (size_t child = 0; child < targetParent->Children.size(); child++)
+				if (targetParent->Children[child].id == joint->id)
+					{ // found our slot
+					if (child < sourceParent->Children.size() && !used[sourceParent->Children[child].id])
+						match = sourceParent->Children[child].id;
+					break;
+					} // found our slot
+			} // topological match
+
+		if (match == -1)
+			continue;
+
+		// record the match
+		sourceJoint[joint->id] = match;
+		used[match] = true;
+		matchedJoints++;
+		} // per target joint
+
+	// the table is the identity when every joint maps to itself
+	identity = (nTarget == nSource);
+	for (size_t i = 0; identity && i < nTarget; i++)
+		if (sourceJoint[i] != (int) i)
+			identity = false;
+	} // Build()
+
+// sample the source clip's rotations for a frame onto the target rig
+void Retarget::SampleRotations(BVHData& source, int frame, std::vector<Cartesian3>& rotations) const
+	{ // SampleRotations()
+	const std::vector<Cartesian3>& sourceRotations = source.boneRotations[frame % source.frame_count];
+
+	// the fast path is a straight copy
+	if (identity)
+		{ // identical rigs
+		rotations = sourceRotations;
+		return;
+		} // identical rigs
+
+	// otherwise walk the flat remap table
+	for (size_t i = 0; i < sourceJoint.size(); i++)
+		if (sourceJoint[i] != -1)
+			rotations[i] = sourceRotations[sourceJoint[i]];
+	} // SampleRotations()
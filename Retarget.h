@@ -0,0 +1,52 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Retarget.h
+//	------------------------
+//
+//	A joint mapping between two skeletons, built once per
+//	pair of rigs, so that a clip captured on one rig can be
+//	sampled onto another with a flat lookup table
+//
+///////////////////////////////////////////////////
+
+#ifndef _RETARGET_H
+#define _RETARGET_H
+
+#include <vector>
+#include <string>
+
+#include "BVHData.h"
+
+class Retarget
+	{ // class Retarget
+	public:
+	// for each target joint id, the source joint id that drives it (-1 if none)
+	std::vector<int> sourceJoint;
+
+	// number of target joints that found a partner in the source
+	int matchedJoints;
+
+	// true when every joint maps to the one with the same id, so the table is the identity
+	// (poses are rotations hung on each rig's own offsets, so bone lengths need not agree)
+	bool identity;
+
+	// constructor will initialise to an empty table
+	Retarget();
+
+	// build the table that maps the source skeleton onto the target skeleton
+	// joints are matched by name first, then by their position under a matched parent
+	void Build(BVHData& target, BVHData& source);
+
+	// sample the source clip's rotations for a frame onto the target rig
+	// rotations must already hold one entry per target joint: joints with no
+	// partner in the source are left untouched, so the caller can pre-fill a fallback pose
+	void SampleRotations(BVHData& source, int frame, std::vector<Cartesian3>& rotations) const;
+
+	// reduce a joint name to the part that is common between rigs
+	// e.g. "mixamorig1:LeftArm" and "mixamorig:leftarm" both become "leftarm"
+	static std::string CanonicalName(const std::string& name);
+
+	}; // class Retarget
+
+#endif
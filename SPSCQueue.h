@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	SPSCQueue.h
+//	------------------------
+//
+//	A fixed-size queue from one thread that pushes to one
+//	thread that pops, with no locks: each end only writes
+//	its own counter, and reads the other's to see how far
+//	it may go. A push onto a full queue fails rather than
+//	waiting.
+//
+///////////////////////////////////////////////////
+
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// CAPACITY must be a power of two
+template <class T, size_t CAPACITY> class SPSCQueue
+	{ // class SPSCQueue
+	public:
+	// constructor will initialise to safe values
+	SPSCQueue()
+		:
+		pushed(0),
+		popped(0)
+		{ // constructor
+		static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SPSCQueue capacity must be a power of two");
+		} // constructor
+
+	// add an item at the back: only the producer may call this, and it returns false if the queue is full
+	bool Push(const T &item)
+		{ // Push()
+		size_t back = pushed.load(std::memory_order_relaxed);
+		if (back - popped.load(std::memory_order_acquire) == CAPACITY)
+			return false;
+		items[back & (CAPACITY - 1)] = item;
+		pushed.store(back + 1, std::memory_order_release);
+		return true;
+		} // Push()
+
+	// take the item at the front: only the consumer may call this, and it returns false if the queue is empty
+	bool Pop(T &item)
+		{ // Pop()
+		size_t front = popped.load(std::memory_order_relaxed);
+		if (front == pushed.load(std::memory_order_acquire))
+			return false;
+		item = items[front & (CAPACITY - 1)];
+		popped.store(front + 1, std::memory_order_release);
+		return true;
+		} // Pop()
+
+	// a queue belongs to the two threads that share it
+	SPSCQueue(const SPSCQueue &) = delete;
+	SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+	private:
+	T items[CAPACITY];
+	// how many items have ever been pushed and popped: each written by one end only,
+	// and kept on cache lines of their own so that the two ends do not fight over them
+	alignas(64) std::atomic<size_t> pushed;
+	alignas(64) std::atomic<size_t> popped;
+	}; // class SPSCQueue
+
+#endif
@@ -13,8 +13,11 @@
 ///////////////////////////////////////////////////
 
 #include "SceneModel.h"
+#include "FrameProfiler.h"
 #include <math.h>
+#include <chrono>
 #include <iostream>
+#include <fstream>
 
 // three local variables with the hardcoded file names
 const char* groundModelName		= "./models/randomland.dem";
@@ -26,6 +29,12 @@ const char* motionBvhveerLeft	= "./models/veer_left.bvh";
 const char* motionBvhveerRight	= "./models/veer_right.bvh";
 const float cameraSpeed = 0.5;
 
+// text DEMs bigger than this are streamed a tile at a time rather than read in whole
+// (binary ones are mapped, so the OS reads them in as they are used)
+const long streamedTerrainBytes = 256L << 20;
+// and tiles are read within this distance of the camera and of each character
+const float tileRequestRadius = 500.0;
+
 const Homogeneous4 sunDirection(0.5, -0.5, 0.3, 1.0);
 const GLfloat groundColour[4] = { 0.2, 0.5, 0.2, 1.0 };
 const GLfloat boneColour[4] = { 0.7, 0.7, 0.4, 1.0 };
@@ -37,9 +46,19 @@ const GLfloat blackColour[4] = {0.0, 0.0, 0.0, 1.0};
 
 // constructor
 SceneModel::SceneModel()
+	:
+	simulating(false)
 	{ // constructor
 	// load the object models from files
-	groundModel.ReadFileTerrainData(groundModelName, 3);
+	// indexed, so that it can be drawn a chunk at a time
+	std::ifstream groundFile(groundModelName, std::ios::binary | std::ios::ate);
+	if (groundFile.good() && (long) groundFile.tellg() > streamedTerrainBytes && !BinaryDEM::IsBinary(groundModelName))
+		{ // too big to read in whole
+		groundTiles.Open(groundModelName, 3);
+		groundModel.tileStore = &groundTiles;
+		} // too big to read in whole
+	else
+		groundModel.ReadFileTerrainData(groundModelName, 3, Terrain::INDEXED_MESH);
 
 	// load the animation data from files
 	restPose.ReadFileBVH(motionBvhStand);
@@ -48,42 +67,110 @@ SceneModel::SceneModel()
 	veerRightCycle.ReadFileBVH(motionBvhveerRight);
     walkCycle.ReadFileBVH(motionBvhWalk);
 
+    //Index the cycles so that they can be looked up by animation
+    cycles.resize(Character::N_ANIMATIONS);
+    cycles[Character::REST] = &restPose;
+    cycles[Character::RUNNING] = &runCycle;
+    cycles[Character::WALKING] = &walkCycle;
+    cycles[Character::TURN_LEFT] = &veerLeftCycle;
+    cycles[Character::TURN_RIGHT] = &veerRightCycle;
+
+    //Build the joint mappings between every pair of cycles once, so blending never matches names per frame
+    retargetMaps.resize(Character::N_ANIMATIONS, std::vector<Retarget>(Character::N_ANIMATIONS));
+    for (int to = 0; to < Character::N_ANIMATIONS; to++)
+    {
+        for (int from = 0; from < Character::N_ANIMATIONS; from++)
+            retargetMaps[to][from].Build(*cycles[to], *cycles[from]);
+    }
+
+	// the characters' surface, bound to the rest pose: without it they are drawn as bones
+	if (characterMesh.ReadFileOBJ(characterModelName))
+		characterMesh.Bind(restPose, Character::scale);
+
 	// set the world to opengl matrix
 	world2OpenGLMatrix = Matrix4::RotateX(90.0);
 	CameraTranslateMatrix = Matrix4::Translate(Cartesian3(-5, 15, -15.5));
 	CameraRotationMatrix = Matrix4::RotateX(-30.0) * Matrix4::RotateZ(15.0);
 
-	// initialize the character's position and rotation
-	EventCharacterReset();
+	// the user's character starts at the origin in the rest pose
+	characters.resize(1);
 
 	// and set the frame number to 0
 	frameNumber = 0;
+	charactersDrawn = 0;
 
-    //Initialise current BVH to restPose
-    current = restPose;
-    currentAnim = REST;
-
-    //Set up the character location and rotation
-    characterTransform = Matrix4::Identity();
-    characterLocation = {0,0,0};
-    characterRotation = Matrix4::Identity();
-    move = false;
-    walk = false;
-    turn = 0;
+	// so that there is something to draw before the first tick
+	PublishSnapshot();
 
 	} // constructor
 
+// destructor stops the simulation if it is running
+SceneModel::~SceneModel()
+	{ // destructor
+	StopSimulation();
+	} // destructor
+
 // routine that updates the scene for the next frame
 void SceneModel::Update()
 	{ // Update()
+	ScopedPhase timer(PHASE_UPDATE);
+
+	// apply whatever has been posted since the last tick: any event may change what is drawn
+	bool changed = false;
+	int event;
+	while (events.Pop(event))
+		{ // per event
+		ApplyEvent(event);
+		changed = true;
+		} // per event
+
 	// increment the frame counter
     frameNumber++;
 
+	// and step every character
+	for (size_t character = 0; character < characters.size(); character++)
+		{ // per character
+		characters[character].Step(cycles, retargetMaps, groundModel);
+		changed = changed || characters[character].poseChanged;
+		} // per character
+
+	// keep the tiles around the camera and the characters coming in, if the terrain is streamed
+	if (groundModel.tileStore != NULL)
+		{ // streamed terrain
+		Cartesian3 camera = CameraTranslateMatrix * Cartesian3(0, 0, 0);
+		groundTiles.RequestTilesAround(-camera.x, -camera.y, tileRequestRadius);
+		for (size_t character = 0; character < characters.size(); character++)
+			{ // per character
+			Cartesian3 position = characters[character].characterTransform * Cartesian3(0, 0, 0);
+			groundTiles.RequestTilesAround(position.x, position.y, tileRequestRadius);
+			} // per character
+		} // streamed terrain
+
+	// and hand the result to Render()
+	PublishSnapshot();
+	if (snapshotPublished)
+		snapshotPublished(changed);
+
 	} // Update()
 
+// copy what Render() needs into the snapshot the render thread is not looking at, and publish it
+void SceneModel::PublishSnapshot()
+	{ // PublishSnapshot()
+	SceneSnapshot& snapshot = snapshots.WriteBuffer();
+	snapshot.frameNumber = frameNumber;
+	snapshot.CameraTranslateMatrix = CameraTranslateMatrix;
+	snapshot.CameraRotationMatrix = CameraRotationMatrix;
+	snapshot.characters.resize(characters.size());
+	for (size_t character = 0; character < characters.size(); character++)
+		snapshot.characters[character].Capture(characters[character]);
+	snapshots.Publish();
+	} // PublishSnapshot()
+
 // routine to tell the scene to render itself
 void SceneModel::Render()
 	{ // Render()
+	ScopedPhase timer(PHASE_RENDER);
+
 	// enable Z-buffering
 	glEnable(GL_DEPTH_TEST);
 	
@@ -94,7 +181,6 @@ void SceneModel::Render()
 	glLightfv(GL_LIGHT0, GL_AMBIENT, sunAmbient);
 	glLightfv(GL_LIGHT0, GL_DIFFUSE, sunDiffuse);
 	glLightfv(GL_LIGHT0, GL_SPECULAR, blackColour);
-	glLightfv(GL_LIGHT0, GL_EMISSION, blackColour);
 	
 	// background is sky-blue
 	glClearColor(0.7, 0.7, 1.0, 1.0);
@@ -102,20 +188,24 @@ void SceneModel::Render()
 	// clear the buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// everything below comes from the newest tick, which stays put while we draw it
+	const SceneSnapshot& snapshot = snapshots.Read();
+
 	// compute the view matrix by combining camera translation, rotation & world2OpenGL
-	viewMatrix = world2OpenGLMatrix * CameraRotationMatrix * CameraTranslateMatrix;
+	viewMatrix = world2OpenGLMatrix * snapshot.CameraRotationMatrix * snapshot.CameraTranslateMatrix;
 
 	// compute the light position
-  	Homogeneous4 lightDirection = world2OpenGLMatrix * CameraRotationMatrix * sunDirection;
+  	Homogeneous4 lightDirection = world2OpenGLMatrix * snapshot.CameraRotationMatrix * sunDirection;
   	
   	// turn it into Cartesian and normalise
   	Cartesian3 lightVector = lightDirection.Vector().unit();
 
 	// and set the w to zero to force infinite distance
- 	lightDirection.w = 0.0;
+	// (OpenGL reads four floats, so a Cartesian3 alone would leave w to whatever follows it)
+	GLfloat lightPosition[4] = { lightVector.x, lightVector.y, lightVector.z, 0.0f };
  	 	
 	// pass it to OpenGL
-	glLightfv(GL_LIGHT0, GL_POSITION, &(lightVector.x));
+	glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
 
 	// and set a material colour for the ground
 	glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, groundColour);
@@ -123,72 +213,120 @@ void SceneModel::Render()
 	glMaterialfv(GL_FRONT, GL_EMISSION, blackColour);
 
 	// render the terrain
-    groundModel.Render(viewMatrix);
-
-	// now set the colour to draw the bones
+	{ // terrain
+	ScopedPhase terrainTimer(PHASE_TERRAIN);
+	// a streamed terrain has no mesh of its own, so its overview is drawn in its place
+	if (groundModel.tileStore == NULL)
+		groundModel.Render(viewMatrix);
+	else if (groundOverview.nRows > 0 || groundOverview.ReadOverview(groundTiles))
+		groundOverview.Render(viewMatrix);
+	} // terrain
+
+	// now set the colour to draw the bones (or the characters' surface)
+	ScopedPhase bonesTimer(PHASE_BONES);
     glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, boneColour);
 
-    //If the character is moving, update its position
-    if(move){
-        //Go slower if the character is turning
-        if (turn == 1 || turn == 2)
-            characterLocation.y = -0.35;
-        //Slowest pace when walking
-        else if(walk)
-            characterLocation.y = -0.2;
-        //Go quickest when running
-        else
-            characterLocation.y = -0.5;
-    }
-    else
-        characterLocation.y = 0;
-
-    //Turn the character if necessary
-    if(turn == 1)
-        characterRotation = Matrix4::RotateZ(355); //Left
-    else if (turn == 2)
-        characterRotation = Matrix4::RotateZ(5); // Right
-    else
-        characterRotation = Matrix4::Identity(); // No turn
-
-    //Apply the movement and orientation changes to the character's position
-    characterTransform = characterTransform * Matrix4::Translate(characterLocation) * characterRotation;
-    Matrix4 characterPosition = viewMatrix * characterTransform;
-
-    //Get the character's position in the ground's coordinate system, so we can get the terrain height
-    Cartesian3 characterPos = characterTransform * Cartesian3(0,0,0);
-    float groundHeight = groundModel.getHeight(characterPos.x, characterPos.z);
-
-    if(currentlyBlending)
-    {
-        //Render
-        current.RenderBlend(characterPosition, 0.1, frameNumber,  groundHeight, blend, t, blendFrame );
-
-        //Update values for next iteration
-        blendFrame += 1;
-
-        //The animation blend lasts for 0.5s (i.e. 12 frames out of the 24fps)
-        t -= (1.0 / 12.0);
-
-        //Check whether to stop blending
-        if(t < 0)
-        {
-            //Make the blended animation the current one
-            currentlyBlending = false;
-            current = blend;
-            frameNumber = blendFrame;
-        }
-    }
-
-    else
-    {
-        //Render the current pose
-        //Make it 1/10th of the size in the file by specifying scale = 0.1
-        current.Render(characterPosition, 0.1, frameNumber, groundHeight);
-    }
+	// find what can be seen with the projection we have been given
+	// (identity to start with, in case there is no context to ask)
+	float projection[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	Frustum frustum;
+	frustum.SetFromMatrix(Frustum::FromColumnMajor(projection) * viewMatrix);
+
+	// and draw each character in view in the pose Update() left it in, all in one batch
+	bool skinned = characterMesh.Bound();
+	charactersDrawn = 0;
+	for (size_t character = 0; character < snapshot.characters.size(); character++)
+		if (frustum.IntersectsBox(snapshot.characters[character].boundsMinimum, snapshot.characters[character].boundsMaximum))
+			{ // in view
+			if (skinned)
+				snapshot.characters[character].Skin(characterMesh);
+			else
+				snapshot.characters[character].Render(viewMatrix, bones);
+			charactersDrawn++;
+			} // in view
+	if (skinned)
+		{ // surface
+		characterMesh.Skin();
+		characterMesh.Draw(viewMatrix);
+		} // surface
+	else
+		bones.Draw();
 
     } // Render()
 
+// free every OpenGL object Render() made
+void SceneModel::ReleaseBuffers()
+	{ // ReleaseBuffers()
+	groundModel.ReleaseBuffers();
+	groundOverview.ReleaseBuffers();
+	bones.ReleaseBuffers();
+	BVHData::cylinderBones.ReleaseBuffers();
+	characterMesh.ReleaseBuffers();
+	} // ReleaseBuffers()
+
+// call Update() on a thread of its own, ticksPerSecond times a second
+void SceneModel::StartSimulation(double ticksPerSecond)
+	{ // StartSimulation()
+	StopSimulation();
+	simulating = true;
+	simulationThread = std::thread([this, ticksPerSecond]()
+		{ // simulation
+		std::chrono::steady_clock::duration tick = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / ticksPerSecond));
+		std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+		while (simulating.load(std::memory_order_relaxed))
+			{ // per tick
+			Update();
+
+			// keep to the tick, but if we have fallen well behind, start counting again from now
+			// rather than running flat out to catch up
+			next += tick;
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now > next + 4 * tick)
+				next = now;
+			std::this_thread::sleep_until(next);
+			} // per tick
+		}); // simulation
+	} // StartSimulation()
+
+// stop the thread StartSimulation() started
+void SceneModel::StopSimulation()
+	{ // StopSimulation()
+	simulating = false;
+	if (simulationThread.joinable())
+		simulationThread.join();
+	} // StopSimulation()
+
+// queue an event for the next Update()
+bool SceneModel::PostEvent(int event)
+	{ // PostEvent()
+	return events.Push(event);
+	} // PostEvent()
+
+// apply an event at once
+void SceneModel::ApplyEvent(int event)
+	{ // ApplyEvent()
+	switch (event)
+		{ // event switch
+		case EVENT_CAMERA_FORWARD:			EventCameraForward();			break;
+		case EVENT_CAMERA_LEFT:				EventCameraLeft();				break;
+		case EVENT_CAMERA_RIGHT:			EventCameraRight();				break;
+		case EVENT_CAMERA_BACKWARD:			EventCameraBackward();			break;
+		case EVENT_CAMERA_UP:				EventCameraUp();				break;
+		case EVENT_CAMERA_DOWN:				EventCameraDown();				break;
+		case EVENT_CAMERA_TURN_LEFT:		EventCameraTurnLeft();			break;
+		case EVENT_CAMERA_TURN_RIGHT:		EventCameraTurnRight();			break;
+		case EVENT_CHARACTER_TURN_LEFT:		EventCharacterTurnLeft();		break;
+		case EVENT_CHARACTER_TURN_RIGHT:	EventCharacterTurnRight();		break;
+		case EVENT_CHARACTER_FORWARD:		EventCharacterForward();		break;
+		case EVENT_CHARACTER_BACKWARD:		EventCharacterBackward();		break;
+		case EVENT_CHARACTER_WALK:			EventCharacterWalk();			break;
+		case EVENT_CHARACTER_RESET:			EventCharacterReset();			break;
+		case EVENT_CHARACTER_SKINNING:		EventCharacterSkinning();		break;
+		default:															break;
+		} // event switch
+	} // ApplyEvent()
+
 // camera control events: WASD for motion
 void SceneModel::EventCameraForward()
 	{ // EventCameraForward()
@@ -239,94 +377,40 @@ void SceneModel::EventCameraTurnRight()
 	} // EventCameraTurnRight()
 	
 // character motion events: arrow keys for forward, backward, veer left & right
+// these all drive the first character, which is the one the user controls
 void SceneModel::EventCharacterTurnLeft()
     { // EventCharacterTurnLeft()
-
-    //Only allow action if blending is not occuring, and when changing animations
-    if(!currentlyBlending && (currentAnim != TURN_LEFT))
-    {
-        currentlyBlending = true;
-        currentAnim = TURN_LEFT;
-        blend = veerLeftCycle;
-        move = true;
-        turn = 1;
-        blendFrame = 0;
-        t = 1.0;
-    }
-
+    characters[0].StartAnimation(Character::TURN_LEFT, true, false, 1);
     } // EventCharacterTurnLeft()
 	
 void SceneModel::EventCharacterTurnRight()
     { // EventCharacterTurnRight()
-    if(!currentlyBlending && (currentAnim != TURN_RIGHT))
-    {
-        currentlyBlending = true;
-        currentAnim = TURN_RIGHT;
-        blend = veerRightCycle;
-        move = true;
-        walk = false;
-        turn = 2;
-        blendFrame = 0;
-        t = 1.0;
-    }
-
-
+    characters[0].StartAnimation(Character::TURN_RIGHT, true, false, 2);
     } // EventCharacterTurnRight()
 	
 void SceneModel::EventCharacterForward()
     { // EventCharacterForward()
-
-    if(!currentlyBlending && (currentAnim != RUNNING))
-    {
-        currentlyBlending = true;
-        currentAnim = RUNNING;
-        blend = runCycle;
-        move = true;
-        walk = false;
-        turn = 0;
-        blendFrame = 0;
-        t = 1.0;
-    }
-
+    characters[0].StartAnimation(Character::RUNNING, true, false, 0);
     } // EventCharacterForward()
 	
 void SceneModel::EventCharacterBackward()
     { // EventCharacterBackward()
-    if(!currentlyBlending && (currentAnim != REST))
-    {
-        currentlyBlending = true;
-        currentAnim = REST;
-        blend = restPose;
-        move = false;
-        walk = false;
-        turn = 0;
-        blendFrame = 0;
-        t = 1.0;
-    }
-
+    characters[0].StartAnimation(Character::REST, false, false, 0);
     } // EventCharacterBackward()
 
-
 void SceneModel::EventCharacterWalk()
     { // EventCharacterWalk()
-    if(!currentlyBlending && (currentAnim != WALKING))
-    {
-        currentlyBlending = true;
-        currentAnim = WALKING;
-        blend = walkCycle;
-        move = true;
-        walk = true;
-        turn = 0;
-        blendFrame = 0;
-        t = 1.0;
-    }
-
+    characters[0].StartAnimation(Character::WALKING, true, true, 0);
     } // EventCharacterWalk()
 
 // reset character to original position: p
 void SceneModel::EventCharacterReset()
 	{ // EventCharacterReset()
-	this->characterLocation = Cartesian3(0, 0, 0);
-	this->characterRotation = Matrix4::Identity();
-    this->characterTransform = Matrix4::Identity();
+	characters[0].Reset();
 	} // EventCharacterReset()
+
+// switch the character's mesh between linear blend and dual quaternion skinning: k
+void SceneModel::EventCharacterSkinning()
+	{ // EventCharacterSkinning()
+	characters[0].skinning = (characters[0].skinning == SkinnedMesh::DUAL_QUATERNION) ? SkinnedMesh::LINEAR_BLEND : SkinnedMesh::DUAL_QUATERNION;
+	} // EventCharacterSkinning()
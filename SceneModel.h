@@ -8,6 +8,18 @@
 //	------------------------
 //	
 //	The model of the scene
+//
+//	Update() steps the simulation and publishes what it
+//	produced as a snapshot; Render() only draws the newest
+//	snapshot. StartSimulation() runs Update() on a thread
+//	of its own at a fixed tick, so that a slow frame does
+//	not hold the animation back, nor the reverse. While it
+//	runs, the only way in from other threads is PostEvent(),
+//	which queues an event for the next tick to apply.
+//
+//	After each tick, snapshotPublished is told whether it
+//	changed anything that is drawn, so that a window need
+//	only redraw when there is something new to show.
 //	
 ///////////////////////////////////////////////////
 
@@ -26,8 +38,36 @@
 #include <GL/glu.h>
 #endif
 #include "Terrain.h"
+#include "TerrainTileStore.h"
 #include "BVHData.h"
+#include "Retarget.h"
+#include "Character.h"
+#include "SkinnedMesh.h"
 #include "Matrix4.h"
+#include "TripleBuffer.h"
+#include "SPSCQueue.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+// everything Render() needs from one tick of the simulation
+class SceneSnapshot
+	{ // class SceneSnapshot
+	public:
+	// the tick this was taken after
+	unsigned long frameNumber;
+
+	// the camera
+	Matrix4 CameraTranslateMatrix;
+	Matrix4 CameraRotationMatrix;
+
+	// every character's pose
+	std::vector<CharacterPose> characters;
+
+	// constructor will initialise to safe values
+	SceneSnapshot() : frameNumber(0) {}
+	}; // class SceneSnapshot
 
 class SceneModel										
 	{ // class SceneModel
@@ -35,6 +75,12 @@ class SceneModel
 	// a terrain model 
 	Terrain groundModel;
 
+	// heights for a terrain too large to read in whole: when the DEM is streamed,
+	// groundModel answers height queries from here, and the ground is drawn from
+	// groundOverview, built from the tile store's overview once its scan is done
+	TerrainTileStore groundTiles;
+	Terrain groundOverview;
+
 	// animation cycles (which implicitly have geometric data for a character)
 	BVHData restPose;
 	BVHData runCycle;
@@ -42,35 +88,27 @@ class SceneModel
 	BVHData veerRightCycle;
     BVHData walkCycle;
 
-    //Determine whether blending is enabled
-    bool blendingEnabled;
-
-    enum
-    {
-        REST,
-        RUNNING,
-        WALKING,
-        TURN_LEFT,
-        TURN_RIGHT
-    } Animations;
-
-    //Value to store which BVH data is currently being used
-    BVHData current;
-    int currentAnim;
-
-    //Value to store which BVH data is being blended to
-    BVHData blend;
-    bool currentlyBlending = false;
-    float t;
-    int blendFrame;
-
-	// location & orientation of character
-    Matrix4 characterTransform;
-	Cartesian3 characterLocation;
-	Matrix4 characterRotation;
-    bool move;
-    bool walk;
-    int turn;
+    //The animation cycles indexed by Character's animation enum
+    std::vector<BVHData*> cycles;
+
+    //Joint mapping tables for every pair of cycles, built once at startup
+    //retargetMaps[to][from] samples cycle "from" onto the rig of cycle "to"
+    std::vector<std::vector<Retarget>> retargetMaps;
+
+	// the characters in the scene: the first one is the one the user controls
+	std::vector<Character> characters;
+
+	// the bones of every character in view, queued by Render() and drawn in one batch
+	// (bones.drawCalls and bones.verticesSubmitted say what the last frame sent)
+	BoneRenderer bones;
+
+	// the characters' surface, skinned to each pose in view and drawn in place of the bones
+	// when the model could be read (characterMesh.verticesSkinned and VerticesPerSecond()
+	// say what the last frame skinned)
+	SkinnedMesh characterMesh;
+
+	// how many characters the last Render() drew: the others were out of view
+	long charactersDrawn;
 
 	// a matrix that specifies the mapping from world coordinates to those assumed
 	// by OpenGL
@@ -81,18 +119,76 @@ class SceneModel
 	Matrix4 CameraTranslateMatrix;
 	Matrix4 CameraRotationMatrix;
 	
-	// the frame number for use in animating
+	// the number of ticks the scene has been stepped
 	unsigned long frameNumber;
+
+	// the events PostEvent() takes, one for each of the Event...() routines below
+	enum
+		{
+		EVENT_CAMERA_FORWARD,
+		EVENT_CAMERA_LEFT,
+		EVENT_CAMERA_RIGHT,
+		EVENT_CAMERA_BACKWARD,
+		EVENT_CAMERA_UP,
+		EVENT_CAMERA_DOWN,
+		EVENT_CAMERA_TURN_LEFT,
+		EVENT_CAMERA_TURN_RIGHT,
+		EVENT_CHARACTER_TURN_LEFT,
+		EVENT_CHARACTER_TURN_RIGHT,
+		EVENT_CHARACTER_FORWARD,
+		EVENT_CHARACTER_BACKWARD,
+		EVENT_CHARACTER_WALK,
+		EVENT_CHARACTER_RESET,
+		EVENT_CHARACTER_SKINNING
+		};
+
+	// the snapshots Update() publishes and Render() draws
+	TripleBuffer<SceneSnapshot> snapshots;
+
+	// events waiting for the next Update(): one thread may post, and Update() takes them
+	SPSCQueue<int, 256> events;
+
+	// the thread that calls Update(), while the simulation is running
+	std::thread simulationThread;
+	std::atomic<bool> simulating;
+
+	// if set, called by Update() once the snapshot is published (on whichever thread called Update()),
+	// with false when the snapshot would draw exactly as the one before it
+	std::function<void(bool changed)> snapshotPublished;
 	
 	// constructor
 	SceneModel();
 
+	// destructor stops the simulation if it is running
+	~SceneModel();
+
 	// routine that updates the scene for the next frame
+	// this applies the events posted, steps every character, and publishes a snapshot;
+	// it makes no GL calls
 	void Update();
 
 	// routine to tell the scene to render itself
+	// this only draws the newest snapshot Update() published
 	void Render();
 
+	// free every OpenGL object Render() made: whoever owns the context calls this while it is
+	// still current, before destroying it
+	void ReleaseBuffers();
+
+	// call Update() on a thread of its own, ticksPerSecond times a second, until StopSimulation()
+	void StartSimulation(double ticksPerSecond);
+	void StopSimulation();
+
+	// queue an event for the next Update(): returns false if too many are waiting
+	bool PostEvent(int event);
+
+	// apply an event at once: only the thread that calls Update() may do this
+	void ApplyEvent(int event);
+
+	// copy what Render() needs into a snapshot and publish it: Update() does this every tick
+	void PublishSnapshot();
+
+	// the events themselves: while the simulation runs on its own thread, use PostEvent() instead
 	// camera control events: WASD for motion
 	void EventCameraForward();
 	void EventCameraLeft();
@@ -116,6 +212,9 @@ class SceneModel
 	// reset character to original position: p
 	void EventCharacterReset();
 
+	// switch the character's mesh between linear blend and dual quaternion skinning: K
+	void EventCharacterSkinning();
+
 	// needed for now for Xiaoyuan's code
 	void EventSwitchMode();
 
@@ -0,0 +1,679 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	SkinnedMesh.cpp
+//	------------------------
+//
+//	A character's surface, read from an OBJ file, bound to
+//	a BVH skeleton, and skinned on the CPU.
+//
+///////////////////////////////////////////////////
+
+#include "GLSupport.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <unordered_map>
+
+#include "SkinnedMesh.h"
+#include "Retarget.h"
+#include "ParallelFor.h"
+#include "FrameProfiler.h"
+
+// the skinning uses whichever vector instructions the compiler has been allowed
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SKINNED_MESH_SSE2
+#endif
+
+// vertices are skinned this many at a time on each thread
+static const long skinBlock = 1024;
+
+// and influences weighing less than this are dropped when binding
+static const float smallestWeight = 0.01f;
+
+// constructor will initialise to safe values
+SkinnedMesh::SkinnedMesh()
+	:
+	vertexCount(0),
+	skeleton(NULL),
+	meshScale(1.0f),
+	posesQueued(0),
+	posesSkinned(0),
+	verticesSkinned(0),
+	skinSeconds(0.0),
+	drawCalls(0),
+	vertexBuffer(0),
+	indexBuffer(0),
+	indicesUploaded(false)
+	{ // constructor
+	} // constructor
+
+// read the index of an OBJ face corner's element, counting from one, or from the end if negative:
+// returns -1 if there is none or it is out of range
+static long ReadIndex(const char *&text, long count)
+	{ // ReadIndex()
+	char *end;
+	long index = strtol(text, &end, 10);
+	if (end == text)
+		return -1;
+	text = end;
+	index = (index < 0) ? count + index : index - 1;
+	return (index >= 0 && index < count) ? index : -1;
+	} // ReadIndex()
+
+// read vertices, normals and faces from an OBJ file
+bool SkinnedMesh::ReadFileOBJ(const char *fileName)
+	{ // ReadFileOBJ()
+	ScopedPhase timer(PHASE_LOAD_MESH);
+	std::ifstream inFile(fileName);
+	if (!inFile.good())
+		return false;
+
+	// what the file lists, and for each corner of each face the position and normal it picked
+	std::vector<float> filePositions, fileNormals;
+	std::vector<long> vertexPosition, vertexNormal;
+	// a vertex for each different pair, so that corners which share both share a vertex
+	std::unordered_map<unsigned long long, unsigned int> vertexIndex;
+	triangles.clear();
+
+	std::string line;
+	std::vector<unsigned int> face;
+	while (std::getline(inFile, line))
+		{ // per line
+		const char *text = line.c_str();
+		while (*text == ' ' || *text == '\t')
+			text++;
+		if (text[0] == 'v' && (text[1] == ' ' || text[1] == '\t' || (text[1] == 'n' && (text[2] == ' ' || text[2] == '\t'))))
+			{ // position or normal
+			std::vector<float> &values = (text[1] == 'n') ? fileNormals : filePositions;
+			text += (text[1] == 'n') ? 2 : 1;
+			for (int coordinate = 0; coordinate < 3; coordinate++)
+				{ // per coordinate
+				char *end;
+				values.push_back(strtof(text, &end));
+				text = end;
+				} // per coordinate
+			} // position or normal
+		else if (text[0] == 'f' && (text[1] == ' ' || text[1] == '\t'))
+			{ // face
+			text++;
+			face.clear();
+			bool valid = true;
+			long nPositions = (long) filePositions.size() / 3, nNormals = (long) fileNormals.size() / 3;
+			while (valid)
+				{ // per corner
+				while (*text == ' ' || *text == '\t' || *text == '\r')
+					text++;
+				if (*text == '\0')
+					break;
+				// position, then optionally /texture coordinate, then optionally /normal
+				long position = ReadIndex(text, nPositions), normal = -1;
+				if (*text == '/')
+					{ // more
+					text++;
+					char *end;
+					if (*text != '/')
+						{ // texture coordinate, which is not used
+						strtol(text, &end, 10);
+						text = end;
+						} // texture coordinate
+					if (*text == '/')
+						{ // normal
+						text++;
+						normal = ReadIndex(text, nNormals);
+						valid = normal != -1;
+						} // normal
+					} // more
+				valid = valid && position != -1 && (*text == '\0' || *text == ' ' || *text == '\t' || *text == '\r');
+				if (!valid)
+					break;
+
+				unsigned long long key = ((unsigned long long) position << 32) | (unsigned long long) (normal + 1);
+				std::unordered_map<unsigned long long, unsigned int>::iterator found = vertexIndex.find(key);
+				if (found == vertexIndex.end())
+					{ // new vertex
+					found = vertexIndex.insert(std::make_pair(key, (unsigned int) vertexPosition.size())).first;
+					vertexPosition.push_back(position);
+					vertexNormal.push_back(normal);
+					} // new vertex
+				face.push_back(found->second);
+				} // per corner
+
+			// a polygon is split into a fan of triangles about its first corner
+			if (valid)
+				for (size_t corner = 2; corner < face.size(); corner++)
+					{ // per triangle
+					triangles.push_back(face[0]);
+					triangles.push_back(face[corner - 1]);
+					triangles.push_back(face[corner]);
+					} // per triangle
+			} // face
+		} // per line
+
+	// lay the vertices out as the skinning reads them
+	vertexCount = (long) vertexPosition.size();
+	bindPositions.assign(4 * vertexCount, 0.0f);
+	bindNormals.assign(4 * vertexCount, 0.0f);
+	bool missingNormals = false;
+	for (long vertex = 0; vertex < vertexCount; vertex++)
+		{ // per vertex
+		for (int coordinate = 0; coordinate < 3; coordinate++)
+			bindPositions[4 * vertex + coordinate] = filePositions[3 * vertexPosition[vertex] + coordinate];
+		bindPositions[4 * vertex + 3] = 1.0f;
+		if (vertexNormal[vertex] != -1)
+			for (int coordinate = 0; coordinate < 3; coordinate++)
+				bindNormals[4 * vertex + coordinate] = fileNormals[3 * vertexNormal[vertex] + coordinate];
+		else
+			missingNormals = true;
+		} // per vertex
+
+	// vertices the file gave no normal get the sum of their triangles' normals, each weighted by
+	// its area (which the length of the cross product already is)
+	if (missingNormals)
+		{ // work out normals
+		for (size_t triangle = 0; triangle < triangles.size(); triangle += 3)
+			{ // per triangle
+			const float *p = &bindPositions[4 * triangles[triangle]];
+			const float *q = &bindPositions[4 * triangles[triangle + 1]];
+			const float *r = &bindPositions[4 * triangles[triangle + 2]];
+			Cartesian3 normal = Cartesian3(q[0] - p[0], q[1] - p[1], q[2] - p[2]).cross(Cartesian3(r[0] - p[0], r[1] - p[1], r[2] - p[2]));
+			for (int corner = 0; corner < 3; corner++)
+				if (vertexNormal[triangles[triangle + corner]] == -1)
+					{ // no normal given
+					float *out = &bindNormals[4 * triangles[triangle + corner]];
+					out[0] += normal.x;	out[1] += normal.y;	out[2] += normal.z;
+					} // no normal given
+			} // per triangle
+		for (long vertex = 0; vertex < vertexCount; vertex++)
+			if (vertexNormal[vertex] == -1)
+				{ // no normal given
+				float *normal = &bindNormals[4 * vertex];
+				float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+				if (length > 0.0f)
+					for (int coordinate = 0; coordinate < 3; coordinate++)
+						normal[coordinate] /= length;
+				} // no normal given
+		} // work out normals
+
+	// a new mesh has to be bound again, and its triangles sent to OpenGL
+	skeleton = NULL;
+	influenceJoints.clear();
+	influenceWeights.clear();
+	jointMaps.clear();
+	indicesUploaded = false;
+	ClearPoses();
+	return !triangles.empty();
+	} // ReadFileOBJ()
+
+// the distance from a point to the segment from start to end
+static float SegmentDistance(const Cartesian3 &point, const Cartesian3 &start, const Cartesian3 &end)
+	{ // SegmentDistance()
+	Cartesian3 along = end - start;
+	float lengthSquared = along.dot(along);
+	float t = (lengthSquared > 0.0f) ? (point - start).dot(along) / lengthSquared : 0.0f;
+	t = std::min(std::max(t, 0.0f), 1.0f);
+	return (point - (start + along * t)).length();
+	} // SegmentDistance()
+
+// bind the mesh to the skeleton's rest pose, and weight each vertex to the nearest bones
+void SkinnedMesh::Bind(BVHData& Skeleton, float scale)
+	{ // Bind()
+	skeleton = &Skeleton;
+	meshScale = scale;
+	jointMaps.clear();
+	ClearPoses();
+	long nJoints = (long) skeleton->all_joints.size();
+
+	// the rest pose as EvaluatePose() will scale it, whose joints are only rotated and translated,
+	// so each inverse is the transposed rotation and the translation undone; the mesh itself is
+	// in the file's units, so it is scaled first
+	std::vector<Cartesian3> restRotations(nJoints, Cartesian3(0, 0, 0));
+	std::vector<Matrix4> restTransforms;
+	skeleton->EvaluatePose(restRotations, Matrix4::Identity(), scale, restTransforms);
+	inverseBindTransforms.assign(nJoints, Matrix4::Identity());
+	for (long joint = 0; joint < nJoints; joint++)
+		{ // per joint
+		const Matrix4 &rest = restTransforms[joint];
+		Matrix4 &inverse = inverseBindTransforms[joint];
+		for (int row = 0; row < 3; row++)
+			{ // per row
+			for (int column = 0; column < 3; column++)
+				inverse.coordinates[row][column] = rest.coordinates[column][row] * scale;
+			inverse.coordinates[row][3] = -(rest.coordinates[0][row] * rest.coordinates[0][3]
+				+ rest.coordinates[1][row] * rest.coordinates[1][3] + rest.coordinates[2][row] * rest.coordinates[2][3]);
+			} // per row
+		} // per joint
+
+	// the bones in the file's units: each joint moves the bones to its children, and a joint with no
+	// children moves the vertices round its own position
+	skeleton->EvaluatePose(restRotations, Matrix4::Identity(), 1.0f, restTransforms);
+	std::vector<Cartesian3> jointPositions(nJoints);
+	std::vector<bool> hasChildren(nJoints, false);
+	for (long joint = 0; joint < nJoints; joint++)
+		{ // per joint
+		jointPositions[joint] = restTransforms[joint] * Cartesian3(0, 0, 0);
+		if (skeleton->parentBones[joint] != -1)
+			hasChildren[skeleton->parentBones[joint]] = true;
+		} // per joint
+
+	// a distance too small to matter, so that a vertex on a bone does not divide by zero
+	Cartesian3 lowest = jointPositions[0], highest = jointPositions[0];
+	for (long joint = 1; joint < nJoints; joint++)
+		for (int axis = 0; axis < 3; axis++)
+			{ // per axis
+			lowest[axis] = std::min(lowest[axis], jointPositions[joint][axis]);
+			highest[axis] = std::max(highest[axis], jointPositions[joint][axis]);
+			} // per axis
+	float nearest = std::max(1E-4f * (highest - lowest).length(), 1E-6f);
+
+	// each vertex follows its nearest joints, by the inverse fourth power of the distance, so that
+	// it follows its own bone almost entirely, but blends where bones meet
+	influenceJoints.assign(MAX_INFLUENCES * vertexCount, 0);
+	influenceWeights.assign(MAX_INFLUENCES * vertexCount, 0.0f);
+	ParallelFor(vertexCount, skinBlock, [&](long begin, long end)
+		{ // weight
+		std::vector<float> distance(nJoints);
+		for (long vertex = begin; vertex < end; vertex++)
+			{ // per vertex
+			Cartesian3 point(bindPositions[4 * vertex], bindPositions[4 * vertex + 1], bindPositions[4 * vertex + 2]);
+			for (long joint = 0; joint < nJoints; joint++)
+				distance[joint] = hasChildren[joint] ? std::numeric_limits<float>::max() : (point - jointPositions[joint]).length();
+			for (long joint = 0; joint < nJoints; joint++)
+				{ // per bone
+				int parent = skeleton->parentBones[joint];
+				if (parent != -1)
+					distance[parent] = std::min(distance[parent], SegmentDistance(point, jointPositions[parent], jointPositions[joint]));
+				} // per bone
+
+			// pick the nearest few, nearest first
+			int *joints = &influenceJoints[MAX_INFLUENCES * vertex];
+			float *weights = &influenceWeights[MAX_INFLUENCES * vertex];
+			float total = 0.0f;
+			for (int influence = 0; influence < MAX_INFLUENCES && influence < nJoints; influence++)
+				{ // per influence
+				long best = -1;
+				for (long joint = 0; joint < nJoints; joint++)
+					if ((best == -1 || distance[joint] < distance[best]) && std::find(joints, joints + influence, (int) joint) == joints + influence)
+						best = joint;
+				float d = std::max(distance[best], nearest);
+				joints[influence] = (int) best;
+				weights[influence] = 1.0f / (d * d * d * d);
+				total += weights[influence];
+				} // per influence
+
+			// drop the ones that barely count, and make the rest sum to one
+			float kept = 0.0f;
+			for (int influence = 0; influence < MAX_INFLUENCES; influence++)
+				{ // per influence
+				weights[influence] /= total;
+				if (weights[influence] < smallestWeight)
+					weights[influence] = 0.0f;
+				kept += weights[influence];
+				} // per influence
+			for (int influence = 0; influence < MAX_INFLUENCES; influence++)
+				weights[influence] /= kept;
+			} // per vertex
+		}); // weight
+	} // Bind()
+
+// for each joint of the bound skeleton, the joint of another clip that drives it
+const std::vector<int>& SkinnedMesh::JointMap(BVHData* clip)
+	{ // JointMap()
+	for (size_t map = 0; map < jointMaps.size(); map++)
+		if (jointMaps[map].first == clip)
+			return jointMaps[map].second;
+
+	// match by name, as blending does; a joint with no partner moves as its parent does
+	Retarget retarget;
+	retarget.Build(*skeleton, *clip);
+	std::vector<int> map(skeleton->all_joints.size());
+	for (size_t joint = 0; joint < map.size(); joint++)
+		{ // per joint
+		int parent = skeleton->parentBones[joint];
+		map[joint] = retarget.sourceJoint[joint];
+		if (map[joint] == -1)
+			map[joint] = (parent == -1) ? 0 : map[parent];
+		} // per joint
+	jointMaps.push_back(std::make_pair(clip, map));
+	return jointMaps.back().second;
+	} // JointMap()
+
+// the unit dual quaternion for a matrix that only rotates, scales by the given factor, and translates:
+// four floats of rotation (x, y, z, w), then four of translation
+static void DualQuaternion(const Matrix4 &matrix, float scale, float *out)
+	{ // DualQuaternion()
+	// the rotation, found from whichever of w, x, y and z is largest, so as not to divide by a small one
+	const float (*m)[4] = matrix.coordinates;
+	float inverse = 1.0f / scale;
+	float m00 = m[0][0] * inverse, m01 = m[0][1] * inverse, m02 = m[0][2] * inverse;
+	float m10 = m[1][0] * inverse, m11 = m[1][1] * inverse, m12 = m[1][2] * inverse;
+	float m20 = m[2][0] * inverse, m21 = m[2][1] * inverse, m22 = m[2][2] * inverse;
+	float trace = m00 + m11 + m22;
+	float x, y, z, w;
+	if (trace > 0.0f)
+		{ // w largest
+		float s = 2.0f * sqrtf(trace + 1.0f);
+		w = 0.25f * s;	x = (m21 - m12) / s;	y = (m02 - m20) / s;	z = (m10 - m01) / s;
+		} // w largest
+	else if (m00 > m11 && m00 > m22)
+		{ // x largest
+		float s = 2.0f * sqrtf(1.0f + m00 - m11 - m22);
+		w = (m21 - m12) / s;	x = 0.25f * s;	y = (m01 + m10) / s;	z = (m02 + m20) / s;
+		} // x largest
+	else if (m11 > m22)
+		{ // y largest
+		float s = 2.0f * sqrtf(1.0f + m11 - m00 - m22);
+		w = (m02 - m20) / s;	x = (m01 + m10) / s;	y = 0.25f * s;	z = (m12 + m21) / s;
+		} // y largest
+	else
+		{ // z largest
+		float s = 2.0f * sqrtf(1.0f + m22 - m00 - m11);
+		w = (m10 - m01) / s;	x = (m02 + m20) / s;	y = (m12 + m21) / s;	z = 0.25f * s;
+		} // z largest
+	float length = sqrtf(x * x + y * y + z * z + w * w);
+	x /= length;	y /= length;	z /= length;	w /= length;
+
+	// and the translation part is half the translation, as a quaternion, times the rotation
+	float tx = m[0][3], ty = m[1][3], tz = m[2][3];
+	out[0] = x;	out[1] = y;	out[2] = z;	out[3] = w;
+	out[4] = 0.5f * (w * tx + ty * z - tz * y);
+	out[5] = 0.5f * (w * ty + tz * x - tx * z);
+	out[6] = 0.5f * (w * tz + tx * y - ty * x);
+	out[7] = -0.5f * (tx * x + ty * y + tz * z);
+	} // DualQuaternion()
+
+// queue a pose
+void SkinnedMesh::AddPose(BVHData* clip, const std::vector<Matrix4>& jointTransforms, const Matrix4& placement, int skinning)
+	{ // AddPose()
+	if (!Bound() || clip == NULL || jointTransforms.size() != clip->all_joints.size())
+		return;
+	const std::vector<int> &map = JointMap(clip);
+
+	// each joint's matrix takes a vertex from the rest pose into the joint's coordinates,
+	// then out again as the pose has moved the joint, then to where the pose is placed
+	size_t nJoints = inverseBindTransforms.size();
+	std::vector<float> &transforms = (skinning == DUAL_QUATERNION) ? skinDualQuaternions : skinMatrices;
+	size_t first = transforms.size();
+	poseSkinning.push_back(skinning == DUAL_QUATERNION ? DUAL_QUATERNION : LINEAR_BLEND);
+	poseTransforms.push_back((long) first);
+	if (skinning == DUAL_QUATERNION)
+		{ // dual quaternions
+		transforms.resize(first + 8 * nJoints);
+		for (size_t joint = 0; joint < nJoints; joint++)
+			DualQuaternion(placement * jointTransforms[map[joint]] * inverseBindTransforms[joint], meshScale, &transforms[first + 8 * joint]);
+		} // dual quaternions
+	else
+		{ // matrices
+		transforms.resize(first + 16 * nJoints);
+		for (size_t joint = 0; joint < nJoints; joint++)
+			{ // per joint
+			columnMajorMatrix skin = (placement * jointTransforms[map[joint]] * inverseBindTransforms[joint]).columnMajor();
+			memcpy(&transforms[first + 16 * joint], skin.coordinates, sizeof(skin.coordinates));
+			} // per joint
+		} // matrices
+	posesQueued++;
+	} // AddPose()
+
+// skin vertices [begin, end) of one pose by blending matrices
+void SkinnedMesh::SkinLinearBlend(long pose, long begin, long end)
+	{ // SkinLinearBlend()
+	const float *matrices = &skinMatrices[poseTransforms[pose]];
+	float *out = &skinnedVertices[8 * (pose * vertexCount + begin)];
+	const float *position = &bindPositions[4 * begin];
+	const float *normal = &bindNormals[4 * begin];
+	const int *joints = &influenceJoints[MAX_INFLUENCES * begin];
+	const float *weights = &influenceWeights[MAX_INFLUENCES * begin];
+	for (long vertex = begin; vertex < end; vertex++, out += 8, position += 4, normal += 4, joints += MAX_INFLUENCES, weights += MAX_INFLUENCES)
+		{ // per vertex
+#ifdef SKINNED_MESH_SSE2
+		// blend the columns of the matrices, a column to a register
+		__m128 columns[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+		for (int influence = 0; influence < MAX_INFLUENCES; influence++)
+			{ // per influence
+			const float *matrix = matrices + 16 * joints[influence];
+			__m128 weight = _mm_set1_ps(weights[influence]);
+			for (int column = 0; column < 4; column++)
+				columns[column] = _mm_add_ps(columns[column], _mm_mul_ps(weight, _mm_loadu_ps(matrix + 4 * column)));
+			} // per influence
+
+		// then transform the position and the normal by the blended matrix
+		__m128 skinned = _mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(position[0])), _mm_mul_ps(columns[1], _mm_set1_ps(position[1]))),
+			_mm_add_ps(_mm_mul_ps(columns[2], _mm_set1_ps(position[2])), columns[3]));
+		_mm_storeu_ps(out, skinned);
+		skinned = _mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(normal[0])), _mm_mul_ps(columns[1], _mm_set1_ps(normal[1]))),
+			_mm_mul_ps(columns[2], _mm_set1_ps(normal[2])));
+		_mm_storeu_ps(out + 4, skinned);
+#else
+		float columns[16] = { 0.0f };
+		for (int influence = 0; influence < MAX_INFLUENCES; influence++)
+			{ // per influence
+			const float *matrix = matrices + 16 * joints[influence];
+			for (int element = 0; element < 16; element++)
+				columns[element] += weights[influence] * matrix[element];
+			} // per influence
+		for (int row = 0; row < 4; row++)
+			{ // per row
+			out[row] = columns[row] * position[0] + columns[4 + row] * position[1] + columns[8 + row] * position[2] + columns[12 + row];
+			out[4 + row] = columns[row] * normal[0] + columns[4 + row] * normal[1] + columns[8 + row] * normal[2];
+			} // per row
+#endif
+		} // per vertex
+	} // SkinLinearBlend()
+
+#ifdef SKINNED_MESH_SSE2
+// the cross product of the first three lanes of two vectors (the last lane comes out zero)
+static inline __m128 Cross(__m128 a, __m128 b)
+	{ // Cross()
+	__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 difference = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(difference, difference, _MM_SHUFFLE(3, 0, 2, 1));
+	} // Cross()
+#endif
+
+// skin vertices [begin, end) of one pose by blending dual quaternions
+void SkinnedMesh::SkinDualQuaternion(long pose, long begin, long end)
+	{ // SkinDualQuaternion()
+	const float *quaternions = &skinDualQuaternions[poseTransforms[pose]];
+	float *out = &skinnedVertices[8 * (pose * vertexCount + begin)];
+	const float *position = &bindPositions[4 * begin];
+	const float *normal = &bindNormals[4 * begin];
+	const int *joints = &influenceJoints[MAX_INFLUENCES * begin];
+	const float *weights = &influenceWeights[MAX_INFLUENCES * begin];
+#ifdef SKINNED_MESH_SSE2
+	const __m128 scale = _mm_set_ps(1.0f, meshScale, meshScale, meshScale), one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+#endif
+	for (long vertex = begin; vertex < end; vertex++, out += 8, position += 4, normal += 4, joints += MAX_INFLUENCES, weights += MAX_INFLUENCES)
+		{ // per vertex
+		// q and -q are the same rotation, so each joint's is taken on the same side as the first
+		// joint's, or the blend would go the long way round
+		const float *first = quaternions + 8 * joints[0];
+		float signedWeights[MAX_INFLUENCES];
+		for (int influence = 0; influence < MAX_INFLUENCES; influence++)
+			{ // per influence
+			const float *quaternion = quaternions + 8 * joints[influence];
+			float dot = first[0] * quaternion[0] + first[1] * quaternion[1] + first[2] * quaternion[2] + first[3] * quaternion[3];
+			signedWeights[influence] = (dot < 0.0f) ? -weights[influence] : weights[influence];
+			} // per influence
+#ifdef SKINNED_MESH_SSE2
+		// blend the rotation and translation parts, a register each
+		__m128 rotation = _mm_setzero_ps(), translation = _mm_setzero_ps();
+		for (int influence = 0; influence < MAX_INFLUENCES; influence++)
+			{ // per influence
+			const float *quaternion = quaternions + 8 * joints[influence];
+			__m128 weight = _mm_set1_ps(signedWeights[influence]);
+			rotation = _mm_add_ps(rotation, _mm_mul_ps(weight, _mm_loadu_ps(quaternion)));
+			translation = _mm_add_ps(translation, _mm_mul_ps(weight, _mm_loadu_ps(quaternion + 4)));
+			} // per influence
+
+		// the blend is no longer unit length, so is divided by the length of its rotation part
+		__m128 square = _mm_mul_ps(rotation, rotation);
+		square = _mm_add_ps(square, _mm_shuffle_ps(square, square, _MM_SHUFFLE(2, 3, 0, 1)));
+		square = _mm_add_ps(square, _mm_shuffle_ps(square, square, _MM_SHUFFLE(1, 0, 3, 2)));
+		__m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(square));
+		rotation = _mm_mul_ps(rotation, inverseLength);
+		translation = _mm_mul_ps(translation, inverseLength);
+
+		// rotate by v, w: p + 2 v x (v x p + w p), then translate by 2 (w t - s v + v x t),
+		// where t, s is the translation part; the last lanes work out as 1 for positions, 0 for normals
+		__m128 w = _mm_shuffle_ps(rotation, rotation, _MM_SHUFFLE(3, 3, 3, 3));
+		__m128 s = _mm_shuffle_ps(translation, translation, _MM_SHUFFLE(3, 3, 3, 3));
+		__m128 moved = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(w, translation), _mm_mul_ps(s, rotation)), Cross(rotation, translation));
+		__m128 point = _mm_mul_ps(_mm_loadu_ps(position), scale);
+		__m128 skinned = _mm_add_ps(point, _mm_mul_ps(two, _mm_add_ps(Cross(rotation, _mm_add_ps(Cross(rotation, point), _mm_mul_ps(w, point))), moved)));
+		_mm_storeu_ps(out, skinned);
+		__m128 direction = _mm_loadu_ps(normal);
+		skinned = _mm_add_ps(direction, _mm_mul_ps(two, Cross(rotation, _mm_add_ps(Cross(rotation, direction), _mm_mul_ps(w, direction)))));
+		_mm_storeu_ps(out + 4, skinned);
+#else
+		float blend[8] = { 0.0f };
+		for (int influence = 0; influence < MAX_INFLUENCES; influence++)
+			{ // per influence
+			const float *quaternion = quaternions + 8 * joints[influence];
+			for (int element = 0; element < 8; element++)
+				blend[element] += signedWeights[influence] * quaternion[element];
+			} // per influence
+		float inverseLength = 1.0f / sqrtf(blend[0] * blend[0] + blend[1] * blend[1] + blend[2] * blend[2] + blend[3] * blend[3]);
+		for (int element = 0; element < 8; element++)
+			blend[element] *= inverseLength;
+		Cartesian3 v(blend[0], blend[1], blend[2]), t(blend[4], blend[5], blend[6]);
+		float w = blend[3], s = blend[7];
+		Cartesian3 moved = t * w - v * s + v.cross(t);
+		Cartesian3 point = Cartesian3(position[0], position[1], position[2]) * meshScale;
+		Cartesian3 direction(normal[0], normal[1], normal[2]);
+		Cartesian3 skinned = point + (v.cross(v.cross(point) + point * w) + moved) * 2.0f;
+		Cartesian3 turned = direction + v.cross(v.cross(direction) + direction * w) * 2.0f;
+		out[0] = skinned.x;	out[1] = skinned.y;	out[2] = skinned.z;	out[3] = 1.0f;
+		out[4] = turned.x;	out[5] = turned.y;	out[6] = turned.z;	out[7] = 0.0f;
+#endif
+		} // per vertex
+	} // SkinDualQuaternion()
+
+// skin the mesh for every queued pose
+void SkinnedMesh::Skin()
+	{ // Skin()
+	ScopedPhase timer(PHASE_SKIN);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	posesSkinned = Bound() ? posesQueued : 0;
+	skinnedVertices.resize(8 * vertexCount * posesSkinned);
+
+	// every block of every pose is one piece of work, so one character or many spread alike
+	long blocks = (vertexCount + skinBlock - 1) / skinBlock;
+	ParallelFor(posesSkinned * blocks, 1, [this, blocks](long begin, long end)
+		{ // skin
+		for (long piece = begin; piece < end; piece++)
+			{ // per piece
+			long pose = piece / blocks, first = (piece % blocks) * skinBlock;
+			if (poseSkinning[pose] == DUAL_QUATERNION)
+				SkinDualQuaternion(pose, first, std::min(first + skinBlock, vertexCount));
+			else
+				SkinLinearBlend(pose, first, std::min(first + skinBlock, vertexCount));
+			} // per piece
+		}); // skin
+
+	verticesSkinned = vertexCount * posesSkinned;
+	skinSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} // Skin()
+
+// draw every pose Skin() skinned, and empty the queue
+void SkinnedMesh::Draw(const Matrix4& viewMatrix)
+	{ // Draw()
+	drawCalls = 0;
+	if (posesSkinned == 0)
+		{ // nothing to draw
+		ClearPoses();
+		return;
+		} // nothing to draw
+
+	// point at buffer objects, or at our own copies if there aren't any
+	const char *base = (const char *) skinnedVertices.data();
+	const char *indices = (const char *) triangles.data();
+#ifdef GL_SUPPORT_BUFFERS
+	if (GLSupport::HasBuffers())
+		{ // buffer objects
+		if (vertexBuffer == 0)
+			{ // first time
+			glGenBuffers(1, &vertexBuffer);
+			glGenBuffers(1, &indexBuffer);
+			} // first time
+		// the triangles are the same every frame, so are only sent when they change
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		if (!indicesUploaded)
+			{ // send the triangles
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangles.size() * sizeof(unsigned int), triangles.data(), GL_STATIC_DRAW);
+			indicesUploaded = true;
+			} // send the triangles
+		// fresh storage every frame for the vertices, as BoneRenderer streams its batch
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, skinnedVertices.size() * sizeof(float), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, skinnedVertices.size() * sizeof(float), skinnedVertices.data());
+		base = NULL;
+		indices = NULL;
+		} // buffer objects
+#endif
+
+	// the vertices are already placed in the world, so the view matrix is all OpenGL needs;
+	// skinning leaves the normals scaled, and the mesh is smooth, unlike the bones
+	glPushAttrib(GL_ENABLE_BIT | GL_LIGHTING_BIT);
+	glEnable(GL_NORMALIZE);
+	glShadeModel(GL_SMOOTH);
+	columnMajorMatrix modelview = viewMatrix.columnMajor();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glMultMatrixf(modelview.coordinates);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+
+	// each pose is a copy of the mesh's vertices, so is drawn with the same triangles from its own start
+	for (long pose = 0; pose < posesSkinned; pose++)
+		{ // per pose
+		const char *vertices = base + pose * vertexCount * 8 * sizeof(float);
+		glVertexPointer(3, GL_FLOAT, 8 * sizeof(float), vertices);
+		glNormalPointer(GL_FLOAT, 8 * sizeof(float), vertices + 4 * sizeof(float));
+		glDrawElements(GL_TRIANGLES, triangles.size(), GL_UNSIGNED_INT, indices);
+		drawCalls++;
+		} // per pose
+
+	// then put everything back the way we found it
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glPopMatrix();
+	glPopAttrib();
+#ifdef GL_SUPPORT_BUFFERS
+	if (vertexBuffer != 0)
+		{ // buffer objects
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		} // buffer objects
+#endif
+	ClearPoses();
+	} // Draw()
+
+// empty the queue without drawing
+void SkinnedMesh::ClearPoses()
+	{ // ClearPoses()
+	skinMatrices.clear();
+	skinDualQuaternions.clear();
+	poseSkinning.clear();
+	poseTransforms.clear();
+	posesQueued = 0;
+	posesSkinned = 0;
+	} // ClearPoses()
+
+// free the OpenGL buffers
+void SkinnedMesh::ReleaseBuffers()
+	{ // ReleaseBuffers()
+#ifdef GL_SUPPORT_BUFFERS
+	if (vertexBuffer != 0)
+		glDeleteBuffers(1, &vertexBuffer);
+	if (indexBuffer != 0)
+		glDeleteBuffers(1, &indexBuffer);
+#endif
+	vertexBuffer = indexBuffer = 0;
+	indicesUploaded = false;
+	} // ReleaseBuffers()
@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	SkinnedMesh.h
+//	------------------------
+//
+//	A character's surface, read from an OBJ file and bound
+//	to a BVH skeleton, so that it can be drawn in place of
+//	the bones. Each vertex follows up to four joints, with
+//	weights that sum to one; OBJ has no way to carry them,
+//	so Bind() works them out from how near each vertex lies
+//	to each bone in the skeleton's rest pose.
+//
+//	Poses are queued with AddPose(), which turns the pose's
+//	joint transforms into one skinning transform per joint.
+//	Skin() then blends those transforms for every vertex of
+//	every queued pose, a block of vertices at a time on all
+//	the hardware threads, into one vertex array that is
+//	reused from frame to frame.
+//
+//	Each pose is skinned in one of two ways. LINEAR_BLEND
+//	blends the joints' matrices, which is cheap, but where
+//	the joints turn far apart the blend is no longer a
+//	rotation, and elbows and shoulders collapse inwards.
+//	DUAL_QUATERNION turns each joint's transform into a
+//	dual quaternion, once per pose, and blends those, which
+//	always gives a rotation and a translation, so the joint
+//	keeps its volume, for a little more work per vertex.
+//
+//	Draw() streams that array to OpenGL and draws each pose
+//	with one call. Skin() makes no GL calls, so tools with
+//	no context can measure it.
+//
+//	The OBJ is expected in the same units and axes as the
+//	BVH file, standing in the skeleton's rest pose (every
+//	rotation zero).
+//
+///////////////////////////////////////////////////
+
+#ifndef _SKINNED_MESH_H
+#define _SKINNED_MESH_H
+
+#include <utility>
+#include <vector>
+
+#include "BVHData.h"
+#include "Matrix4.h"
+
+class SkinnedMesh
+	{ // class SkinnedMesh
+	public:
+	// the most joints a vertex follows
+	static const int MAX_INFLUENCES = 4;
+
+	// how a pose is skinned
+	enum { LINEAR_BLEND, DUAL_QUATERNION };
+
+	// the mesh as read: four floats each of position and normal per vertex, the last unused,
+	// so that the skinning reads whole vectors
+	std::vector<float> bindPositions;
+	std::vector<float> bindNormals;
+	long vertexCount;
+
+	// three vertex indices per triangle
+	std::vector<unsigned int> triangles;
+
+	// the joints each vertex follows and how far it follows each, MAX_INFLUENCES per vertex
+	// (unused influences have a weight of zero)
+	std::vector<int> influenceJoints;
+	std::vector<float> influenceWeights;
+
+	// the skeleton Bind() bound to, the scale it gave the mesh, and for each of the skeleton's
+	// joints the inverse of its rest pose transform, with that scale folded in
+	BVHData* skeleton;
+	float meshScale;
+	std::vector<Matrix4> inverseBindTransforms;
+
+	// the queued poses, each skinned by the method in poseSkinning, from its joints' transforms
+	// starting at poseTransforms in one of:
+	// sixteen floats per joint for LINEAR_BLEND, the column-major matrix that takes a vertex
+	// from the rest pose to where the pose puts it
+	std::vector<float> skinMatrices;
+	// eight per joint for DUAL_QUATERNION, the rotation then the translation part of the unit
+	// dual quaternion that does the same to the vertex once it has been scaled
+	std::vector<float> skinDualQuaternions;
+	std::vector<int> poseSkinning;
+	std::vector<long> poseTransforms;
+	long posesQueued;
+
+	// what Skin() produced: for each queued pose in turn, four floats of position then four of normal
+	// per vertex (the normals are not unit length, so Draw() has OpenGL normalise them)
+	std::vector<float> skinnedVertices;
+	long posesSkinned;
+
+	// what the last Skin() did, and the last Draw()
+	long verticesSkinned;
+	double skinSeconds;
+	long drawCalls;
+
+	// the OpenGL objects, created the first time Draw() needs them, and whether the triangles
+	// have been sent since they were read
+	unsigned int vertexBuffer, indexBuffer;
+	bool indicesUploaded;
+
+	// constructor will initialise to safe values
+	SkinnedMesh();
+
+	// read vertices, normals and faces from an OBJ file: polygons are split into triangles, and
+	// normals are worked out if the file has none. Returns false if nothing could be read
+	bool ReadFileOBJ(const char *fileName);
+
+	// bind the mesh to the skeleton's rest pose, scaled as EvaluatePose() scales it, and weight
+	// each vertex to the joints whose bones it lies nearest
+	void Bind(BVHData& skeleton, float scale);
+
+	// true once there is a mesh bound to a skeleton
+	bool Bound() const { return skeleton != NULL && vertexCount > 0; }
+
+	// queue a pose, to be skinned by the given method: jointTransforms as clip's EvaluatePose()
+	// computed them, and placement taking the pose's coordinates to the world's (which must only
+	// rotate and translate). The clip need not be the skeleton the mesh is bound to, so long as
+	// its joints have the same names
+	void AddPose(BVHData* clip, const std::vector<Matrix4>& jointTransforms, const Matrix4& placement, int skinning = LINEAR_BLEND);
+
+	// skin the mesh for every queued pose into skinnedVertices
+	void Skin();
+
+	// draw every pose Skin() skinned, with the given view matrix, and empty the queue
+	// (there must be a current context)
+	void Draw(const Matrix4& viewMatrix);
+
+	// empty the queue without drawing
+	void ClearPoses();
+
+	// free the OpenGL buffers while the context they were made in is still current: the next
+	// Draw() creates them again
+	void ReleaseBuffers();
+
+	// vertices the last Skin() skinned per second
+	double VerticesPerSecond() const { return skinSeconds > 0.0 ? verticesSkinned / skinSeconds : 0.0; }
+
+	private:
+	// for each joint of the bound skeleton, the joint of another clip that drives it, built the
+	// first time a pose from that clip is queued
+	std::vector<std::pair<BVHData*, std::vector<int> > > jointMaps;
+	const std::vector<int>& JointMap(BVHData* clip);
+
+	// skin vertices [begin, end) of one pose, by each method
+	void SkinLinearBlend(long pose, long begin, long end);
+	void SkinDualQuaternion(long pose, long begin, long end);
+	}; // class SkinnedMesh
+
+#endif
@@ -16,55 +16,274 @@
 //	
 ///////////////////////////////////////////////////
 
+#include "GLSupport.h"
 #include <iostream>
 #include <fstream>
+#include <string>
 #include <numeric>
+#include <algorithm>
+#include <cstddef>
 #include <math.h>
 
 #include "Terrain.h"
+#include "TerrainTileStore.h"
+#include "ParallelFor.h"
+#include "FrameProfiler.h"
+
+// the batched height queries use whichever vector instructions the compiler has been allowed
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TERRAIN_QUERY_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TERRAIN_QUERY_SSE2
+#endif
 
 // constructor will initialise to safe values
 Terrain::Terrain()
 	:  
 	HomogeneousFaceSurface(),
-	xyScale(1)
+	nRows(0),
+	nColumns(0),
+	heights(NULL),
+	xyScale(1),
+	meshMode(SOUP_MESH),
+	gridVertexBuffer(0),
+	gridIndexBuffer(0),
+	gridIndexCount(0),
+	gridDirty(true),
+	smoothNormals(false),
+	chunkSize(32),
+	chunksTested(0),
+	chunksCulled(0),
+	chunksDrawn(0),
+	maxPixelError(2.0f),
+	chunkColumns(0),
+	chunkRows(0),
+	tileStore(NULL),
+	frameIndexBuffer(0),
+	trianglesDrawn(0)
 	{ // constructor
 	// terrain vector will default to empty
 	// so no additional work required here
 	} // constructor
 
-// read routine returns true on success, failure otherwise
-// xyScale gives the scale factor to use in the x-y directions
-bool Terrain::ReadFileTerrainData(const char *fileName, float XYScale)
-	{ // ReadFileTerrainData()
+// text is read a piece of about this many bytes at a time, each piece on one thread
+static const long textPieceBytes = 4L << 20;
+
+// read the lines of a text file that start in [start, end), where the first line starts at dataStart
+static void ReadTextPiece(std::ifstream &inFile, std::streamoff start, std::streamoff end, std::streamoff dataStart, std::string &text)
+	{ // ReadTextPiece()
+	// read from one byte early, to see whether a line starts at start
+	std::streamoff from = std::max(start - 1, dataStart);
+	text.resize(end - from);
+	inFile.clear();
+	inFile.seekg(from);
+	inFile.read(&text[0], text.size());
+	text.resize(inFile.gcount());
+
+	// a line that started in the piece before belongs to it
+	size_t skip = 0;
+	if (start > dataStart)
+		{ // not the first piece
+		size_t newline = text.find('\n');
+		skip = (newline == std::string::npos) ? text.size() : newline + 1;
+		} // not the first piece
+	text.erase(0, skip);
+
+	// and the last line carries on past end until it finishes
+	if (!text.empty() && text[text.size() - 1] != '\n')
+		{ // unfinished line
+		std::string rest;
+		std::getline(inFile, rest);
+		text += rest;
+		} // unfinished line
+	} // ReadTextPiece()
+
+// true for the characters that separate values in a .dem file
+static inline bool IsSpace(char c)
+	{ // IsSpace()
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+	} // IsSpace()
+
+// how many values there are in some text
+static long CountTextValues(const char *text, const char *end)
+	{ // CountTextValues()
+	long count = 0;
+	bool inValue = false;
+	for (; text < end; text++)
+		{ // per character
+		bool space = IsSpace(*text);
+		count += (!space && !inValue);
+		inValue = !space;
+		} // per character
+	return count;
+	} // CountTextValues()
+
+// parse up to count values from some text: a number written as C would, with an optional sign,
+// fraction and exponent. Unlike strtof(), this ignores the locale Qt may have set
+static void ParseTextValues(const char *text, const char *end, float *values, long count)
+	{ // ParseTextValues()
+	// powers of ten that doubles hold exactly, so that one division or multiplication rounds once
+	static const double powersOfTen[23] = { 1E0, 1E1, 1E2, 1E3, 1E4, 1E5, 1E6, 1E7, 1E8, 1E9, 1E10, 1E11,
+		1E12, 1E13, 1E14, 1E15, 1E16, 1E17, 1E18, 1E19, 1E20, 1E21, 1E22 };
+	for (long value = 0; value < count; value++)
+		{ // per value
+		while (text < end && IsSpace(*text))
+			text++;
+		if (text >= end)
+			return;
+
+		bool negative = (*text == '-');
+		if (*text == '-' || *text == '+')
+			text++;
+
+		// up to 19 significant digits, then count the rest only as a power of ten
+		unsigned long long digits = 0;
+		int nDigits = 0, exponent = 0;
+		for (; text < end && *text >= '0' && *text <= '9'; text++)
+			if (nDigits < 19)
+				digits = 10 * digits + (*text - '0'), nDigits += (digits != 0);
+			else
+				exponent++;
+		if (text < end && *text == '.')
+			for (text++; text < end && *text >= '0' && *text <= '9'; text++)
+				if (nDigits < 19)
+					digits = 10 * digits + (*text - '0'), nDigits += (digits != 0), exponent--;
+		if (text < end && (*text == 'e' || *text == 'E'))
+			{ // exponent
+			text++;
+			bool negativeExponent = (text < end && *text == '-');
+			if (text < end && (*text == '-' || *text == '+'))
+				text++;
+			int written = 0;
+			for (; text < end && *text >= '0' && *text <= '9'; text++)
+				written = std::min(10 * written + (*text - '0'), 1000);
+			exponent += negativeExponent ? -written : written;
+			} // exponent
+
+		double result = (double) digits;
+		if (exponent < 0)
+			result = (exponent >= -22) ? result / powersOfTen[-exponent] : result * pow(10.0, exponent);
+		else if (exponent > 0)
+			result = (exponent <= 22) ? result * powersOfTen[exponent] : result * pow(10.0, exponent);
+		values[value] = (float) (negative ? -result : result);
+
+		// anything else in the value is not a number we know how to read
+		while (text < end && !IsSpace(*text))
+			text++;
+		} // per value
+	} // ParseTextValues()
+
+// read only the heights, from a .dem text file or a binary heightfield, without building a mesh
+bool Terrain::ReadHeights(const char *fileName, float XYScale)
+	{ // ReadHeights()
+	// forget any heights we had
+	heightFile.Close();
+	heightValues.clear();
+	heights = NULL;
+	heightPyramid.clear();
+	nRows = nColumns = 0;
+
+	// save the xy scale
+	xyScale = XYScale;
+
+	// a binary file is mapped rather than read
+	if (BinaryDEM::IsBinary(fileName))
+		{ // binary
+		if (!heightFile.Open(fileName))
+			return false;
+		nRows = heightFile.header.nRows;
+		nColumns = heightFile.header.nColumns;
+
+		// floats can be used where they lie, but 16-bit samples have to be expanded
+		if (heightFile.floatSamples != NULL)
+			heights = heightFile.floatSamples;
+		else
+			{ // quantized
+			heightValues.resize(nRows * nColumns);
+			heightFile.Expand(&heightValues[0]);
+			heightFile.Close();
+			heights = &heightValues[0];
+			} // quantized
+		return true;
+		} // binary
+
 	// open a file stream
 	std::ifstream inFile(fileName);
 	if (inFile.bad())
 		return false;
 
-	// save the xy scale
-	xyScale = XYScale;
-	
 	// now set a default height and width of the data
 	long height = 0, width = 0;
 	
 	// and read those values in
 	inFile >> height >> width;
 
-	// now allocate the memory and read in the data values
-	heightValues.resize(height);
+	// now allocate the memory and read in the data values, all in one block
+	nRows = std::max(height, 0L);
+	nColumns = std::max(width, 0L);
+	heightValues.resize(nRows * nColumns);
 
-	// the read / compute loop	
-	for (int row = 0; row < height; row++)
-		{ // per row
-		// allocate the row
-		heightValues[row].resize(width);
+	// the values start after the size, and the file is cut into pieces of whole lines there
+	std::streamoff dataStart = inFile.tellg();
+	inFile.seekg(0, std::ios::end);
+	std::streamoff fileEnd = inFile.tellg();
+	if (heightValues.empty() || dataStart < 0 || fileEnd <= dataStart)
+		{ // nothing to read
+		heights = heightValues.empty() ? NULL : &heightValues[0];
+		return true;
+		} // nothing to read
+	long nPieces = (long) ((fileEnd - dataStart + textPieceBytes - 1) / textPieceBytes);
 
-		// loop along the row
-		for (int col = 0; col < width; col++)
-			// read in a value
-			inFile >> heightValues[row][col];
-		} // per row
+	// first count the values in each piece, so that each knows where its first value goes,
+	// then parse them, each piece on whichever thread is free
+	std::vector<long> firstValue(nPieces + 1, 0);
+	for (int pass = 0; pass < 2; pass++)
+		{ // per pass
+		ParallelFor(nPieces, 1, [&](long begin, long end)
+			{ // per range
+			std::ifstream pieceFile(fileName, std::ios::binary);
+			std::string text;
+			for (long piece = begin; piece < end; piece++)
+				{ // per piece
+				ReadTextPiece(pieceFile, dataStart + piece * textPieceBytes, std::min(dataStart + (piece + 1) * textPieceBytes, fileEnd), dataStart, text);
+				if (pass == 0)
+					firstValue[piece + 1] = CountTextValues(text.data(), text.data() + text.size());
+				else
+					ParseTextValues(text.data(), text.data() + text.size(), &heightValues[0] + firstValue[piece], firstValue[piece + 1] - firstValue[piece]);
+				} // per piece
+			}); // per range
+
+		// running totals, capped at the number of values the size promised
+		if (pass == 0)
+			for (long piece = 0; piece < nPieces; piece++)
+				firstValue[piece + 1] = std::min(firstValue[piece] + firstValue[piece + 1], nRows * nColumns);
+		} // per pass
+
+	heights = &heightValues[0];
+	return true;
+	} // ReadHeights()
+
+// read routine returns true on success, failure otherwise
+// xyScale gives the scale factor to use in the x-y directions
+bool Terrain::ReadFileTerrainData(const char *fileName, float XYScale, int MeshMode)
+	{ // ReadFileTerrainData()
+	ScopedPhase timer(PHASE_LOAD_TERRAIN);
+
+	// read the heights, then build the mesh in the mode asked for
+	if (!ReadHeights(fileName, XYScale))
+		return false;
+	meshMode = MeshMode;
+	long height = nRows, width = nColumns;
+
+	// the indexed mesh shares one vertex between all the triangles that meet there
+	if (meshMode == INDEXED_MESH)
+		{ // indexed mesh
+		BuildIndexedMesh();
+		return true;
+		} // indexed mesh
 	
 	// now, we want the triangles to be centred on the origin, but with the zero elevation set
 	// at 0 z, so we have to juggle things somewhat
@@ -77,100 +296,973 @@ bool Terrain::ReadFileTerrainData(const char *fileName, float XYScale)
 	
 	// each square of data is two triangles, but the end values don't have squares,
 	// so we don't need quite as many vertices
-	int nTriangles = (height-1)*(width-1) * 2;
+	long nTriangles = (height-1)*(width-1) * 2;
+	std::vector<TerrainVertex>().swap(gridVertices);
 	vertices.resize(3 * nTriangles);
 
-	// add an extra loop counter for the vertex ID
-	int vertex = 0;
-
-	// now that we have read in all the data, we can create the triangles
-	for (int row = 0; row < height-1; row++)
-		for (int col = 0; col < width-1; col++)
-			{ // loop through squares
-			// first triangle
-			vertices[vertex++] = Cartesian3(	(xyScale * col) 		- midPoint.x , 		(midPoint.y - (xyScale * row		)), 	heightValues[row]		[col]);
-			vertices[vertex++] = Cartesian3(	(xyScale * (col+1)) 	- midPoint.x , 		(midPoint.y - (xyScale * (row+1)	)), 	heightValues[row+1]	[col+1]);
-			vertices[vertex++] = Cartesian3(	(xyScale * (col+1))	- midPoint.x , 		(midPoint.y - (xyScale * row		)), 	heightValues[row]		[col+1]);
-
-			// second triangle			
-			vertices[vertex++] = Cartesian3(	(xyScale * col) 		- midPoint.x , 		(midPoint.y - (xyScale * row		)), 	heightValues[row]		[col]);
-			vertices[vertex++] = Cartesian3(	(xyScale * col)	 	- midPoint.x , 		(midPoint.y - (xyScale * (row+1)	)), 	heightValues[row+1]	[col]);
-			vertices[vertex++] = Cartesian3(	(xyScale * (col+1))	- midPoint.x , 		(midPoint.y - (xyScale * (row+1)	)), 	heightValues[row+1]	[col+1]);
-			} // loop through squares
-
-	// call the routine to compute normals
-	ComputeUnitNormalVectors();
+	// a normal per triangle, or per vertex if they are to be smooth
+	normals.resize(smoothNormals ? 3 * nTriangles : nTriangles);
+
+	// now that we have read in all the data, we can create the triangles, a row of squares
+	// on each thread at a time: each row's vertices start at a known place
+	ParallelFor(height - 1, 16, [&](long firstRow, long lastRow)
+		{ // per range of rows
+		for (long row = firstRow; row < lastRow; row++)
+			for (long col = 0; col < width-1; col++)
+				{ // loop through squares
+				long vertex = 6 * (row * (width-1) + col);
+
+				// first triangle
+				vertices[vertex    ] = Cartesian3(	(xyScale * col) 		- midPoint.x , 		(midPoint.y - (xyScale * row		)), 	heights[row * width + col]);
+				vertices[vertex + 1] = Cartesian3(	(xyScale * (col+1)) 	- midPoint.x , 		(midPoint.y - (xyScale * (row+1)	)), 	heights[(row+1) * width + col+1]);
+				vertices[vertex + 2] = Cartesian3(	(xyScale * (col+1))	- midPoint.x , 		(midPoint.y - (xyScale * row		)), 	heights[row * width + col+1]);
+
+				// second triangle			
+				vertices[vertex + 3] = Cartesian3(	(xyScale * col) 		- midPoint.x , 		(midPoint.y - (xyScale * row		)), 	heights[row * width + col]);
+				vertices[vertex + 4] = Cartesian3(	(xyScale * col)	 	- midPoint.x , 		(midPoint.y - (xyScale * (row+1)	)), 	heights[(row+1) * width + col]);
+				vertices[vertex + 5] = Cartesian3(	(xyScale * (col+1))	- midPoint.x , 		(midPoint.y - (xyScale * (row+1)	)), 	heights[(row+1) * width + col+1]);
+
+				if (smoothNormals)
+					{ // smooth
+					// each vertex gets the slope of the grid where it sits
+					long corners[6][2] = { { row, col }, { row+1, col+1 }, { row, col+1 }, { row, col }, { row+1, col }, { row+1, col+1 } };
+					for (int corner = 0; corner < 6; corner++)
+						{ // per corner
+						Cartesian3 normal = GridNormal(corners[corner][0], corners[corner][1]);
+						normals[vertex + corner] = Homogeneous4(normal.x, normal.y, normal.z, 0.0);
+						} // per corner
+					} // smooth
+				else
+					// as ComputeUnitNormalVectors() would, for the two triangles
+					for (int triangle = 0; triangle < 2; triangle++)
+						{ // per triangle
+						Cartesian3 vertexP = vertices[vertex + 3 * triangle].Point();
+						Cartesian3 vertexQ = vertices[vertex + 3 * triangle + 1].Point();
+						Cartesian3 vertexR = vertices[vertex + 3 * triangle + 2].Point();
+						Cartesian3 normal = (vertexQ - vertexP).cross(vertexR - vertexP).unit();
+						normals[vertex / 3 + triangle] = Homogeneous4(normal.x, normal.y, normal.z, 0.0);
+						} // per triangle
+				} // loop through squares
+		}); // per range of rows
+
+	// the geometry has changed, so OpenGL's copy is out of date
+	renderDirty = true;
 	
 	// return success
 	return true;
 	} // ReadFileTerrainData()
+
+// the normal of the grid at a sample, from the slopes to the neighbouring samples
+Cartesian3 Terrain::GridNormal(long row, long col) const
+	{ // GridNormal()
+	// slopes by central differences, one-sided at the edges
+	long left = std::max(col - 1, 0L), right = std::min(col + 1, nColumns - 1);
+	long up = std::max(row - 1, 0L), down = std::min(row + 1, nRows - 1);
+	float dx = right > left ? (heights[row * nColumns + right] - heights[row * nColumns + left]) / (xyScale * (right - left)) : 0.0f;
+	// y increases up the rows, so the difference runs from down to up
+	float dy = down > up ? (heights[up * nColumns + col] - heights[down * nColumns + col]) / (xyScale * (down - up)) : 0.0f;
+	return Cartesian3(-dx, -dy, 1.0f).unit();
+	} // GridNormal()
+
+// build gridVertices from the heights, with normals from the neighbouring heights
+void Terrain::BuildIndexedMesh()
+	{ // BuildIndexedMesh()
+	long height = nRows, width = nColumns;
+
+	// the same placement as the soup: centred on the origin, rows running down in y
+	float midX = xyScale * (width / 2);
+	float midY = xyScale * (height / 2);
+
+	gridVertices.resize(height * width);
+	ParallelFor(height, 16, [&](long firstRow, long lastRow)
+		{ // per range of rows
+		for (long row = firstRow; row < lastRow; row++)
+			for (long col = 0; col < width; col++)
+				{ // per sample
+				TerrainVertex &vertex = gridVertices[row * width + col];
+				vertex.position[0] = (xyScale * col) - midX;
+				vertex.position[1] = midY - (xyScale * row);
+				vertex.position[2] = heights[row * width + col];
+
+				// and pack the normal into bytes, which OpenGL maps back to [-1, 1]
+				Cartesian3 normal = GridNormal(row, col);
+				vertex.normal[0] = (signed char) lrintf(normal.x * 127.0f);
+				vertex.normal[1] = (signed char) lrintf(normal.y * 127.0f);
+				vertex.normal[2] = (signed char) lrintf(normal.z * 127.0f);
+				vertex.normal[3] = 0;
+				} // per sample
+		}); // per range of rows
+
+	// cut the squares into chunks, each with a box around its vertices
+	chunks.clear();
+	visibleChunks.clear();
+	chunkLevels.clear();
+	long chunkSquares = std::max(chunkSize, 1);
+	chunkColumns = (width - 1 + chunkSquares - 1) / chunkSquares;
+	chunkRows = (height - 1 + chunkSquares - 1) / chunkSquares;
+	long firstIndex = 0;
+	for (long firstRow = 0; firstRow < height - 1; firstRow += chunkSquares)
+		for (long firstColumn = 0; firstColumn < width - 1; firstColumn += chunkSquares)
+			{ // per chunk
+			TerrainChunk chunk;
+			chunk.firstRow = firstRow;
+			chunk.firstColumn = firstColumn;
+			chunk.nRows = std::min(chunkSquares, height - 1 - firstRow);
+			chunk.nColumns = std::min(chunkSquares, width - 1 - firstColumn);
+			chunk.firstIndex = firstIndex;
+			chunk.indexCount = 6 * chunk.nRows * chunk.nColumns;
+			firstIndex += chunk.indexCount;
+
+			chunks.push_back(chunk);
+			} // per chunk
+
+	// then their boxes and errors, which only read the heights, a few chunks on each thread at a time
+	ParallelFor(chunks.size(), 4, [&](long firstChunk, long lastChunk)
+		{ // per range of chunks
+		for (long index = firstChunk; index < lastChunk; index++)
+			{ // per chunk
+			TerrainChunk &chunk = chunks[index];
+
+			// x and y follow from the grid, but the heights have to be searched
+			const float *corner = gridVertices[chunk.firstRow * width + chunk.firstColumn].position;
+			const float *opposite = gridVertices[(chunk.firstRow + chunk.nRows) * width + chunk.firstColumn + chunk.nColumns].position;
+			float lowest = corner[2], highest = corner[2];
+			for (long row = chunk.firstRow; row <= chunk.firstRow + chunk.nRows; row++)
+				for (long col = chunk.firstColumn; col <= chunk.firstColumn + chunk.nColumns; col++)
+					{ // per vertex
+					lowest = std::min(lowest, heights[row * width + col]);
+					highest = std::max(highest, heights[row * width + col]);
+					} // per vertex
+			chunk.minimum = Cartesian3(corner[0], opposite[1], lowest);
+			chunk.maximum = Cartesian3(opposite[0], corner[1], highest);
+			ComputeLevelErrors(chunk);
+			} // per chunk
+		}); // per range of chunks
+
+	// the soup isn't needed in this mode
+	std::vector<Homogeneous4>().swap(vertices);
+	std::vector<Homogeneous4>().swap(normals);
+	std::vector<unsigned int>().swap(gridIndices);
+	gridIndexCount = firstIndex;
+	gridDirty = true;
+	} // BuildIndexedMesh()
+
+// take the heights from the overview of a streamed terrain and build the indexed mesh from them
+bool Terrain::ReadOverview(const TerrainTileStore &store)
+	{ // ReadOverview()
+	if (!store.ready)
+		return false;
+
+	// the overview is a grid of its own, overviewStep squares of the full grid apart
+	heightFile.Close();
+	heightPyramid.clear();
+	heightValues = store.overview;
+	heights = heightValues.empty() ? NULL : &heightValues[0];
+	nRows = store.overviewRows;
+	nColumns = store.overviewColumns;
+	xyScale = store.xyScale * store.overviewStep;
+	meshMode = INDEXED_MESH;
+	BuildIndexedMesh();
+
+	// which centres itself on its own middle sample rather than the full grid's, so move it over
+	float dx = xyScale * (nColumns / 2) - store.xyScale * (store.nColumns / 2);
+	float dy = store.xyScale * (store.nRows / 2) - xyScale * (nRows / 2);
+	for (size_t vertex = 0; vertex < gridVertices.size(); vertex++)
+		{ // per vertex
+		gridVertices[vertex].position[0] += dx;
+		gridVertices[vertex].position[1] += dy;
+		} // per vertex
+	for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+		{ // per chunk
+		chunks[chunk].minimum = chunks[chunk].minimum + Cartesian3(dx, dy, 0.0f);
+		chunks[chunk].maximum = chunks[chunk].maximum + Cartesian3(dx, dy, 0.0f);
+		} // per chunk
+	return true;
+	} // ReadOverview()
+
+// the triangles of the grid, two per square, in the same order and winding as the soup
+void Terrain::GridIndices(std::vector<unsigned int>& indices)
+	{ // GridIndices()
+	unsigned int height = nRows, width = nColumns;
+	indices.clear();
+	if (height < 2 || width < 2)
+		return;
+	indices.reserve(6 * (height - 1) * (width - 1));
+	for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+		for (unsigned int row = chunks[chunk].firstRow; row < chunks[chunk].firstRow + chunks[chunk].nRows; row++)
+			for (unsigned int col = chunks[chunk].firstColumn; col < chunks[chunk].firstColumn + chunks[chunk].nColumns; col++)
+				{ // per square
+				unsigned int upperLeft = row * width + col;
+				unsigned int lowerLeft = upperLeft + width;
+				// first triangle
+				indices.push_back(upperLeft);
+				indices.push_back(lowerLeft + 1);
+				indices.push_back(upperLeft + 1);
+				// second triangle
+				indices.push_back(upperLeft);
+				indices.push_back(lowerLeft);
+				indices.push_back(lowerLeft + 1);
+				} // per square
+	} // GridIndices()
+
+// test every chunk against the frustum of projection * modelview
+void Terrain::CullChunks(const Matrix4& clipMatrix)
+	{ // CullChunks()
+	Frustum frustum;
+	frustum.SetFromMatrix(clipMatrix);
+
+	visibleChunks.clear();
+	for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+		if (frustum.IntersectsBox(chunks[chunk].minimum, chunks[chunk].maximum))
+			visibleChunks.push_back(chunk);
+
+	chunksTested = chunks.size();
+	chunksDrawn = visibleChunks.size();
+	chunksCulled = chunksTested - chunksDrawn;
+	} // CullChunks()
+
+// the position a level keeps at or before p, along an edge of n squares
+static long SnapToLevel(long p, int level, long n)
+	{ // SnapToLevel()
+	// every level keeps the last row or column, even when it is not a multiple of the step
+	if (p >= n)
+		return n;
+	return (p >> level) << level;
+	} // SnapToLevel()
+
+// find how far each level of a chunk is from the full grid
+void Terrain::ComputeLevelErrors(TerrainChunk& chunk)
+	{ // ComputeLevelErrors()
+	chunk.levelErrors.assign(1, 0.0f);
+	chunk.indexCache.clear();
+	for (int level = 1; (1L << level) <= std::max(chunk.nRows, chunk.nColumns); level++)
+		{ // per level
+		long step = 1L << level;
+		float error = chunk.levelErrors[level - 1];
+		for (long row = 0; row < chunk.nRows; row = std::min(row + step, chunk.nRows))
+			for (long col = 0; col < chunk.nColumns; col = std::min(col + step, chunk.nColumns))
+				{ // per cell
+				// the corners this level keeps
+				long nextRow = std::min(row + step, chunk.nRows), nextCol = std::min(col + step, chunk.nColumns);
+				const float *upper = &heights[(chunk.firstRow + row) * nColumns];
+				const float *lower = &heights[(chunk.firstRow + nextRow) * nColumns];
+				float upperLeft = upper[chunk.firstColumn + col], upperRight = upper[chunk.firstColumn + nextCol];
+				float lowerLeft = lower[chunk.firstColumn + col], lowerRight = lower[chunk.firstColumn + nextCol];
+
+				// and every grid height they span, against the same split into two triangles
+				for (long r = row; r <= nextRow; r++)
+					for (long c = col; c <= nextCol; c++)
+						{ // per height
+						float u = (c - col) / (float) (nextCol - col);
+						float v = (r - row) / (float) (nextRow - row);
+						float interpolated = (u >= v)
+							? upperLeft + u * (upperRight - upperLeft) + v * (lowerRight - upperRight)
+							: upperLeft + v * (lowerLeft - upperLeft) + u * (lowerRight - lowerLeft);
+						error = std::max(error, fabsf(heights[(chunk.firstRow + r) * nColumns + chunk.firstColumn + c] - interpolated));
+						} // per height
+				} // per cell
+		chunk.levelErrors.push_back(error);
+		} // per level
+	} // ComputeLevelErrors()
+
+// the triangles of a chunk at the given level, stitched to coarser neighbours
+const std::vector<unsigned int>& Terrain::ChunkIndices(long chunk, int level, const int neighbourLevels[4])
+	{ // ChunkIndices()
+	TerrainChunk &block = chunks[chunk];
+
+	// a finer neighbour stitches itself to us, so only coarser ones change anything
+	int edgeLevels[4];
+	unsigned int key = level;
+	for (int side = 0; side < 4; side++)
+		{ // per side
+		edgeLevels[side] = std::max(neighbourLevels[side], level);
+		key = (key << 4) | edgeLevels[side];
+		} // per side
+	std::map<unsigned int, std::vector<unsigned int>>::iterator cached = block.indexCache.find(key);
+	if (cached != block.indexCache.end())
+		return cached->second;
+
+	std::vector<unsigned int> &indices = block.indexCache[key];
+	long width = nColumns;
+	long step = 1L << level;
+	for (long row = 0; row < block.nRows; row = std::min(row + step, block.nRows))
+		for (long col = 0; col < block.nColumns; col = std::min(col + step, block.nColumns))
+			{ // per cell
+			long nextRow = std::min(row + step, block.nRows), nextCol = std::min(col + step, block.nColumns);
+			// upper left, upper right, lower right, lower left
+			long corners[4][2] = { { row, col }, { row, nextCol }, { nextRow, nextCol }, { nextRow, col } };
+			unsigned int vertex[4];
+			for (int corner = 0; corner < 4; corner++)
+				{ // per corner
+				long r = corners[corner][0], c = corners[corner][1];
+				// a vertex on an edge moves back onto the neighbour's vertices, leaving
+				// the triangles that used it either degenerate or along the coarse edge
+				if (r == 0)
+					c = SnapToLevel(c, edgeLevels[0], block.nColumns);
+				else if (r == block.nRows)
+					c = SnapToLevel(c, edgeLevels[2], block.nColumns);
+				if (c == 0)
+					r = SnapToLevel(r, edgeLevels[3], block.nRows);
+				else if (c == block.nColumns)
+					r = SnapToLevel(r, edgeLevels[1], block.nRows);
+				vertex[corner] = (block.firstRow + r) * width + block.firstColumn + c;
+				} // per corner
+
+			// the same two triangles as the full grid, leaving out any that collapsed
+			unsigned int triangles[2][3] = { { vertex[0], vertex[2], vertex[1] }, { vertex[0], vertex[3], vertex[2] } };
+			for (int triangle = 0; triangle < 2; triangle++)
+				{ // per triangle
+				unsigned int *t = triangles[triangle];
+				if (t[0] == t[1] || t[1] == t[2] || t[2] == t[0])
+					continue;
+				indices.insert(indices.end(), t, t + 3);
+				} // per triangle
+			} // per cell
+	return indices;
+	} // ChunkIndices()
+
+// cull the chunks, then choose a level for each and fill in frameIndices
+void Terrain::SelectLevels(const Matrix4& projectionMatrix, const Matrix4& viewMatrix, float viewportHeight)
+	{ // SelectLevels()
+	CullChunks(projectionMatrix * viewMatrix);
+
+	// the view is rigid, so the eye is at -R^T t
+	Cartesian3 eye;
+	eye.x = -(viewMatrix[0][0] * viewMatrix[0][3] + viewMatrix[1][0] * viewMatrix[1][3] + viewMatrix[2][0] * viewMatrix[2][3]);
+	eye.y = -(viewMatrix[0][1] * viewMatrix[0][3] + viewMatrix[1][1] * viewMatrix[1][3] + viewMatrix[2][1] * viewMatrix[2][3]);
+	eye.z = -(viewMatrix[0][2] * viewMatrix[0][3] + viewMatrix[1][2] * viewMatrix[1][3] + viewMatrix[2][2] * viewMatrix[2][3]);
+
+	// a height error e at distance d covers about e * pixelsPerUnit / d pixels on screen
+	float pixelsPerUnit = 0.5f * viewportHeight * projectionMatrix[1][1];
+
+	// every chunk gets a level, since neighbours of visible chunks need one too
+	chunkLevels.assign(chunks.size(), 0);
+	for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+		{ // per chunk
+		// measured to the nearest point of the box, so that the error is never underestimated
+		const TerrainChunk &block = chunks[chunk];
+		float dx = std::max(std::max(block.minimum.x - eye.x, eye.x - block.maximum.x), 0.0f);
+		float dy = std::max(std::max(block.minimum.y - eye.y, eye.y - block.maximum.y), 0.0f);
+		float dz = std::max(std::max(block.minimum.z - eye.z, eye.z - block.maximum.z), 0.0f);
+		float distance = sqrt(dx * dx + dy * dy + dz * dz);
+
+		int level = 0;
+		while (level + 1 < (int) block.levelErrors.size() && block.levelErrors[level + 1] * pixelsPerUnit <= maxPixelError * distance)
+			level++;
+		chunkLevels[chunk] = level;
+		} // per chunk
+
+	// then gather the triangles of the visible ones
+	frameIndices.clear();
+	for (size_t visible = 0; visible < visibleChunks.size(); visible++)
+		{ // per visible chunk
+		long chunk = visibleChunks[visible];
+		long chunkRow = chunk / chunkColumns, chunkColumn = chunk % chunkColumns;
+		int level = chunkLevels[chunk];
+		// north, east, south, west: the terrain's edge counts as a neighbour at the same level
+		int neighbourLevels[4] =
+			{ // neighbourLevels
+			chunkRow > 0 ? chunkLevels[chunk - chunkColumns] : level,
+			chunkColumn + 1 < chunkColumns ? chunkLevels[chunk + 1] : level,
+			chunkRow + 1 < chunkRows ? chunkLevels[chunk + chunkColumns] : level,
+			chunkColumn > 0 ? chunkLevels[chunk - 1] : level
+			}; // neighbourLevels
+		const std::vector<unsigned int> &indices = ChunkIndices(chunk, level, neighbourLevels);
+		frameIndices.insert(frameIndices.end(), indices.begin(), indices.end());
+		} // per visible chunk
+	trianglesDrawn = frameIndices.size() / 3;
+	} // SelectLevels()
+
+// routine to render, in whichever mode the mesh was built
+void Terrain::Render(Matrix4 &viewMatrix)
+	{ // Render()
+	if (meshMode != INDEXED_MESH)
+		{ // soup
+		// smooth normals are wasted unless they are interpolated across the triangles
+		bool smooth = normals.size() == vertices.size() && !normals.empty();
+		if (smooth)
+			{ // smooth shading
+			glPushAttrib(GL_LIGHTING_BIT);
+			glShadeModel(GL_SMOOTH);
+			} // smooth shading
+		HomogeneousFaceSurface::Render(viewMatrix);
+		if (smooth)
+			glPopAttrib();
+		return;
+		} // soup
+
+	// send the mesh to OpenGL the first time, or if it has changed
+	if (gridDirty)
+		{ // upload
+#ifdef GL_SUPPORT_BUFFERS
+		if (GLSupport::HasBuffers())
+			{ // buffer objects
+			// the indices are only needed long enough to upload them
+			std::vector<unsigned int> indices;
+			GridIndices(indices);
+			if (gridVertexBuffer == 0)
+				glGenBuffers(1, &gridVertexBuffer);
+			if (gridIndexBuffer == 0)
+				glGenBuffers(1, &gridIndexBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, gridVertexBuffer);
+			glBufferData(GL_ARRAY_BUFFER, gridVertices.size() * sizeof(TerrainVertex), gridVertices.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridIndexBuffer);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			} // buffer objects
+		else
+#endif
+			// otherwise we draw from client memory, and need to keep the indices
+			GridIndices(gridIndices);
+		gridDirty = false;
+		} // upload
+
+	// find the chunks that can be seen with the projection we have been given
+	// (identity to start with, in case there is no context to ask)
+	float projection[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	Matrix4 projectionMatrix = Frustum::FromColumnMajor(projection);
+	bool levelOfDetail = (maxPixelError > 0.0f);
+	if (levelOfDetail)
+		{ // level of detail
+		// errors are measured in pixels, so we need the viewport (the window's starting size without a context)
+		GLint viewport[4] = { 0, 0, 600, 600 };
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		SelectLevels(projectionMatrix, viewMatrix, viewport[3]);
+		} // level of detail
+	else
+		{ // full resolution
+		CullChunks(projectionMatrix * viewMatrix);
+		trianglesDrawn = 0;
+		for (size_t visible = 0; visible < visibleChunks.size(); visible++)
+			trianglesDrawn += chunks[visibleChunks[visible]].indexCount / 3;
+		} // full resolution
+	if (visibleChunks.empty())
+		return;
+
+	// let OpenGL apply the view matrix, as the soup does
+	columnMajorMatrix modelview = viewMatrix.columnMajor();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glMultMatrixf(modelview.coordinates);
+
+	// point at the buffer objects, or at our own copies if there aren't any
+	const char *base = (const char *) gridVertices.data();
+	const char *indices = (const char *) (levelOfDetail ? frameIndices.data() : gridIndices.data());
+#ifdef GL_SUPPORT_BUFFERS
+	if (gridVertexBuffer != 0)
+		{ // buffer objects
+		glBindBuffer(GL_ARRAY_BUFFER, gridVertexBuffer);
+		base = NULL;
+		indices = NULL;
+		if (levelOfDetail)
+			{ // this frame's indices
+			// they change as the camera moves, so they are streamed every frame
+			if (frameIndexBuffer == 0)
+				glGenBuffers(1, &frameIndexBuffer);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, frameIndexBuffer);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, frameIndices.size() * sizeof(unsigned int), frameIndices.data(), GL_STREAM_DRAW);
+			} // this frame's indices
+		else
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridIndexBuffer);
+		} // buffer objects
+#endif
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(TerrainVertex), base);
+	glNormalPointer(GL_BYTE, sizeof(TerrainVertex), base + offsetof(TerrainVertex, normal));
+
+	// at chosen levels, the visible chunks were gathered into one list
+	if (levelOfDetail)
+		glDrawElements(GL_TRIANGLES, frameIndices.size(), GL_UNSIGNED_INT, indices);
+	else
+		{ // full resolution
+		// one call per run of visible chunks that are next to each other in the index list
+		for (size_t visible = 0; visible < visibleChunks.size(); )
+			{ // per run
+			const TerrainChunk &first = chunks[visibleChunks[visible]];
+			long count = first.indexCount;
+			for (visible++; visible < visibleChunks.size() && visibleChunks[visible] == visibleChunks[visible - 1] + 1; visible++)
+				count += chunks[visibleChunks[visible]].indexCount;
+			glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, indices + first.firstIndex * sizeof(unsigned int));
+			} // per run
+		} // full resolution
+
+	// then put everything back the way we found it
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+#ifdef GL_SUPPORT_BUFFERS
+	if (gridVertexBuffer != 0)
+		{ // buffer objects
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		} // buffer objects
+#endif
+	glPopMatrix();
+	} // Render()
+
+// free the buffer objects
+void Terrain::ReleaseBuffers()
+	{ // ReleaseBuffers()
+	HomogeneousFaceSurface::ReleaseBuffers();
+#ifdef GL_SUPPORT_BUFFERS
+	if (gridVertexBuffer != 0)
+		glDeleteBuffers(1, &gridVertexBuffer);
+	if (gridIndexBuffer != 0)
+		glDeleteBuffers(1, &gridIndexBuffer);
+	if (frameIndexBuffer != 0)
+		glDeleteBuffers(1, &frameIndexBuffer);
+#endif
+	gridVertexBuffer = gridIndexBuffer = frameIndexBuffer = 0;
+	gridDirty = true;
+	} // ReleaseBuffers()
+
+// bytes of CPU memory held by the height values and the mesh
+size_t Terrain::MemoryBytes() const
+	{ // MemoryBytes()
+	// a mapped binary file is paged in by the OS, and not counted
+	size_t bytes = heightValues.capacity() * sizeof(float);
+	bytes += vertices.capacity() * sizeof(Homogeneous4);
+	bytes += normals.capacity() * sizeof(Homogeneous4);
+	bytes += renderVertices.capacity() * sizeof(float);
+	bytes += gridVertices.capacity() * sizeof(TerrainVertex);
+	bytes += gridIndices.capacity() * sizeof(unsigned int);
+	bytes += chunks.capacity() * sizeof(TerrainChunk);
+	for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+		{ // per chunk
+		bytes += chunks[chunk].levelErrors.capacity() * sizeof(float);
+		std::map<unsigned int, std::vector<unsigned int>>::const_iterator cached;
+		for (cached = chunks[chunk].indexCache.begin(); cached != chunks[chunk].indexCache.end(); cached++)
+			bytes += cached->second.capacity() * sizeof(unsigned int);
+		} // per chunk
+	bytes += frameIndices.capacity() * sizeof(unsigned int);
+	for (size_t level = 0; level < heightPyramid.size(); level++)
+		bytes += 2 * heightPyramid[level].minimum.capacity() * sizeof(float);
+	return bytes;
+	} // MemoryBytes()
 	
+// find the square of the grid under (x, y), returning its upper left corner and where in it the point is
+// with fewer than two rows or columns there is no square, and NULL is returned
+static inline const float *LocateInGrid(const float *heights, long nRows, long nColumns, float xyScale, float x, float y, float &u, float &v)
+	{ // LocateInGrid()
+	if (nRows < 2 || nColumns < 2)
+		return NULL;
+
+	// (0,0) is at row nRows / 2 counted up from the bottom, column nColumns / 2 (integer division),
+	// and rows start at the top, so y is flipped. Positions off the edge are clamped onto it
+	float column = x / xyScale + nColumns / 2;
+	float row = (nRows - 1) - nRows / 2 - y / xyScale;
+	column = std::min(std::max(column, 0.0f), (float) (nColumns - 1));
+	row = std::min(std::max(row, 0.0f), (float) (nRows - 1));
+
+	// the last row and column belong to the square before them
+	long squareRow = std::min((long) row, nRows - 2);
+	long squareColumn = std::min((long) column, nColumns - 2);
+	u = column - squareColumn;
+	v = row - squareRow;
+	return &heights[squareRow * nColumns + squareColumn];
+	} // LocateInGrid()
+
 // and a function to find the height at a known (x,y) coordinate
 float Terrain::getHeight(float x, float y)
 	{ // getHeight()
-	float height = 0.0;
+	// a streamed terrain keeps its heights elsewhere
+	if (tileStore != NULL)
+		return tileStore->getHeight(x, y);
 
-	// retrieve the number of rows and columns of the data
-	long nRows = heightValues.size(), nColumns = heightValues[0].size();
-	
-	// Use this to compute the logical size of the map
-	long totalHeight = (nRows - 1) * xyScale;
-
-	// this returns the height at a known point.
-	// we start by noting that (0,0) is in the dead centre, which is located at
-	// x = nRows / 2 (integer), y = nRows / 2 (integer)
-	// BUT that's only because of how I wrote the code to generate the data
-	long arrayOrigin_i = nRows / 2;
-	long arrayOrigin_j = nColumns / 2;
-
-	// now correct x and y for this offset (note rows are y, columns are x)
-	x = x + arrayOrigin_j * xyScale;
-	y = y + arrayOrigin_i * xyScale;
-
-	// we need to flip coordinates vertically because the rows start at the top
-	y = totalHeight - y;
-
-	// now divide by the x-y scale to get the index 
-	long x_integer	=	x / xyScale;
-	long y_integer 	= 	y / xyScale;
-
-	// now work out the fractional parts
-	float x_remainder	=	(float)(x - (xyScale * x_integer))/xyScale;
-	float y_remainder	=	(float)(y - (xyScale * y_integer))/xyScale;
-
-	// now we can find the row and column easily
-	long row	=	y_integer;
-	long column	=	x_integer; 
-
-	// OK. There are two possibilities - above or below the TL-BR diagonal
-	// Since this is the line x = y, it's easy to check
-	if (x_remainder < y_remainder)
-		{ // LL triangle
-		// in theory, we want barycentric interpolation, but fortunately, it collapses for us because we have 
-		// right triangles.  
-		// y_remainder is alpha, the barycentric coordinate for the UL corner
-		// (1.0 - y_remainder) * x_remainder is beta, the barycentric coordinate for the LR corner
-		// (1.0 - y_remainder) * (1.0 - x_remainder) is gamma, the barycentric coordinate for the LL corner
-		float alpha = y_remainder;
-		float beta = (1.0 - y_remainder) * x_remainder;
-		float gamma = 1.0 - alpha - beta;
-		
-		// compute and return
-		height = alpha * heightValues[row][column] + beta * heightValues[row+1][column+1] + gamma * heightValues[row+1][column];
-		} // LL triangle
-	else
-		{ // UR triangle
-		// (1.0 - x_remainder) is alpha, the barycentric coordinate for the UL corner
-		// x_remainder * y_remainder is beta, the barycentric coordinate for the LR corner
-		// x_remainder * (1.0 - y_remainder) is gamma, the barycentric coordinate for the UR corner
-		float alpha = 1.0 - y_remainder;
-		float beta = x_remainder * y_remainder;
-		float gamma = 1.0 - alpha - beta;
-		
-		// compute and return
-		height = alpha * heightValues[row][column] + beta * heightValues[row+1][column+1] + gamma * heightValues[row][column+1];
-		} // UR triangle
-
-	// return the height
-	return height;
-	} // getHeight()
\ No newline at end of file
+	float u, v;
+	const float *upper = LocateInGrid(heights, nRows, nColumns, xyScale, x, y, u, v);
+	if (upper == NULL)
+		return (heights != NULL) ? heights[0] : 0.0f;
+	const float *lower = upper + nColumns;
+
+	// the diagonal runs from upper left to lower right. Above it (u >= v) the third corner is
+	// the upper right, below it the lower left, and either way the barycentric coordinates
+	// are 1 - max(u, v) for the upper left, max - min for the third corner, and min for the lower right
+	float third = (u >= v) ? upper[1] : lower[0];
+	float larger = std::max(u, v), smaller = std::min(u, v);
+	return (1.0f - larger) * upper[0] + (larger - smaller) * third + smaller * lower[1];
+	} // getHeight()
+
+// one point: the height, and the normal if normal is not NULL
+float Terrain::HeightAndNormal(float x, float y, float *normal) const
+	{ // HeightAndNormal()
+	float u, v;
+	const float *upper = LocateInGrid(heights, nRows, nColumns, xyScale, x, y, u, v);
+	if (upper == NULL)
+		{ // no triangles
+		if (normal != NULL)
+			normal[0] = normal[1] = 0.0f, normal[2] = 1.0f;
+		return (heights != NULL) ? heights[0] : 0.0f;
+		} // no triangles
+	const float *lower = upper + nColumns;
+
+	// the same triangle as getHeight()
+	float third = (u >= v) ? upper[1] : lower[0];
+	float larger = std::max(u, v), smaller = std::min(u, v);
+
+	if (normal != NULL)
+		{ // normal
+		// the slopes of the triangle along u and v: x runs with u, but y runs against v
+		float dhdu = (u >= v) ? upper[1] - upper[0] : lower[1] - lower[0];
+		float dhdv = (u >= v) ? lower[1] - upper[1] : lower[0] - upper[0];
+		float nx = -dhdu / xyScale, ny = dhdv / xyScale;
+		float length = sqrtf(nx * nx + ny * ny + 1.0f);
+		normal[0] = nx / length;
+		normal[1] = ny / length;
+		normal[2] = 1.0f / length;
+		} // normal
+
+	return (1.0f - larger) * upper[0] + (larger - smaller) * third + smaller * lower[1];
+	} // HeightAndNormal()
+
+// the same for count points at once, and optionally the normals
+void Terrain::getHeights(const float *x, const float *y, long count, float *results, float *normals)
+	{ // getHeights()
+	long done = 0;
+
+#if defined(TERRAIN_QUERY_AVX2) || defined(TERRAIN_QUERY_SSE2)
+	// the vector paths need a grid to look in, and the streamed heights are answered one at a time
+	bool vectorised = tileStore == NULL && nRows >= 2 && nColumns >= 2;
+#endif
+
+#ifdef TERRAIN_QUERY_AVX2
+	// eight at a time, with the corners gathered by 32-bit index
+	if (vectorised && nRows * nColumns < (1L << 31))
+		{ // AVX2
+		const __m256 inverseScale = _mm256_set1_ps(1.0f / xyScale), scale = _mm256_set1_ps(xyScale);
+		const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+		const __m256 columnOffset = _mm256_set1_ps((float) (nColumns / 2)), rowOffset = _mm256_set1_ps((float) ((nRows - 1) - nRows / 2));
+		const __m256 lastColumn = _mm256_set1_ps((float) (nColumns - 1)), lastRow = _mm256_set1_ps((float) (nRows - 1));
+		const __m256 lastSquareColumn = _mm256_set1_ps((float) (nColumns - 2)), lastSquareRow = _mm256_set1_ps((float) (nRows - 2));
+		const __m256i stride = _mm256_set1_epi32((int) nColumns), nextRow = _mm256_set1_epi32((int) nColumns + 1);
+		const float *grid = heights;
+		for (; done + 8 <= count; done += 8)
+			{ // per eight
+			// placement and clamping as in HeightAndNormal(), dividing so that the answers agree exactly
+			__m256 column = _mm256_add_ps(_mm256_div_ps(_mm256_loadu_ps(x + done), scale), columnOffset);
+			__m256 row = _mm256_sub_ps(rowOffset, _mm256_div_ps(_mm256_loadu_ps(y + done), scale));
+			column = _mm256_min_ps(_mm256_max_ps(column, zero), lastColumn);
+			row = _mm256_min_ps(_mm256_max_ps(row, zero), lastRow);
+			__m256 squareColumn = _mm256_min_ps(_mm256_round_ps(column, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), lastSquareColumn);
+			__m256 squareRow = _mm256_min_ps(_mm256_round_ps(row, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), lastSquareRow);
+			__m256 u = _mm256_sub_ps(column, squareColumn), v = _mm256_sub_ps(row, squareRow);
+
+			// the four corners of each square
+			__m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(squareRow), stride), _mm256_cvttps_epi32(squareColumn));
+			__m256 upperLeft = _mm256_i32gather_ps(grid, index, 4);
+			__m256 upperRight = _mm256_i32gather_ps(grid + 1, index, 4);
+			__m256 lowerLeft = _mm256_i32gather_ps(grid, _mm256_add_epi32(index, stride), 4);
+			__m256 lowerRight = _mm256_i32gather_ps(grid, _mm256_add_epi32(index, nextRow), 4);
+
+			// above the diagonal the third corner is the upper right, below it the lower left
+			__m256 above = _mm256_cmp_ps(u, v, _CMP_GE_OQ);
+			__m256 third = _mm256_blendv_ps(lowerLeft, upperRight, above);
+			__m256 larger = _mm256_max_ps(u, v), smaller = _mm256_min_ps(u, v);
+			__m256 height = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(one, larger), upperLeft),
+				_mm256_mul_ps(_mm256_sub_ps(larger, smaller), third)), _mm256_mul_ps(smaller, lowerRight));
+			_mm256_storeu_ps(results + done, height);
+
+			if (normals != NULL)
+				{ // normals
+				__m256 dhdu = _mm256_blendv_ps(_mm256_sub_ps(lowerRight, lowerLeft), _mm256_sub_ps(upperRight, upperLeft), above);
+				__m256 dhdv = _mm256_blendv_ps(_mm256_sub_ps(lowerLeft, upperLeft), _mm256_sub_ps(lowerRight, upperRight), above);
+				__m256 nx = _mm256_sub_ps(zero, _mm256_mul_ps(dhdu, inverseScale)), ny = _mm256_mul_ps(dhdv, inverseScale);
+				__m256 inverseLength = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), one)));
+				float lanes[3][8];
+				_mm256_storeu_ps(lanes[0], _mm256_mul_ps(nx, inverseLength));
+				_mm256_storeu_ps(lanes[1], _mm256_mul_ps(ny, inverseLength));
+				_mm256_storeu_ps(lanes[2], inverseLength);
+				for (int lane = 0; lane < 8; lane++)
+					for (int axis = 0; axis < 3; axis++)
+						normals[3 * (done + lane) + axis] = lanes[axis][lane];
+				} // normals
+			} // per eight
+		} // AVX2
+#endif
+
+#ifdef TERRAIN_QUERY_SSE2
+	// four at a time: SSE2 has no gather, so the corners are fetched one lane at a time
+	if (vectorised)
+		{ // SSE2
+		const __m128 inverseScale = _mm_set1_ps(1.0f / xyScale), scale = _mm_set1_ps(xyScale);
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+		const __m128 columnOffset = _mm_set1_ps((float) (nColumns / 2)), rowOffset = _mm_set1_ps((float) ((nRows - 1) - nRows / 2));
+		const __m128 lastColumn = _mm_set1_ps((float) (nColumns - 1)), lastRow = _mm_set1_ps((float) (nRows - 1));
+		const __m128 lastSquareColumn = _mm_set1_ps((float) (nColumns - 2)), lastSquareRow = _mm_set1_ps((float) (nRows - 2));
+		for (; done + 4 <= count; done += 4)
+			{ // per four
+			__m128 column = _mm_add_ps(_mm_div_ps(_mm_loadu_ps(x + done), scale), columnOffset);
+			__m128 row = _mm_sub_ps(rowOffset, _mm_div_ps(_mm_loadu_ps(y + done), scale));
+			column = _mm_min_ps(_mm_max_ps(column, zero), lastColumn);
+			row = _mm_min_ps(_mm_max_ps(row, zero), lastRow);
+			__m128 squareColumn = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(column)), lastSquareColumn);
+			__m128 squareRow = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(row)), lastSquareRow);
+			__m128 u = _mm_sub_ps(column, squareColumn), v = _mm_sub_ps(row, squareRow);
+
+			// the four corners of each square
+			int rows[4], columns[4];
+			_mm_storeu_si128((__m128i *) rows, _mm_cvttps_epi32(squareRow));
+			_mm_storeu_si128((__m128i *) columns, _mm_cvttps_epi32(squareColumn));
+			float corners[4][4];
+			for (int lane = 0; lane < 4; lane++)
+				{ // per lane
+				const float *upper = &heights[rows[lane] * nColumns + columns[lane]];
+				corners[0][lane] = upper[0];
+				corners[1][lane] = upper[1];
+				corners[2][lane] = upper[nColumns];
+				corners[3][lane] = upper[nColumns + 1];
+				} // per lane
+			__m128 upperLeft = _mm_loadu_ps(corners[0]), upperRight = _mm_loadu_ps(corners[1]);
+			__m128 lowerLeft = _mm_loadu_ps(corners[2]), lowerRight = _mm_loadu_ps(corners[3]);
+
+			// above the diagonal the third corner is the upper right, below it the lower left
+			__m128 above = _mm_cmpge_ps(u, v);
+			__m128 third = _mm_or_ps(_mm_and_ps(above, upperRight), _mm_andnot_ps(above, lowerLeft));
+			__m128 larger = _mm_max_ps(u, v), smaller = _mm_min_ps(u, v);
+			__m128 height = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, larger), upperLeft),
+				_mm_mul_ps(_mm_sub_ps(larger, smaller), third)), _mm_mul_ps(smaller, lowerRight));
+			_mm_storeu_ps(results + done, height);
+
+			if (normals != NULL)
+				{ // normals
+				__m128 dhdu = _mm_or_ps(_mm_and_ps(above, _mm_sub_ps(upperRight, upperLeft)), _mm_andnot_ps(above, _mm_sub_ps(lowerRight, lowerLeft)));
+				__m128 dhdv = _mm_or_ps(_mm_and_ps(above, _mm_sub_ps(lowerRight, upperRight)), _mm_andnot_ps(above, _mm_sub_ps(lowerLeft, upperLeft)));
+				__m128 nx = _mm_sub_ps(zero, _mm_mul_ps(dhdu, inverseScale)), ny = _mm_mul_ps(dhdv, inverseScale);
+				__m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), one)));
+				float lanes[3][4];
+				_mm_storeu_ps(lanes[0], _mm_mul_ps(nx, inverseLength));
+				_mm_storeu_ps(lanes[1], _mm_mul_ps(ny, inverseLength));
+				_mm_storeu_ps(lanes[2], inverseLength);
+				for (int lane = 0; lane < 4; lane++)
+					for (int axis = 0; axis < 3; axis++)
+						normals[3 * (done + lane) + axis] = lanes[axis][lane];
+				} // normals
+			} // per four
+		} // SSE2
+#endif
+
+	// whatever is left over, or everything if there are no vector instructions to use
+	for (; done < count; done++)
+		{ // per point
+		float *normal = (normals != NULL) ? normals + 3 * done : NULL;
+		if (tileStore != NULL)
+			{ // streamed
+			results[done] = tileStore->getHeight(x[done], y[done]);
+			if (normal != NULL)
+				{ // normal
+				// the tiles keep no slopes, so take them across a grid square either side
+				float nx = (tileStore->getHeight(x[done] - xyScale, y[done]) - tileStore->getHeight(x[done] + xyScale, y[done])) / (2.0f * xyScale);
+				float ny = (tileStore->getHeight(x[done], y[done] - xyScale) - tileStore->getHeight(x[done], y[done] + xyScale)) / (2.0f * xyScale);
+				float length = sqrtf(nx * nx + ny * ny + 1.0f);
+				normal[0] = nx / length;
+				normal[1] = ny / length;
+				normal[2] = 1.0f / length;
+				} // normal
+			} // streamed
+		else
+			results[done] = HeightAndNormal(x[done], y[done], normal);
+		} // per point
+	} // getHeights()
+
+// build the height pyramid that rays are cast through
+void Terrain::BuildHeightPyramid()
+	{ // BuildHeightPyramid()
+	heightPyramid.clear();
+	if (heights == NULL || nRows < 2 || nColumns < 2)
+		return;
+
+	// level 0: the four corners of each square
+	TerrainHeightLevel squares;
+	squares.nRows = nRows - 1;
+	squares.nColumns = nColumns - 1;
+	squares.minimum.resize(squares.nRows * squares.nColumns);
+	squares.maximum.resize(squares.nRows * squares.nColumns);
+	for (long row = 0; row < squares.nRows; row++)
+		{ // per row
+		const float *upper = &heights[row * nColumns], *lower = upper + nColumns;
+		for (long col = 0; col < squares.nColumns; col++)
+			{ // per square
+			squares.minimum[row * squares.nColumns + col] = std::min(std::min(upper[col], upper[col + 1]), std::min(lower[col], lower[col + 1]));
+			squares.maximum[row * squares.nColumns + col] = std::max(std::max(upper[col], upper[col + 1]), std::max(lower[col], lower[col + 1]));
+			} // per square
+		} // per row
+	heightPyramid.push_back(squares);
+
+	// then halve until one block covers everything, odd rows and columns carrying up on their own
+	while (heightPyramid.back().nRows > 1 || heightPyramid.back().nColumns > 1)
+		{ // per level
+		const TerrainHeightLevel &below = heightPyramid.back();
+		TerrainHeightLevel level;
+		level.nRows = (below.nRows + 1) / 2;
+		level.nColumns = (below.nColumns + 1) / 2;
+		level.minimum.resize(level.nRows * level.nColumns);
+		level.maximum.resize(level.nRows * level.nColumns);
+		for (long row = 0; row < level.nRows; row++)
+			for (long col = 0; col < level.nColumns; col++)
+				{ // per block
+				float lowest = INFINITY, highest = -INFINITY;
+				for (long r = 2 * row; r < std::min(2 * row + 2, below.nRows); r++)
+					for (long c = 2 * col; c < std::min(2 * col + 2, below.nColumns); c++)
+						{ // per block below
+						lowest = std::min(lowest, below.minimum[r * below.nColumns + c]);
+						highest = std::max(highest, below.maximum[r * below.nColumns + c]);
+						} // per block below
+				level.minimum[row * level.nColumns + col] = lowest;
+				level.maximum[row * level.nColumns + col] = highest;
+				} // per block
+		heightPyramid.push_back(level);
+		} // per level
+	} // BuildHeightPyramid()
+
+// where a ray enters and leaves a box, within [tNear, tFar]: returns false if it misses
+static inline bool RayBox(const float origin[3], const float inverse[3], const float low[3], const float high[3], float &tNear, float &tFar)
+	{ // RayBox()
+	for (int axis = 0; axis < 3; axis++)
+		{ // per axis
+		float t0 = (low[axis] - origin[axis]) * inverse[axis], t1 = (high[axis] - origin[axis]) * inverse[axis];
+		tNear = std::max(tNear, std::min(t0, t1));
+		tFar = std::min(tFar, std::max(t0, t1));
+		} // per axis
+	return tNear <= tFar;
+	} // RayBox()
+
+// where a ray meets a triangle, if it does closer than t: Moller & Trumbore's test
+static inline bool RayTriangle(const float origin[3], const float direction[3], const float a[3], const float b[3], const float c[3], float &t)
+	{ // RayTriangle()
+	float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	float p[3] = { direction[1] * ac[2] - direction[2] * ac[1], direction[2] * ac[0] - direction[0] * ac[2], direction[0] * ac[1] - direction[1] * ac[0] };
+	float determinant = ab[0] * p[0] + ab[1] * p[1] + ab[2] * p[2];
+	if (determinant == 0.0f)
+		return false;
+	float inverse = 1.0f / determinant;
+	float s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+	float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+	float q[3] = { s[1] * ab[2] - s[2] * ab[1], s[2] * ab[0] - s[0] * ab[2], s[0] * ab[1] - s[1] * ab[0] };
+	float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+	float hitT = (ac[0] * q[0] + ac[1] * q[1] + ac[2] * q[2]) * inverse;
+	if (hitT < 0.0f || hitT >= t)
+		return false;
+	t = hitT;
+	return true;
+	} // RayTriangle()
+
+// a block of the pyramid waiting to be looked at, and where the ray enters it
+class TerrainRayBlock
+	{ // class TerrainRayBlock
+	public:
+	int level;
+	long row, column;
+	float tNear;
+	}; // class TerrainRayBlock
+
+// find where origin + t * direction first meets the terrain, for t from 0 to maxT
+bool Terrain::Raycast(const Cartesian3 &origin, const Cartesian3 &direction, float maxT, TerrainRayHit &hit)
+	{ // Raycast()
+	hit.triangle = -1;
+	if (heights == NULL || nRows < 2 || nColumns < 2)
+		return false;
+	if (heightPyramid.empty())
+		BuildHeightPyramid();
+
+	// work in grid coordinates, with the same placement as the mesh: columns along x, rows down y.
+	// t is the same in both, since the change is affine
+	float gridOrigin[3] = { origin.x / xyScale + nColumns / 2, nRows / 2 - origin.y / xyScale, origin.z };
+	float gridDirection[3] = { direction.x / xyScale, -direction.y / xyScale, direction.z };
+	float inverse[3];
+	for (int axis = 0; axis < 3; axis++)
+		// a huge reciprocal rather than infinity, so that a ray in the plane of a face gives no NaNs
+		inverse[axis] = (fabsf(gridDirection[axis]) > 1E-20f) ? 1.0f / gridDirection[axis] : copysignf(1E20f, gridDirection[axis]);
+
+	// blocks still to look at, nearest last so that it comes off first. Each level down pushes at most four
+	TerrainRayBlock stack[4 * 64];
+	int stacked = 0;
+	float bestT = maxT;
+	long bestTriangle = -1;
+
+	int top = (int) heightPyramid.size() - 1;
+	float tNear = 0.0f, tFar = maxT;
+	float low[3] = { 0.0f, 0.0f, heightPyramid[top].minimum[0] }, high[3] = { (float) (nColumns - 1), (float) (nRows - 1), heightPyramid[top].maximum[0] };
+	if (RayBox(gridOrigin, inverse, low, high, tNear, tFar))
+		{ // hits the terrain's box
+		TerrainRayBlock root = { top, 0, 0, tNear };
+		stack[stacked++] = root;
+		} // hits the terrain's box
+
+	while (stacked > 0)
+		{ // per block
+		TerrainRayBlock block = stack[--stacked];
+		// something nearer has been hit already
+		if (block.tNear > bestT)
+			continue;
+
+		if (block.level == 0)
+			{ // a grid square
+			long row = block.row, col = block.column;
+			const float *upper = &heights[row * nColumns + col], *lower = upper + nColumns;
+			float upperLeft[3] = { (float) col, (float) row, upper[0] }, upperRight[3] = { (float) col + 1, (float) row, upper[1] };
+			float lowerLeft[3] = { (float) col, (float) row + 1, lower[0] }, lowerRight[3] = { (float) col + 1, (float) row + 1, lower[1] };
+			// the two triangles, in the order the soup has them
+			long square = row * (nColumns - 1) + col;
+			if (RayTriangle(gridOrigin, gridDirection, upperLeft, lowerRight, upperRight, bestT))
+				bestTriangle = 2 * square;
+			if (RayTriangle(gridOrigin, gridDirection, upperLeft, lowerLeft, lowerRight, bestT))
+				bestTriangle = 2 * square + 1;
+			continue;
+			} // a grid square
+
+		// the up to four blocks below this one that the ray passes through, farthest first
+		const TerrainHeightLevel &below = heightPyramid[block.level - 1];
+		long squaresAcross = 1L << (block.level - 1);
+		TerrainRayBlock children[4];
+		int nChildren = 0;
+		for (long row = 2 * block.row; row < std::min(2 * block.row + 2, below.nRows); row++)
+			for (long col = 2 * block.column; col < std::min(2 * block.column + 2, below.nColumns); col++)
+				{ // per child
+				float childNear = 0.0f, childFar = bestT;
+				float childLow[3] = { (float) (col * squaresAcross), (float) (row * squaresAcross), below.minimum[row * below.nColumns + col] };
+				float childHigh[3] = { (float) std::min((col + 1) * squaresAcross, nColumns - 1), (float) std::min((row + 1) * squaresAcross, nRows - 1), below.maximum[row * below.nColumns + col] };
+				if (!RayBox(gridOrigin, inverse, childLow, childHigh, childNear, childFar))
+					continue;
+				TerrainRayBlock child = { block.level - 1, row, col, childNear };
+				int slot = nChildren++;
+				for (; slot > 0 && children[slot - 1].tNear < childNear; slot--)
+					children[slot] = children[slot - 1];
+				children[slot] = child;
+				} // per child
+		for (int child = 0; child < nChildren; child++)
+			stack[stacked++] = children[child];
+		} // per block
+
+	if (bestTriangle < 0)
+		return false;
+	hit.t = bestT;
+	hit.point = origin + bestT * direction;
+	hit.triangle = bestTriangle;
+	return true;
+	} // Raycast()
+
+// cast count rays at once, spread across the hardware threads
+void Terrain::Raycasts(const Cartesian3 *origins, const Cartesian3 *directions, long count, float maxT, TerrainRayHit *hits)
+	{ // Raycasts()
+	// built here, before the threads share it
+	if (heightPyramid.empty())
+		BuildHeightPyramid();
+	ParallelFor(count, 256, [&](long begin, long end)
+		{ // per range
+		for (long ray = begin; ray < end; ray++)
+			Raycast(origins[ray], directions[ray], maxT, hits[ray]);
+		}); // per range
+	} // Raycasts()
+
+// true if nothing of the terrain lies between the two points
+bool Terrain::LineOfSight(const Cartesian3 &from, const Cartesian3 &to)
+	{ // LineOfSight()
+	TerrainRayHit hit;
+	return !Raycast(from, to - from, 1.0f, hit);
+	} // LineOfSight()
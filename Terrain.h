@@ -14,28 +14,239 @@
 #ifndef _TERRAIN_H
 #define _TERRAIN_H
 
+#include <map>
 #include <vector>
 
 #include "HomogeneousFaceSurface.h"
+#include "BinaryDEM.h"
+#include "Frustum.h"
+
+class TerrainTileStore;
+
+// one vertex of the indexed mesh: position, then a normal packed into signed bytes
+// (the fourth byte is padding, so that a vertex is 16 bytes)
+class TerrainVertex
+	{ // class TerrainVertex
+	public:
+	float position[3];
+	signed char normal[4];
+	}; // class TerrainVertex
+
+// a block of grid squares from the indexed mesh, drawn or culled as a whole
+class TerrainChunk
+	{ // class TerrainChunk
+	public:
+	// the squares it covers
+	long firstRow, firstColumn, nRows, nColumns;
+
+	// the box around all of its vertices, lowest and highest heights included
+	Cartesian3 minimum, maximum;
+
+	// its triangles are indexCount indices from firstIndex on
+	long firstIndex, indexCount;
+
+	// level L keeps every 2^L-th row and column of the chunk, and its last ones
+	// levelErrors[L] is the largest height difference between level L and the full grid
+	std::vector<float> levelErrors;
+
+	// index lists already built, keyed by the level and the levels of the neighbours it stitches to
+	std::map<unsigned int, std::vector<unsigned int>> indexCache;
+	}; // class TerrainChunk
+
+// one level of the height pyramid: the lowest and highest height in each block of grid squares
+class TerrainHeightLevel
+	{ // class TerrainHeightLevel
+	public:
+	// how many blocks there are down and across
+	long nRows, nColumns;
+
+	// the lowest and highest heights, block by block, row by row
+	std::vector<float> minimum, maximum;
+	}; // class TerrainHeightLevel
+
+// where a ray met the terrain
+class TerrainRayHit
+	{ // class TerrainRayHit
+	public:
+	// the hit is at origin + t * direction
+	float t;
+	Cartesian3 point;
+
+	// the triangle hit, numbered as in the triangle soup (two per grid square, row by row), or -1 for a miss
+	long triangle;
+	}; // class TerrainRayHit
 
 class Terrain : public HomogeneousFaceSurface
 	{ // class Terrain
 	public:
-	// array to store the terrain data
-	std::vector<std::vector<float>> heightValues;
+	// array to store the terrain data, row by row in one block
+	// empty when the heights are used where they lie in a mapped binary file
+	std::vector<float> heightValues;
+
+	// and how many rows and columns of it there are
+	long nRows, nColumns;
+
+	// the heights, wherever they are: the height at (row, col) is heights[row * nColumns + col]
+	const float *heights;
+
+	// the binary file the heights were mapped from, if they were
+	BinaryDEM heightFile;
 	
 	// keep track of the xy scale that we are told about
 	float xyScale;
 
+	// how the triangles are stored
+	enum
+		{ // mesh modes
+		// six vertices per grid square in vertices, one normal per triangle in normals
+		// (or per vertex, with smoothNormals)
+		SOUP_MESH,
+		// one vertex per height value in gridVertices, with the triangles implied by the grid
+		INDEXED_MESH
+		}; // mesh modes
+	int meshMode;
+
+	// in INDEXED_MESH mode, one vertex per height value, row by row
+	std::vector<TerrainVertex> gridVertices;
+
+	// the triangles as indices into gridVertices. Only kept when there are no
+	// buffer objects, since otherwise they can be regenerated from the grid
+	std::vector<unsigned int> gridIndices;
+
+	// the buffer objects for the indexed mesh, or 0 if there aren't any
+	unsigned int gridVertexBuffer, gridIndexBuffer;
+
+	// how many indices the whole indexed mesh has
+	long gridIndexCount;
+
+	// set when gridVertices changes, so that Render() sends it to OpenGL again
+	bool gridDirty;
+
+	// in SOUP_MESH mode, give each vertex the normal of the grid where it sits, and shade
+	// smoothly, rather than a normal per triangle: set before reading the terrain
+	bool smoothNormals;
+
+	// grid squares along each side of a chunk: set before reading the terrain
+	int chunkSize;
+
+	// the chunks of the indexed mesh, row by row
+	std::vector<TerrainChunk> chunks;
+
+	// the chunks that passed the last frustum test, in order
+	std::vector<int> visibleChunks;
+
+	// counters from the last frustum test
+	long chunksTested, chunksCulled, chunksDrawn;
+
+	// the largest error, in pixels, allowed when choosing a chunk's level of detail
+	// 0 or less draws every chunk at full resolution
+	float maxPixelError;
+
+	// how many chunks there are across and down the grid
+	long chunkColumns, chunkRows;
+
+	// when set, getHeight() answers from these streamed tiles rather than from heights
+	TerrainTileStore *tileStore;
+
+	// the level chosen for each chunk by the last SelectLevels()
+	std::vector<int> chunkLevels;
+
+	// the triangles of the visible chunks at their chosen levels, rebuilt every frame
+	std::vector<unsigned int> frameIndices;
+
+	// the buffer object frameIndices is streamed into, or 0 if there isn't one
+	unsigned int frameIndexBuffer;
+
+	// triangles sent by the last Render()
+	long trianglesDrawn;
+
+	// the height pyramid, built by BuildHeightPyramid(): level 0 has a block per grid square,
+	// each level above has a block per 2 x 2 blocks of the one below, and the top a single block
+	std::vector<TerrainHeightLevel> heightPyramid;
+
 	// constructor will initialise to safe values
 	Terrain();
 	
+	// read only the heights, from a .dem text file or a binary heightfield (see BinaryDEM),
+	// without building a mesh. A binary file of floats is mapped rather than read, so this
+	// takes much the same time however large it is. returns true on success
+	bool ReadHeights(const char *fileName, float XYScale);
+
 	// read routine returns true on success, failure otherwise
+	// the file may be text or binary, as for ReadHeights()
 	// xyScale gives the scale factor to use in the x-y directions
-	bool ReadFileTerrainData(const char *fileName, float XYScale);
+	// meshMode chooses between the triangle soup and the indexed mesh
+	bool ReadFileTerrainData(const char *fileName, float XYScale, int MeshMode = SOUP_MESH);
+
+	// the normal of the grid at a sample, from the slopes to the neighbouring samples
+	Cartesian3 GridNormal(long row, long col) const;
+
+	// build gridVertices from the heights, with normals from the neighbouring heights
+	void BuildIndexedMesh();
+
+	// take the heights from the overview of a streamed terrain, once its scan is done, and build
+	// the indexed mesh from them, placed where the full grid would be so that there is ground
+	// to draw: returns false if the scan is not done yet
+	bool ReadOverview(const TerrainTileStore &store);
+
+	// the triangles of the grid, two per square, with the same winding as the soup
+	// each chunk's triangles are contiguous, and the chunks are in order
+	void GridIndices(std::vector<unsigned int>& indices);
+
+	// test every chunk against the frustum of projection * modelview, and
+	// fill in visibleChunks and the counters
+	void CullChunks(const Matrix4& clipMatrix);
+
+	// find how far each level of a chunk is from the full grid
+	void ComputeLevelErrors(TerrainChunk& chunk);
+
+	// the triangles of a chunk at the given level, with the edges that border coarser
+	// neighbours (north, east, south, west) collapsed onto their vertices so that no cracks show
+	const std::vector<unsigned int>& ChunkIndices(long chunk, int level, const int neighbourLevels[4]);
+
+	// cull the chunks, then give each the coarsest level whose error is no more than
+	// maxPixelError on a viewport viewportHeight pixels high, and fill in frameIndices
+	void SelectLevels(const Matrix4& projectionMatrix, const Matrix4& viewMatrix, float viewportHeight);
+
+	// routine to render, in whichever mode the mesh was built
+	// in INDEXED_MESH mode, only the chunks inside the current projection and view are drawn
+	void Render(Matrix4 &viewMatrix);
+
+	// free the buffer objects, those of the triangle soup included, while the context they were
+	// made in is still current: the next Render() uploads again
+	void ReleaseBuffers();
+
+	// bytes of CPU memory held by the height values and the mesh
+	size_t MemoryBytes() const;
 	
 	// A function to find the height at a known (x,y) coordinate
+	// positions beyond the edge of the terrain get the height at the edge
 	float getHeight(float x, float y);
+
+	// the same for count points at once, with x and y in separate arrays and the heights put
+	// in results. If normals is not NULL, it gets the unit normal of the triangle under each
+	// point, as x, y, z triples.
+	// Several points are answered at a time with SSE2, or AVX2 when compiled for it.
+	// Streamed terrain is answered a point at a time, with normals from height differences
+	void getHeights(const float *x, const float *y, long count, float *results, float *normals = NULL);
+
+	// one point: the height, and the normal if normal is not NULL
+	float HeightAndNormal(float x, float y, float *normal) const;
+
+	// build the height pyramid that rays are cast through
+	void BuildHeightPyramid();
+
+	// find where origin + t * direction first meets the terrain, for t from 0 to maxT,
+	// skipping blocks of squares the ray passes over. The triangles are those the mesh draws.
+	// The first ray builds the pyramid if it has not been built, so build it before casting
+	// rays from several threads. Streamed terrain has no heights here to cast against
+	bool Raycast(const Cartesian3 &origin, const Cartesian3 &direction, float maxT, TerrainRayHit &hit);
+
+	// cast count rays at once, spread across the hardware threads
+	void Raycasts(const Cartesian3 *origins, const Cartesian3 *directions, long count, float maxT, TerrainRayHit *hits);
+
+	// true if nothing of the terrain lies between the two points
+	bool LineOfSight(const Cartesian3 &from, const Cartesian3 &to);
 	
 	}; // class Terrain
 
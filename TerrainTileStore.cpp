@@ -0,0 +1,324 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TerrainTileStore.cpp
+//	------------------------
+//
+//	Heights from a .dem file too large to read in whole,
+//	scanned once in the background and then read a tile
+//	at a time, within a memory budget.
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <math.h>
+
+#include "TerrainTileStore.h"
+
+// constructor will initialise to safe values
+TerrainTileStore::TerrainTileStore()
+	:
+	xyScale(1),
+	tileSize(128),
+	budgetBytes(64 << 20),
+	overviewStep(8),
+	ready(false),
+	nRows(0),
+	nColumns(0),
+	tileRows(0),
+	tileColumns(0),
+	overviewRows(0),
+	overviewColumns(0),
+	scanBytes(0),
+	residentBytes(0),
+	stopping(false),
+	tilesLoaded(0),
+	tilesEvicted(0),
+	tileQueries(0),
+	overviewQueries(0)
+	{ // constructor
+	} // constructor
+
+// stops the loading thread
+TerrainTileStore::~TerrainTileStore()
+	{ // destructor
+	Close();
+	} // destructor
+
+// start scanning the file in the background
+bool TerrainTileStore::Open(const char *FileName, float XYScale, int TileSize, size_t BudgetBytes)
+	{ // Open()
+	Close();
+
+	// check the file is there now, rather than failing quietly on the thread
+	std::ifstream inFile(FileName);
+	if (!inFile.good())
+		return false;
+
+	fileName = FileName;
+	xyScale = XYScale;
+	tileSize = std::max(TileSize, 1);
+	budgetBytes = BudgetBytes;
+	stopping = false;
+	loader = std::thread(&TerrainTileStore::Run, this);
+	return true;
+	} // Open()
+
+// stop loading and forget everything
+void TerrainTileStore::Close()
+	{ // Close()
+	if (loader.joinable())
+		{ // running
+		{ // lock
+		std::lock_guard<std::mutex> guard(mutex);
+		stopping = true;
+		} // lock
+		wake.notify_all();
+		loader.join();
+		} // running
+
+	ready = false;
+	nRows = nColumns = tileRows = tileColumns = overviewRows = overviewColumns = 0;
+	overview.clear();
+	rowOffsets.clear();
+	tiles.clear();
+	leastRecentlyUsed.clear();
+	requests.clear();
+	queuedTiles.clear();
+	scanBytes = 0;
+	residentBytes = 0;
+	tilesLoaded = tilesEvicted = tileQueries = overviewQueries = 0;
+	} // Close()
+
+// the loading thread: scan, then serve requests until stopped
+void TerrainTileStore::Run()
+	{ // Run()
+	// binary, so that the offsets we note can be sought back to on any platform
+	std::ifstream inFile(fileName.c_str(), std::ios::binary);
+	bool scanned = Scan(inFile);
+
+	// a failed read at the end of the scan leaves the stream unusable until cleared
+	inFile.clear();
+
+	std::unique_lock<std::mutex> guard(mutex);
+	// if the file could not be read there is nothing to serve, and nobody should wait for us
+	if (!scanned)
+		stopping = true;
+	else
+		ready = true;
+	wake.notify_all();
+	while (true)
+		{ // per request
+		wake.wait(guard, [this] { return stopping || !requests.empty(); });
+		if (stopping)
+			return;
+		long tile = requests.front();
+
+		// read without holding the lock, so that queries are not held up by the disk
+		guard.unlock();
+		TerrainTile loaded;
+		ReadTile(inFile, tile, loaded);
+		guard.lock();
+
+		requests.pop_front();
+		queuedTiles.erase(tile);
+		size_t bytes = loaded.heights.size() * sizeof(float);
+		leastRecentlyUsed.push_front(tile);
+		loaded.lastUse = leastRecentlyUsed.begin();
+		tiles[tile] = std::move(loaded);
+		residentBytes += bytes;
+		tilesLoaded++;
+
+		// then drop the tiles used longest ago, but never the one just read
+		while (scanBytes + residentBytes > budgetBytes && leastRecentlyUsed.size() > 1)
+			{ // over budget
+			long oldest = leastRecentlyUsed.back();
+			leastRecentlyUsed.pop_back();
+			residentBytes -= tiles[oldest].heights.size() * sizeof(float);
+			tiles.erase(oldest);
+			tilesEvicted++;
+			} // over budget
+
+		// let WaitUntilIdle() know when the queue empties
+		if (requests.empty())
+			wake.notify_all();
+		} // per request
+	} // Run()
+
+// read the file once, filling in the sizes, the offsets and the overview
+bool TerrainTileStore::Scan(std::ifstream &inFile)
+	{ // Scan()
+	long height = 0, width = 0;
+	inFile >> height >> width;
+	if (!inFile || height < 2 || width < 2)
+		return false;
+
+	long rowTiles = (height - 1 + tileSize - 1) / tileSize;
+	long columnTiles = (width - 1 + tileSize - 1) / tileSize;
+	long rowsKept = (height - 1) / overviewStep + 1;
+	long columnsKept = (width - 1) / overviewStep + 1;
+	std::vector<std::streamoff> offsets(height * columnTiles);
+	std::vector<float> coarse(rowsKept * columnsKept);
+
+	for (long row = 0; row < height; row++)
+		{ // per row
+		// checking now and then is enough to stop promptly
+		if (stopping)
+			return false;
+		for (long col = 0; col < width; col++)
+			{ // per value
+			// note where each tile starts, skipping the whitespace first so the offset is exact
+			if (col % tileSize == 0 && col / tileSize < columnTiles)
+				{ // tile start
+				inFile >> std::ws;
+				offsets[row * columnTiles + col / tileSize] = inFile.tellg();
+				} // tile start
+			float value = 0.0f;
+			inFile >> value;
+			if (row % overviewStep == 0 && col % overviewStep == 0)
+				coarse[(row / overviewStep) * columnsKept + col / overviewStep] = value;
+			} // per value
+		} // per row
+
+	// publish the results: nothing reads them until ready is set
+	nRows = height;
+	nColumns = width;
+	tileRows = rowTiles;
+	tileColumns = columnTiles;
+	overviewRows = rowsKept;
+	overviewColumns = columnsKept;
+	rowOffsets.swap(offsets);
+	overview.swap(coarse);
+	scanBytes = overview.size() * sizeof(float) + rowOffsets.size() * sizeof(std::streamoff);
+	return true;
+	} // Scan()
+
+// read one tile from the file
+void TerrainTileStore::ReadTile(std::ifstream &inFile, long tile, TerrainTile &result)
+	{ // ReadTile()
+	long firstRow = (tile / tileColumns) * tileSize, firstColumn = (tile % tileColumns) * tileSize;
+	long lastRow = std::min(firstRow + tileSize, nRows - 1), lastColumn = std::min(firstColumn + tileSize, nColumns - 1);
+	result.nColumns = lastColumn - firstColumn + 1;
+	result.heights.resize((lastRow - firstRow + 1) * result.nColumns);
+	for (long row = firstRow; row <= lastRow; row++)
+		{ // per row
+		// the overlap column may belong to the next tile, but it follows on in the file
+		inFile.seekg(rowOffsets[row * tileColumns + tile % tileColumns]);
+		float *out = &result.heights[(row - firstRow) * result.nColumns];
+		for (long col = 0; col < result.nColumns; col++)
+			inFile >> out[col];
+		} // per row
+	} // ReadTile()
+
+// queue a tile if it is neither in memory nor already queued
+void TerrainTileStore::Request(long tile)
+	{ // Request()
+	if (tiles.count(tile) != 0 || !queuedTiles.insert(tile).second)
+		return;
+	requests.push_back(tile);
+	wake.notify_all();
+	} // Request()
+
+// interpolate in a grid of heights, with the same two triangles per square as the terrain mesh
+static float InterpolateSquare(const float *upper, const float *lower, float u, float v)
+	{ // InterpolateSquare()
+	// upper[0] is the upper left corner, lower[1] the lower right, and the diagonal joins them
+	if (u >= v)
+		return (1.0f - u) * upper[0] + (u - v) * upper[1] + v * lower[1];
+	else
+		return (1.0f - v) * upper[0] + (v - u) * lower[0] + u * lower[1];
+	} // InterpolateSquare()
+
+// the height at (x, y), from a tile if one is in memory, otherwise from the overview
+float TerrainTileStore::getHeight(float x, float y)
+	{ // getHeight()
+	if (!ready)
+		return 0.0f;
+
+	// the sizes are read without the lock: Scan() wrote them before setting ready, and they do not
+	// change again until Close(), which must not be called while queries are still being made
+	// (the same holds for the overview, further down)
+
+	// the same placement as Terrain::getHeight(): columns along x and rows down y from the middle,
+	// clamped so that positions off the edge take the height at the edge
+	float column = x / xyScale + nColumns / 2;
+	float row = (nRows - 1) - nRows / 2 - y / xyScale;
+	column = std::min(std::max(column, 0.0f), (float) (nColumns - 1));
+	row = std::min(std::max(row, 0.0f), (float) (nRows - 1));
+
+	// the square the point is in, keeping the last row and column inside a square
+	long squareRow = std::min((long) row, nRows - 2), squareColumn = std::min((long) column, nColumns - 2);
+	long tile = (squareRow / tileSize) * tileColumns + squareColumn / tileSize;
+
+	std::lock_guard<std::mutex> guard(mutex);
+	std::map<long, TerrainTile>::iterator found = tiles.find(tile);
+	if (found != tiles.end())
+		{ // from the tile
+		TerrainTile &resident = found->second;
+		leastRecentlyUsed.splice(leastRecentlyUsed.begin(), leastRecentlyUsed, resident.lastUse);
+		tileQueries++;
+		long localRow = squareRow - (squareRow / tileSize) * tileSize;
+		long localColumn = squareColumn - (squareColumn / tileSize) * tileSize;
+		const float *upper = &resident.heights[localRow * resident.nColumns + localColumn];
+		return InterpolateSquare(upper, upper + resident.nColumns, column - squareColumn, row - squareRow);
+		} // from the tile
+
+	// not here yet, so ask for it and make do with the overview
+	Request(tile);
+	overviewQueries++;
+	float coarseRow = row / overviewStep, coarseColumn = column / overviewStep;
+	long overviewRow = std::min((long) coarseRow, overviewRows - 2), overviewColumn = std::min((long) coarseColumn, overviewColumns - 2);
+	if (overviewRow < 0 || overviewColumn < 0)
+		return overview[0];
+	// past the last overview sample, hold the edge value rather than extrapolate
+	float u = std::min(coarseColumn - overviewColumn, 1.0f), v = std::min(coarseRow - overviewRow, 1.0f);
+	const float *upper = &overview[overviewRow * overviewColumns + overviewColumn];
+	return InterpolateSquare(upper, upper + overviewColumns, u, v);
+	} // getHeight()
+
+// ask for every tile within radius of (x, y), nearest first
+void TerrainTileStore::RequestTilesAround(float x, float y, float radius)
+	{ // RequestTilesAround()
+	if (!ready)
+		return;
+
+	// the tile the point is in, in the same grid coordinates as getHeight()
+	float column = x / xyScale + nColumns / 2;
+	float row = (nRows - 1) - nRows / 2 - y / xyScale;
+	float tileWidth = xyScale * tileSize;
+	long centreRow = (long) floor(row / tileSize), centreColumn = (long) floor(column / tileSize);
+	// no further than the far side of the grid, however large the radius
+	long reach = (long) ceil(radius / tileWidth);
+	reach = std::min(reach, std::max(std::max(centreRow, tileRows - 1 - centreRow), std::max(centreColumn, tileColumns - 1 - centreColumn)));
+
+	// rings outward from the centre, so that the nearest tiles are read first
+	std::lock_guard<std::mutex> guard(mutex);
+	for (long ring = 0; ring <= reach; ring++)
+		for (long tileRow = std::max(centreRow - ring, 0L); tileRow <= std::min(centreRow + ring, tileRows - 1); tileRow++)
+			for (long tileColumn = std::max(centreColumn - ring, 0L); tileColumn <= std::min(centreColumn + ring, tileColumns - 1); tileColumn++)
+				{ // per tile in the ring
+				if (std::max(labs(tileRow - centreRow), labs(tileColumn - centreColumn)) != ring)
+					continue;
+				long tile = tileRow * tileColumns + tileColumn;
+				std::map<long, TerrainTile>::iterator found = tiles.find(tile);
+				// tiles still wanted count as used, so they are not the next to go
+				if (found != tiles.end())
+					leastRecentlyUsed.splice(leastRecentlyUsed.begin(), leastRecentlyUsed, found->second.lastUse);
+				else
+					Request(tile);
+				} // per tile in the ring
+	} // RequestTilesAround()
+
+// wait until the scan is done and every request has been served
+void TerrainTileStore::WaitUntilIdle()
+	{ // WaitUntilIdle()
+	std::unique_lock<std::mutex> guard(mutex);
+	wake.wait(guard, [this] { return stopping || (ready && requests.empty()); });
+	} // WaitUntilIdle()
+
+// bytes of height values held, in tiles and in the overview
+size_t TerrainTileStore::MemoryBytes()
+	{ // MemoryBytes()
+	std::lock_guard<std::mutex> guard(mutex);
+	return residentBytes + scanBytes;
+	} // MemoryBytes()
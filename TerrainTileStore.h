@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TerrainTileStore.h
+//	------------------------
+//
+//	Heights from a .dem file too large to read in whole.
+//	A background thread scans the file once, noting where
+//	each tile starts in every row and keeping a coarse
+//	overview of the heights. After that, square tiles are
+//	read on the same thread as they are requested, and the
+//	least recently used are dropped to stay in a budget,
+//	which counts the offsets and the overview as well as
+//	the tiles.
+//
+//	getHeight() can be called at any time: where the tile
+//	is not in memory yet it answers from the overview,
+//	and until the scan is done it answers 0.
+//
+///////////////////////////////////////////////////
+
+#ifndef _TERRAIN_TILE_STORE_H
+#define _TERRAIN_TILE_STORE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a square of heights, with one row and column of overlap so that it can be interpolated on its own
+class TerrainTile
+	{ // class TerrainTile
+	public:
+	// the heights, row by row, and how many there are across
+	std::vector<float> heights;
+	long nColumns;
+
+	// where the tile sits in the least recently used list
+	std::list<long>::iterator lastUse;
+	}; // class TerrainTile
+
+class TerrainTileStore
+	{ // class TerrainTileStore
+	public:
+	// the file, and the xy scale to place it with, as ReadFileTerrainData() takes
+	std::string fileName;
+	float xyScale;
+
+	// grid squares along each side of a tile, and the most bytes to keep: the offsets and the
+	// overview come out of this first, and the tiles have what is left
+	int tileSize;
+	size_t budgetBytes;
+
+	// every overviewStep-th row and column is kept in the overview
+	int overviewStep;
+
+	// everything below is filled in by the scan, and only read once ready is set
+	std::atomic<bool> ready;
+	long nRows, nColumns;
+	long tileRows, tileColumns;
+	long overviewRows, overviewColumns;
+	std::vector<float> overview;
+
+	// for each row of the file, where each tile's first value on that row starts
+	std::vector<std::streamoff> rowOffsets;
+
+	// bytes of the budget taken by the overview and the offsets, which grow with the file
+	size_t scanBytes;
+
+	// everything below is shared with the loading thread, and guarded by mutex
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::map<long, TerrainTile> tiles;
+	std::list<long> leastRecentlyUsed;
+	std::deque<long> requests;
+	// the same tiles as requests, to find whether one is already queued
+	std::set<long> queuedTiles;
+	size_t residentBytes;
+
+	// set to stop the loading thread, or by it if the file could not be read
+	std::atomic<bool> stopping;
+
+	// counters: tiles read and dropped, and queries answered from tiles or from the overview
+	long tilesLoaded, tilesEvicted;
+	long tileQueries, overviewQueries;
+
+	// the thread that scans the file and then loads tiles
+	std::thread loader;
+
+	// constructor will initialise to safe values
+	TerrainTileStore();
+
+	// stops the loading thread
+	~TerrainTileStore();
+
+	// start scanning the file in the background: returns false if it cannot be opened
+	bool Open(const char *FileName, float XYScale, int TileSize = 128, size_t BudgetBytes = 64 << 20);
+
+	// stop loading and forget everything
+	void Close();
+
+	// the height at (x, y), placed as Terrain::getHeight() places it: from a tile if
+	// one is in memory, otherwise from the overview (and the tile is asked for)
+	float getHeight(float x, float y);
+
+	// ask for every tile within radius of (x, y), nearest first
+	void RequestTilesAround(float x, float y, float radius);
+
+	// wait until the scan is done and every request has been served
+	void WaitUntilIdle();
+
+	// bytes of height values held, in tiles and in the overview
+	size_t MemoryBytes();
+
+	private:
+	// the loading thread: scan, then serve requests until stopped
+	void Run();
+
+	// read the file once, filling in the sizes, the offsets and the overview
+	bool Scan(std::ifstream &inFile);
+
+	// read one tile from the file
+	void ReadTile(std::ifstream &inFile, long tile, TerrainTile &result);
+
+	// queue a tile if it is neither in memory nor already queued (mutex must be held)
+	void Request(long tile);
+	}; // class TerrainTileStore
+
+#endif
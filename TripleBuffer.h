@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TripleBuffer.h
+//	------------------------
+//
+//	Hands whole values from one thread that writes them to
+//	one thread that reads them, without either waiting for
+//	the other. There are three slots: the writer fills its
+//	own and swaps it into the middle, and the reader swaps
+//	the middle for its own whenever it holds something
+//	newer. Neither ever touches the slot the other holds,
+//	so the reader always sees a complete value, and simply
+//	keeps the last one if nothing newer has arrived.
+//
+//	Slots are reused, so a T that holds vectors keeps their
+//	storage from one write to the next.
+//
+///////////////////////////////////////////////////
+
+#ifndef _TRIPLE_BUFFER_H
+#define _TRIPLE_BUFFER_H
+
+#include <atomic>
+
+template <class T> class TripleBuffer
+	{ // class TripleBuffer
+	public:
+	// constructor will initialise to safe values: the reader starts with a default T
+	TripleBuffer()
+		:
+		writeSlot(0),
+		middle(1),
+		readSlot(2)
+		{ // constructor
+		} // constructor
+
+	// the slot the writer fills: only the writer may call this
+	T &WriteBuffer()
+		{ // WriteBuffer()
+		return slots[writeSlot];
+		} // WriteBuffer()
+
+	// hand the slot just filled to the reader, and take back the one it will not read
+	void Publish()
+		{ // Publish()
+		// the release makes everything written to the slot visible to the reader's acquire
+		writeSlot = middle.exchange(writeSlot | FRESH, std::memory_order_acq_rel) & INDEX;
+		} // Publish()
+
+	// the newest value published: only the reader may call this, and the reference
+	// stays valid until it calls it again
+	const T &Read()
+		{ // Read()
+		// only swap if the middle holds something published since we last looked
+		if (middle.load(std::memory_order_relaxed) & FRESH)
+			readSlot = middle.exchange(readSlot, std::memory_order_acq_rel) & INDEX;
+		return slots[readSlot];
+		} // Read()
+
+	// a buffer belongs to the two threads that share it
+	TripleBuffer(const TripleBuffer &) = delete;
+	TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+	private:
+	// the middle holds a slot index, with FRESH set while the reader has not taken it
+	enum { INDEX = 3, FRESH = 4 };
+
+	T slots[3];
+	int writeSlot;
+	std::atomic<int> middle;
+	int readSlot;
+	}; // class TripleBuffer
+
+#endif
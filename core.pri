@@ -0,0 +1,50 @@
+# the platform-independent part of the project, shared by the
+# application and by the command-line tools under tools/
+INCLUDEPATH += $$PWD
+CONFIG += c++11 thread
+
+HEADERS += \
+	$$PWD/BakedClip.h \
+	$$PWD/BinaryDEM.h \
+	$$PWD/BoneRenderer.h \
+	$$PWD/BVHData.h \
+	$$PWD/Cartesian3.h \
+	$$PWD/Character.h \
+	$$PWD/CompressedClip.h \
+	$$PWD/FrameCapture.h \
+	$$PWD/FrameProfiler.h \
+	$$PWD/Frustum.h \
+	$$PWD/GLSupport.h \
+	$$PWD/Homogeneous4.h \
+	$$PWD/HomogeneousFaceSurface.h \
+	$$PWD/Matrix4.h \
+	$$PWD/ParallelFor.h \
+	$$PWD/Retarget.h \
+	$$PWD/SceneModel.h \
+	$$PWD/SkinnedMesh.h \
+	$$PWD/SPSCQueue.h \
+	$$PWD/Terrain.h \
+	$$PWD/TerrainTileStore.h \
+	$$PWD/TripleBuffer.h
+
+SOURCES += \
+	$$PWD/BakedClip.cpp \
+	$$PWD/BinaryDEM.cpp \
+	$$PWD/BoneRenderer.cpp \
+	$$PWD/BVHData.cpp \
+	$$PWD/Cartesian3.cpp \
+	$$PWD/Character.cpp \
+	$$PWD/CompressedClip.cpp \
+	$$PWD/FrameCapture.cpp \
+	$$PWD/FrameProfiler.cpp \
+	$$PWD/Frustum.cpp \
+	$$PWD/GLSupport.cpp \
+	$$PWD/Homogeneous4.cpp \
+	$$PWD/HomogeneousFaceSurface.cpp \
+	$$PWD/Matrix4.cpp \
+	$$PWD/ParallelFor.cpp \
+	$$PWD/Retarget.cpp \
+	$$PWD/SceneModel.cpp \
+	$$PWD/SkinnedMesh.cpp \
+	$$PWD/Terrain.cpp \
+	$$PWD/TerrainTileStore.cpp
@@ -12,6 +12,7 @@
 #include <QtWidgets/QApplication>
 #include "SceneModel.h"
 #include "AnimationCycleWidget.h"
+#include "FrameProfiler.h"
 #include <iostream>
 #include <string>
 
@@ -20,6 +21,9 @@ int main(int argc, char **argv)
 	// initialize QT
 	QApplication app(argc, argv);
 
+	// trace from startup if ANIMATION_TRACE asks us to, so that loading is included
+	FrameProfiler::StartTraceFromEnvironment();
+
 	//	create a window
 	try
 		{ // try block
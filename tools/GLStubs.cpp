@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	GLStubs.cpp
+//	------------------------
+//
+//	No-op definitions of the OpenGL entry points that the
+//	scene code calls, so that the command-line tools link
+//	and run without a driver, a GPU or an X server.
+//	Any GL call the tools make simply does nothing, which
+//	leaves only the CPU side of rendering to be measured.
+//
+//	When the scene code starts calling a new GL function,
+//	add a matching stub here.
+//
+///////////////////////////////////////////////////
+
+#include <cstddef>
+
+#include "GLSupport.h"
+
+// queries: no strings, so GLSupport reports no optional features
+const GLubyte * GLAPIENTRY glGetString(GLenum) { return NULL; }
+void GLAPIENTRY glGetFloatv(GLenum, GLfloat *) {}
+void GLAPIENTRY glGetIntegerv(GLenum, GLint *) {}
+
+// state
+void GLAPIENTRY glEnable(GLenum) {}
+void GLAPIENTRY glShadeModel(GLenum) {}
+void GLAPIENTRY glPushAttrib(GLbitfield) {}
+void GLAPIENTRY glPopAttrib() {}
+void GLAPIENTRY glClearColor(GLclampf, GLclampf, GLclampf, GLclampf) {}
+void GLAPIENTRY glClear(GLbitfield) {}
+
+// reading back: nothing is drawn, so nothing is read
+void GLAPIENTRY glPixelStorei(GLenum, GLint) {}
+void GLAPIENTRY glReadPixels(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, GLvoid *) {}
+
+// lighting & materials
+void GLAPIENTRY glLightfv(GLenum, GLenum, const GLfloat *) {}
+void GLAPIENTRY glMaterialfv(GLenum, GLenum, const GLfloat *) {}
+
+// immediate mode geometry
+void GLAPIENTRY glBegin(GLenum) {}
+void GLAPIENTRY glEnd() {}
+void GLAPIENTRY glNormal3fv(const GLfloat *) {}
+void GLAPIENTRY glVertex3fv(const GLfloat *) {}
+void GLAPIENTRY glVertex4fv(const GLfloat *) {}
+
+// display lists: there are none, so 0 is as good a name as any
+GLuint GLAPIENTRY glGenLists(GLsizei) { return 0; }
+void GLAPIENTRY glNewList(GLuint, GLenum) {}
+void GLAPIENTRY glEndList() {}
+void GLAPIENTRY glCallList(GLuint) {}
+void GLAPIENTRY glDeleteLists(GLuint, GLsizei) {}
+
+// matrices
+void GLAPIENTRY glMatrixMode(GLenum) {}
+void GLAPIENTRY glPushMatrix() {}
+void GLAPIENTRY glPopMatrix() {}
+void GLAPIENTRY glMultMatrixf(const GLfloat *) {}
+
+// vertex arrays
+void GLAPIENTRY glEnableClientState(GLenum) {}
+void GLAPIENTRY glDisableClientState(GLenum) {}
+void GLAPIENTRY glVertexPointer(GLint, GLenum, GLsizei, const GLvoid *) {}
+void GLAPIENTRY glNormalPointer(GLenum, GLsizei, const GLvoid *) {}
+void GLAPIENTRY glDrawArrays(GLenum, GLint, GLsizei) {}
+void GLAPIENTRY glDrawElements(GLenum, GLsizei, GLenum, const GLvoid *) {}
+
+#ifdef GL_SUPPORT_BUFFERS
+// buffer objects
+void GLAPIENTRY glGenBuffers(GLsizei, GLuint *) {}
+void GLAPIENTRY glDeleteBuffers(GLsizei, const GLuint *) {}
+void GLAPIENTRY glBindBuffer(GLenum, GLuint) {}
+void GLAPIENTRY glBufferData(GLenum, GLsizeiptr, const void *, GLenum) {}
+void GLAPIENTRY glBufferSubData(GLenum, GLintptr, GLsizeiptr, const void *) {}
+#endif
+
+#ifdef GL_SUPPORT_INSTANCING
+// shaders and instanced drawing
+GLuint GLAPIENTRY glCreateShader(GLenum) { return 0; }
+void GLAPIENTRY glShaderSource(GLuint, GLsizei, const GLchar *const *, const GLint *) {}
+void GLAPIENTRY glCompileShader(GLuint) {}
+void GLAPIENTRY glGetShaderiv(GLuint, GLenum, GLint *) {}
+void GLAPIENTRY glGetShaderInfoLog(GLuint, GLsizei, GLsizei *, GLchar *) {}
+void GLAPIENTRY glDeleteShader(GLuint) {}
+GLuint GLAPIENTRY glCreateProgram() { return 0; }
+void GLAPIENTRY glAttachShader(GLuint, GLuint) {}
+void GLAPIENTRY glBindAttribLocation(GLuint, GLuint, const GLchar *) {}
+void GLAPIENTRY glLinkProgram(GLuint) {}
+void GLAPIENTRY glGetProgramiv(GLuint, GLenum, GLint *) {}
+void GLAPIENTRY glDeleteProgram(GLuint) {}
+void GLAPIENTRY glUseProgram(GLuint) {}
+void GLAPIENTRY glEnableVertexAttribArray(GLuint) {}
+void GLAPIENTRY glDisableVertexAttribArray(GLuint) {}
+void GLAPIENTRY glVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void *) {}
+void GLAPIENTRY glVertexAttribDivisor(GLuint, GLuint) {}
+void GLAPIENTRY glDrawArraysInstanced(GLenum, GLint, GLsizei, GLsizei) {}
+#endif
@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	SyntheticBody.cpp
+//	------------------------
+//
+//	Writes a stand-in body for a skeleton in the OBJ format.
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "SyntheticBody.h"
+
+// write a body of about the given number of vertices to the named file
+bool WriteSyntheticBody(const char* fileName, BVHData& skeleton, long vertices)
+	{ // WriteSyntheticBody()
+	// the joints where the rest pose puts them, in the file's units
+	long nJoints = (long) skeleton.all_joints.size();
+	std::vector<Cartesian3> restRotations(nJoints, Cartesian3(0, 0, 0));
+	std::vector<Matrix4> restTransforms;
+	skeleton.EvaluatePose(restRotations, Matrix4::Identity(), 1.0f, restTransforms);
+	long nBones = 0;
+	for (long joint = 0; joint < nJoints; joint++)
+		if (skeleton.parentBones[joint] != -1)
+			nBones++;
+	if (nBones == 0)
+		return false;
+
+	// share the vertices out between the bones, as rings of vertices along each
+	long perBone = std::max(vertices / nBones, 12L);
+	int slices = std::max(6, (int) sqrt(perBone / 2.0));
+	int rings = std::max(2, (int) (perBone / slices));
+
+	FILE* outFile = fopen(fileName, "w");
+	if (outFile == NULL)
+		return false;
+	fprintf(outFile, "# a tube round each of %ld bones, %d rings of %d vertices each\n", nBones, rings, slices);
+	long written = 0;
+	for (long joint = 0; joint < nJoints; joint++)
+		{ // per bone
+		int parent = skeleton.parentBones[joint];
+		if (parent == -1)
+			continue;
+		Cartesian3 start = restTransforms[parent] * Cartesian3(0, 0, 0);
+		Cartesian3 along = restTransforms[joint] * Cartesian3(0, 0, 0) - start;
+		float length = along.length();
+		if (length == 0.0f)
+			along = Cartesian3(0, 1, 0);
+
+		// thick bones are long ones, though not too thick, nor too thin to see
+		float radius = std::min(std::max(0.18f * length, 0.6f), 7.0f);
+		Cartesian3 axis = along.unit();
+		Cartesian3 across = axis.cross(fabs(axis.x) < 0.9f ? Cartesian3(1, 0, 0) : Cartesian3(0, 1, 0)).unit();
+		Cartesian3 around = axis.cross(across);
+		for (int ring = 0; ring < rings; ring++)
+			for (int slice = 0; slice < slices; slice++)
+				{ // per vertex
+				float angle = 2.0f * (float) M_PI * slice / slices;
+				Cartesian3 out = across * cosf(angle) + around * sinf(angle);
+				Cartesian3 position = start + along * ((float) ring / (rings - 1)) + out * radius;
+				fprintf(outFile, "v %f %f %f\nvn %f %f %f\n", position.x, position.y, position.z, out.x, out.y, out.z);
+				} // per vertex
+
+		// quads between neighbouring rings, wound to face outwards
+		for (int ring = 0; ring + 1 < rings; ring++)
+			for (int slice = 0; slice < slices; slice++)
+				{ // per quad
+				long corners[4] =
+					{
+					written + ring * slices + slice,
+					written + ring * slices + (slice + 1) % slices,
+					written + (ring + 1) * slices + (slice + 1) % slices,
+					written + (ring + 1) * slices + slice
+					};
+				fprintf(outFile, "f %ld//%ld %ld//%ld %ld//%ld %ld//%ld\n", corners[0] + 1, corners[0] + 1, corners[1] + 1, corners[1] + 1,
+					corners[2] + 1, corners[2] + 1, corners[3] + 1, corners[3] + 1);
+				} // per quad
+		written += (long) rings * slices;
+		} // per bone
+	bool good = !ferror(outFile);
+	fclose(outFile);
+	return good;
+	} // WriteSyntheticBody()
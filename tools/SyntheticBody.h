@@ -0,0 +1,23 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	SyntheticBody.h
+//	------------------------
+//
+//	Writes a stand-in body for a skeleton in the OBJ format:
+//	a tube round every bone of the rest pose, of any number
+//	of vertices, so that the tools can measure skinning
+//	without a modelled character.
+//
+///////////////////////////////////////////////////
+
+#ifndef _SYNTHETIC_BODY_H
+#define _SYNTHETIC_BODY_H
+
+#include "BVHData.h"
+
+// write a body of about the given number of vertices, in the skeleton's units and rest pose,
+// to the named file: returns false if it cannot be written
+bool WriteSyntheticBody(const char* fileName, BVHData& skeleton, long vertices);
+
+#endif
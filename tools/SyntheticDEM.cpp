@@ -0,0 +1,31 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	SyntheticDEM.cpp
+//	------------------------
+//
+//	Writes a rolling landscape of any size in the .dem
+//	text format.
+//
+///////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstdio>
+
+#include "SyntheticDEM.h"
+
+// write rows x columns heights to the named file
+bool WriteSyntheticDEM(const char* fileName, long rows, long columns)
+	{ // WriteSyntheticDEM()
+	FILE* outFile = fopen(fileName, "w");
+	if (outFile == NULL)
+		return false;
+	fprintf(outFile, "%ld\t%ld\n", rows, columns);
+	for (long row = 0; row < rows; row++)
+		{ // per row
+		for (long col = 0; col < columns; col++)
+			fprintf(outFile, "%f%c", 3.0 * sin(0.31 * col) * cos(0.17 * row) + 0.5 * sin(0.053 * (row + col)), col + 1 < columns ? '\t' : '\n');
+		} // per row
+	fclose(outFile);
+	return true;
+	} // WriteSyntheticDEM()
@@ -0,0 +1,19 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	SyntheticDEM.h
+//	------------------------
+//
+//	Writes a rolling landscape of any size in the .dem
+//	text format, so that the tools can measure grids far
+//	larger than the one we ship.
+//
+///////////////////////////////////////////////////
+
+#ifndef _SYNTHETIC_DEM_H
+#define _SYNTHETIC_DEM_H
+
+// write rows x columns heights to the named file: returns false if it cannot be written
+bool WriteSyntheticDEM(const char* fileName, long rows, long columns);
+
+#endif
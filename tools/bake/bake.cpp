@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	bake.cpp
+//	------------------------
+//
+//	Loads each BVH clip given on the command line, bakes
+//	every frame to joint positions and orientations, and
+//	writes the result next to the input as a .bake file.
+//	Reports bake throughput, the cost of playing the baked
+//	clip back against evaluating the hierarchy live, and the
+//	largest difference between the joint transforms rebuilt
+//	from the baked clip and those evaluated live.
+//	GL is stubbed out, so only the CPU cost is measured.
+//
+//	usage: bake [-s scale] file.bvh ...
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "BVHData.h"
+#include "BakedClip.h"
+
+// the clips we ship, used when no files are given
+static const char* defaultClips[] =
+	{ // defaultClips
+	"./models/stand.bvh",
+	"./models/walking.bvh",
+	"./models/fast_run.bvh",
+	"./models/veer_left.bvh",
+	"./models/veer_right.bvh"
+	}; // defaultClips
+
+// how many frames to play back when timing
+static const int playbackFrames = 20000;
+
+// seconds since a time point
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+	{ // SecondsSince()
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} // SecondsSince()
+
+int main(int argc, char **argv)
+	{ // main()
+	// the application draws characters at a tenth of the size in the file
+	float scale = 0.1f;
+	std::vector<std::string> fileNames;
+
+	// parse the command line
+	for (int arg = 1; arg < argc; arg++)
+		{ // per argument
+		if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+			scale = atof(argv[++arg]);
+		else
+			fileNames.push_back(argv[arg]);
+		} // per argument
+	if (fileNames.empty())
+		fileNames.assign(defaultClips, defaultClips + sizeof(defaultClips) / sizeof(defaultClips[0]));
+
+	printf("%-28s %7s %10s %14s %10s %12s %12s %12s %12s %10s\n", "clip", "frames", "bake ms", "frames / s", "bytes", "live pose us", "baked pose us", "live draw us", "baked draw us", "max err");
+
+	Matrix4 viewMatrix = Matrix4::Identity();
+	for (size_t file = 0; file < fileNames.size(); file++)
+		{ // per file
+		BVHData clip;
+		if (!clip.ReadFileBVH(fileNames[file].c_str()) || clip.frame_count <= 0)
+			{ // failed to read
+			printf("%-28s unable to read\n", fileNames[file].c_str());
+			continue;
+			} // failed to read
+
+		// bake, repeating short clips so that the timing means something
+		BakedClip baked;
+		int bakeRepeats = 1 + 2000 / clip.frame_count;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int repeat = 0; repeat < bakeRepeats; repeat++)
+			baked.Bake(clip, scale);
+		double bakeSeconds = SecondsSince(start) / bakeRepeats;
+
+		// write it out next to the input, and check that it reads back
+		std::string outName = fileNames[file];
+		size_t dot = outName.find_last_of('.');
+		if (dot != std::string::npos)
+			outName = outName.substr(0, dot);
+		outName += ".bake";
+		BakedClip reread;
+		if (!baked.WriteFileBaked(outName.c_str()) || !reread.ReadFileBaked(outName.c_str()) || reread.joints.size() != baked.joints.size())
+			{ // failed to write
+			printf("%-28s unable to write %s\n", fileNames[file].c_str(), outName.c_str());
+			continue;
+			} // failed to write
+		size_t bytes = 6 * sizeof(int) + baked.parentBones.size() * sizeof(int) + baked.joints.size() * sizeof(BakedJoint);
+
+		// the baked orientations and positions must give back the transforms the hierarchy does
+		std::vector<Matrix4> pose, bakedPose;
+		float maxError = 0.0f;
+		for (int frame = 0; frame < clip.frame_count; frame++)
+			{ // per frame
+			clip.EvaluatePose(clip.boneRotations[frame], Matrix4::Identity(), scale, pose);
+			reread.JointTransforms(frame, bakedPose);
+			for (size_t joint = 0; joint < pose.size(); joint++)
+				for (int row = 0; row < 3; row++)
+					for (int column = 0; column < 4; column++)
+						maxError = std::max(maxError, (float) fabs(pose[joint][row][column] - bakedPose[joint][row][column]));
+			} // per frame
+
+		// pose cost: evaluating the hierarchy against rebuilding each joint's transform from its baked copy
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < playbackFrames; frame++)
+			clip.EvaluatePose(clip.boneRotations[frame % clip.frame_count], Matrix4::Identity(), scale, pose);
+		double livePose = SecondsSince(start);
+
+		float checksum = 0.0f;
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < playbackFrames; frame++)
+			{ // per frame
+			reread.JointTransforms(frame, bakedPose);
+			checksum += bakedPose[0][1][3];
+			} // per frame
+		double bakedPoseSeconds = SecondsSince(start);
+
+		// draw cost: the full render path, including the bone cylinders
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < playbackFrames; frame++)
+			clip.Render(viewMatrix, scale, frame, 0.0f);
+		double liveDraw = SecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < playbackFrames; frame++)
+			reread.Render(viewMatrix, frame, 0.0f);
+		double bakedDraw = SecondsSince(start);
+
+		printf("%-28s %7d %10.3f %14.0f %10zu %12.3f %12.3f %12.3f %12.3f %10.6f\n", fileNames[file].c_str(), clip.frame_count, 1E3 * bakeSeconds, clip.frame_count / bakeSeconds, bytes,
+			1E6 * livePose / playbackFrames, 1E6 * bakedPoseSeconds / playbackFrames, 1E6 * liveDraw / playbackFrames, 1E6 * bakedDraw / playbackFrames, maxError);
+
+		// keep the lookup loop from being optimised away
+		if (checksum == 12345.678f)
+			printf(" ");
+		} // per file
+
+	return 0;
+	} // main()
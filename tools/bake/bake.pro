@@ -0,0 +1,7 @@
+# bakes clips to world-space joint transforms and compares playback costs
+TEMPLATE = app
+TARGET = bake
+
+include(../tools.pri)
+
+SOURCES += bake.cpp
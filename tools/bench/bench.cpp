@@ -0,0 +1,850 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	bench.cpp
+//	------------------------
+//
+//	Micro-benchmarks for the parts of the code whose speed
+//	we care about: the BVH parser, pose evaluation and
+//	blending, skinning, Matrix4 arithmetic and the terrain. GL is
+//	stubbed out, so render cases measure only CPU work.
+//
+//	Each case is run for a fixed time, repeated several
+//	times, and reported as nanoseconds per operation. The
+//	results are written as JSON, so that two runs can be
+//	diffed, and a table is printed to stderr.
+//
+//	Before anything is timed, the walking clip is written
+//	out again as a second rig that differs from the bundled
+//	one, and the joint mapping is checked both ways: if a
+//	joint is matched wrongly, bench fails.
+//
+//	usage: bench [-o results.json] [-f filter] [-t seconds] [-r repeats]
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SceneModel.h"
+#include "FrameProfiler.h"
+#include "SyntheticBody.h"
+
+// the clips we ship
+static const char* clipNames[] =
+	{ // clipNames
+	"stand",
+	"walking",
+	"fast_run",
+	"veer_left",
+	"veer_right"
+	}; // clipNames
+static const int nClips = sizeof(clipNames) / sizeof(clipNames[0]);
+
+// the terrain we ship
+static const char* terrainFileName = "./models/randomland.dem";
+
+// the synthetic body the skinning cases skin, of about this many vertices
+static const char* bodyFileName = "bench-body.obj";
+static const long bodyVertices = 10000;
+
+// the second rig the retarget check and blend case use, written from the walking clip with this joint dropped
+static const char* rigFileName = "bench-rig.bvh";
+static const int rigClip = 1;
+static const char* rigDroppedJoint = "HeadTop_End";
+
+// results are fed in here so that the compiler cannot drop the work
+static volatile float benchmarkSink;
+
+// a single case: run() performs the operation the given number of times
+class Benchmark
+	{ // class Benchmark
+	public:
+	std::string name;
+	std::function<void(long)> run;
+
+	Benchmark(const std::string& Name, std::function<void(long)> Run)
+		: name(Name), run(Run)
+		{ // constructor
+		} // constructor
+	}; // class Benchmark
+
+// the measurements for one case
+class BenchmarkResult
+	{ // class BenchmarkResult
+	public:
+	std::string name;
+	long iterations;
+	std::vector<double> nsPerOp;
+	}; // class BenchmarkResult
+
+// seconds taken to run a case for a number of iterations
+static double TimeRun(Benchmark& benchmark, long iterations)
+	{ // TimeRun()
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	benchmark.run(iterations);
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} // TimeRun()
+
+// measure a case: calibrate the iteration count, then take several samples
+static BenchmarkResult Measure(Benchmark& benchmark, double secondsPerCase, int repeats)
+	{ // Measure()
+	// double the iterations until a run takes long enough to time reliably
+	double sampleSeconds = secondsPerCase / repeats;
+	long iterations = 1;
+	double seconds = TimeRun(benchmark, iterations);
+	while (seconds < 0.2 * sampleSeconds && iterations < (1L << 40))
+		{ // too quick
+		iterations *= 2;
+		seconds = TimeRun(benchmark, iterations);
+		} // too quick
+	// then scale to the sample length
+	if (seconds > 0.0)
+		iterations = std::max(1L, (long) (iterations * sampleSeconds / seconds));
+
+	BenchmarkResult result;
+	result.name = benchmark.name;
+	result.iterations = iterations;
+	for (int repeat = 0; repeat < repeats; repeat++)
+		result.nsPerOp.push_back(1E9 * TimeRun(benchmark, iterations) / iterations);
+	return result;
+	} // Measure()
+
+// the median of a set of samples
+static double Median(std::vector<double> values)
+	{ // Median()
+	std::sort(values.begin(), values.end());
+	size_t middle = values.size() / 2;
+	return (values.size() % 2) ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+	} // Median()
+
+// write the results as JSON
+static void WriteJSON(FILE* outFile, const std::vector<BenchmarkResult>& results, double secondsPerCase, int repeats)
+	{ // WriteJSON()
+	fprintf(outFile, "{\n");
+	fprintf(outFile, "  \"context\": {\n");
+	fprintf(outFile, "    \"timestamp\": %ld,\n", (long) time(NULL));
+#ifdef __VERSION__
+	fprintf(outFile, "    \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+	fprintf(outFile, "    \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+	fprintf(outFile, "    \"seconds_per_case\": %g,\n", secondsPerCase);
+	fprintf(outFile, "    \"repeats\": %d\n", repeats);
+	fprintf(outFile, "  },\n");
+	fprintf(outFile, "  \"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); i++)
+		{ // per result
+		const BenchmarkResult& result = results[i];
+		fprintf(outFile, "    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.3f, \"ns_per_op_min\": %.3f, \"samples\": [",
+			result.name.c_str(), result.iterations, Median(result.nsPerOp), *std::min_element(result.nsPerOp.begin(), result.nsPerOp.end()));
+		for (size_t sample = 0; sample < result.nsPerOp.size(); sample++)
+			fprintf(outFile, "%s%.3f", sample ? ", " : "", result.nsPerOp[sample]);
+		fprintf(outFile, "]}%s\n", (i + 1 < results.size()) ? "," : "");
+		} // per result
+	fprintf(outFile, "  ]\n");
+	fprintf(outFile, "}\n");
+	} // WriteJSON()
+
+// the path of a bundled clip
+static std::string ClipPath(int clip)
+	{ // ClipPath()
+	return std::string("./models/") + clipNames[clip] + ".bvh";
+	} // ClipPath()
+
+// a second rig for a clip, written to a file: every bundled clip shares one rig, so this is what blending
+// onto a rig that differs is checked and measured against. The joints are renamed into another namespace
+// and case, the left forearm and hand are renamed beyond recognition so that only their child slots can
+// match them, every bone is a fifth longer, and the joint dropped (with its channels) shifts the ids after it
+static bool WriteSecondRig(const char* inName, const char* outName, const std::string& dropped)
+	{ // WriteSecondRig()
+	std::ifstream inFile(inName);
+	FILE* outFile = fopen(outName, "w");
+	if (!inFile.good() || outFile == NULL)
+		{ // failed
+		if (outFile)
+			fclose(outFile);
+		return false;
+		} // failed
+
+	// where the dropped joint's channels start in each frame, and how many it has
+	long columns = 0, droppedColumn = -1, droppedChannels = 0;
+	int droppedDepth = 0, renamed = 0;
+	bool dropping = false, motion = false;
+	std::string line, indent;
+	while (std::getline(inFile, line))
+		{ // per line
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		std::istringstream tokens(line);
+		std::string keyword;
+		tokens >> keyword;
+
+		if (motion)
+			{ // motion
+			if (keyword == "Frames:" || keyword == "Frame")
+				fprintf(outFile, "%s\n", line.c_str());
+			else if (!keyword.empty())
+				{ // a frame
+				std::istringstream values(line);
+				std::string value;
+				const char* separator = "";
+				for (long column = 0; values >> value; column++)
+					if (column < droppedColumn || column >= droppedColumn + droppedChannels)
+						{ // kept
+						fprintf(outFile, "%s%s", separator, value.c_str());
+						separator = " ";
+						} // kept
+				fprintf(outFile, "\n");
+				} // a frame
+			} // motion
+		else if (dropping)
+			{ // inside the dropped joint
+			if (keyword == "{")
+				droppedDepth++;
+			else if (keyword == "CHANNELS")
+				tokens >> droppedChannels;
+			else if (keyword == "OFFSET" && droppedDepth == 1)
+				{ // its offset, which the end site left in its place keeps
+				float x, y, z;
+				tokens >> x >> y >> z;
+				fprintf(outFile, "%sEnd Site\n%s{\n%s\tOFFSET %f %f %f\n%s}\n", indent.c_str(), indent.c_str(), indent.c_str(), 1.2f * x, 1.2f * y, 1.2f * z, indent.c_str());
+				} // its offset
+			else if (keyword == "}" && --droppedDepth == 0)
+				dropping = false;
+			} // inside the dropped joint
+		else if (keyword == "ROOT" || keyword == "JOINT")
+			{ // a joint
+			std::string name;
+			tokens >> name;
+			std::string base = name.substr(name.find_last_of(':') + 1);
+			indent = line.substr(0, line.find(keyword));
+			if (base == dropped)
+				{ // dropped
+				dropping = true;
+				droppedColumn = columns;
+				continue;
+				} // dropped
+			if (base == "LeftForeArm" || base.compare(0, 8, "LeftHand") == 0)
+				base = "bone" + std::to_string(renamed++);
+			else
+				for (size_t i = 0; i < base.size(); i++)
+					base[i] = toupper((unsigned char) base[i]);
+			fprintf(outFile, "%s%s Rig2:%s\n", indent.c_str(), keyword.c_str(), base.c_str());
+			} // a joint
+		else if (keyword == "CHANNELS")
+			{ // channels
+			long count;
+			tokens >> count;
+			columns += count;
+			fprintf(outFile, "%s\n", line.c_str());
+			} // channels
+		else if (keyword == "OFFSET")
+			{ // offset
+			float x, y, z;
+			tokens >> x >> y >> z;
+			fprintf(outFile, "%sOFFSET %f %f %f\n", line.substr(0, line.find(keyword)).c_str(), 1.2f * x, 1.2f * y, 1.2f * z);
+			} // offset
+		else
+			{ // anything else
+			motion = (keyword == "MOTION");
+			fprintf(outFile, "%s\n", line.c_str());
+			} // anything else
+		} // per line
+	fclose(outFile);
+	return droppedColumn >= 0 && renamed > 0;
+	} // WriteSecondRig()
+
+// check a mapping built between a clip and its second rig, which has the dropped joint missing: every other
+// joint must find the one it was written from, whether by name or by child slot, and sampling must carry
+// each one's rotations across. Reports how the joints were matched, and returns false if any went astray
+static bool CheckRetarget(const char* direction, Retarget& map, BVHData& target, BVHData& source, int targetDropped, int sourceDropped)
+	{ // CheckRetarget()
+	int byName = 0, bySlot = 0, wrong = 0;
+	for (size_t joint = 0; joint < target.all_joints.size(); joint++)
+		{ // per joint
+		int id = (int) joint;
+		int expected = (id == targetDropped) ? -1 : id;
+		if (targetDropped >= 0 && id > targetDropped)
+			expected--;
+		if (sourceDropped >= 0 && expected >= sourceDropped)
+			expected++;
+		int match = map.sourceJoint[joint];
+		if (match != expected)
+			wrong++;
+		else if (match != -1 && Retarget::CanonicalName(target.all_joints[joint]->joint_name) == Retarget::CanonicalName(source.all_joints[match]->joint_name))
+			byName++;
+		else if (match != -1)
+			bySlot++;
+		} // per joint
+
+	// joints with no partner keep whatever the caller filled in
+	int missed = 0;
+	for (int frame = 0; frame < source.frame_count; frame++)
+		{ // per frame
+		std::vector<Cartesian3> rotations(target.all_joints.size(), Cartesian3(1000.0f, 1000.0f, 1000.0f));
+		map.SampleRotations(source, frame, rotations);
+		for (size_t joint = 0; joint < rotations.size(); joint++)
+			{ // per joint
+			int match = map.sourceJoint[joint];
+			Cartesian3 wanted = (match == -1) ? Cartesian3(1000.0f, 1000.0f, 1000.0f) : source.boneRotations[frame][match];
+			if ((rotations[joint] - wanted).length() > 0.0f)
+				missed++;
+			} // per joint
+		} // per frame
+
+	bool passed = wrong == 0 && missed == 0 && bySlot > 0 && !map.identity;
+	fprintf(stderr, "retarget %s: %d of %zu joints matched by name, %d by child slot, %d wrong, %d rotations not carried: %s\n",
+		direction, byName, target.all_joints.size(), bySlot, wrong, missed, passed ? "passed" : "FAILED");
+	return passed;
+	} // CheckRetarget()
+
+// the id of the joint with the given name, after any namespace, or -1
+static int JointNamed(BVHData& clip, const std::string& name)
+	{ // JointNamed()
+	for (size_t joint = 0; joint < clip.all_joints.size(); joint++)
+		if (Retarget::CanonicalName(clip.all_joints[joint]->joint_name) == Retarget::CanonicalName(name))
+			return (int) joint;
+	return -1;
+	} // JointNamed()
+
+// parser cases: reading each bundled clip from disk
+static void AddParserBenchmarks(std::vector<Benchmark>& benchmarks)
+	{ // AddParserBenchmarks()
+	for (int clip = 0; clip < nClips; clip++)
+		{ // per clip
+		std::string path = ClipPath(clip);
+		benchmarks.push_back(Benchmark(std::string("parse/ReadFileBVH/") + clipNames[clip], [path](long iterations)
+			{ // run
+			for (long i = 0; i < iterations; i++)
+				{ // per iteration
+				BVHData clip;
+				clip.ReadFileBVH(path.c_str());
+				benchmarkSink = clip.frame_time;
+				} // per iteration
+			})); // run
+		} // per clip
+	} // AddParserBenchmarks()
+
+// pose cases: evaluating and drawing a skeleton, and blending two clips
+static void AddPoseBenchmarks(std::vector<Benchmark>& benchmarks, std::vector<BVHData>& clips, std::vector<std::vector<Retarget>>& maps, BVHData* rig, Retarget* rigMap)
+	{ // AddPoseBenchmarks()
+	for (int clip = 0; clip < nClips; clip++)
+		{ // per clip
+		BVHData* data = &clips[clip];
+		benchmarks.push_back(Benchmark(std::string("pose/Render/") + clipNames[clip], [data](long iterations)
+			{ // run
+			Matrix4 view = Matrix4::Identity();
+			for (long i = 0; i < iterations; i++)
+				data->Render(view, 0.1f, (int) i, 0.0f);
+			})); // run
+
+		benchmarks.push_back(Benchmark(std::string("pose/EvaluatePose/") + clipNames[clip], [data](long iterations)
+			{ // run
+			std::vector<Matrix4> pose;
+			for (long i = 0; i < iterations; i++)
+				data->EvaluatePose(data->boneRotations[i % data->frame_count], Matrix4::Identity(), 0.1f, pose);
+			benchmarkSink = pose.back()[0][3];
+			})); // run
+
+		// queueing an evaluated pose and drawing the batch, as the scene does every frame
+		benchmarks.push_back(Benchmark(std::string("pose/RenderPose/") + clipNames[clip], [data](long iterations)
+			{ // run
+			Matrix4 view = Matrix4::Identity();
+			std::vector<Matrix4> pose;
+			data->EvaluatePose(data->boneRotations[0], Matrix4::Identity(), 0.1f, pose);
+			BoneRenderer bones;
+			for (long i = 0; i < iterations; i++)
+				{ // per iteration
+				data->RenderPose(view, pose, bones);
+				bones.Draw();
+				} // per iteration
+			})); // run
+		} // per clip
+
+	// blend each moving cycle into the next one
+	for (int clip = 1; clip < nClips; clip++)
+		{ // per pair
+		int to = (clip + 1 < nClips) ? clip + 1 : 1;
+		BVHData* from = &clips[clip];
+		BVHData* blend = &clips[to];
+		Retarget* map = &maps[clip][to];
+		benchmarks.push_back(Benchmark(std::string("pose/RenderBlend/") + clipNames[clip] + "-" + clipNames[to], [from, blend, map](long iterations)
+			{ // run
+			Matrix4 view = Matrix4::Identity();
+			for (long i = 0; i < iterations; i++)
+				from->RenderBlend(view, 0.1f, (int) i, 0.0f, *blend, 0.5f, (int) i, *map);
+			})); // run
+		} // per pair
+
+	// and the walking clip's second rig onto the clip, through a table that is not the identity
+	BVHData* from = &clips[rigClip];
+	benchmarks.push_back(Benchmark(std::string("pose/RenderBlend/") + clipNames[rigClip] + "-rig2", [from, rig, rigMap](long iterations)
+		{ // run
+		Matrix4 view = Matrix4::Identity();
+		for (long i = 0; i < iterations; i++)
+			from->RenderBlend(view, 0.1f, (int) i, 0.0f, *rig, 0.5f, (int) i, *rigMap);
+		})); // run
+	} // AddPoseBenchmarks()
+
+// skinning cases: a walking pose skinned onto the body, for one character and for a crowd
+static void AddSkinningBenchmarks(std::vector<Benchmark>& benchmarks, SkinnedMesh* mesh, std::vector<BVHData>& clips)
+	{ // AddSkinningBenchmarks()
+	// each case once for each way of skinning, so that the two can be compared
+	BVHData* walk = &clips[1];
+	static const int methods[] = { SkinnedMesh::LINEAR_BLEND, SkinnedMesh::DUAL_QUATERNION };
+	static const char *methodNames[] = { "linear", "dual" };
+	for (int method : methods)
+		benchmarks.push_back(Benchmark(std::string("skin/AddPose/") + methodNames[method] + "/walking", [mesh, walk, method](long iterations)
+			{ // run
+			std::vector<Matrix4> pose;
+			walk->EvaluatePose(walk->boneRotations[0], Matrix4::Identity(), Character::scale, pose);
+			for (long i = 0; i < iterations; i++)
+				{ // per iteration
+				mesh->AddPose(walk, pose, Matrix4::Identity(), method);
+				mesh->ClearPoses();
+				} // per iteration
+			})); // run
+
+	static const int crowds[] = { 1, 16 };
+	for (int method : methods)
+		for (int crowd : crowds)
+			benchmarks.push_back(Benchmark(std::string("skin/Skin/") + methodNames[method] + "/" + std::to_string(crowd) + "x" + std::to_string(mesh->vertexCount), [mesh, walk, method, crowd](long iterations)
+				{ // run
+				std::vector<Matrix4> pose;
+				for (long i = 0; i < iterations; i++)
+					{ // per iteration
+					// evaluating and queueing the poses is included, but costs little beside the skinning
+					for (int character = 0; character < crowd; character++)
+						{ // per character
+						walk->EvaluatePose(walk->boneRotations[(i + character) % walk->frame_count], Matrix4::Identity(), Character::scale, pose);
+						mesh->AddPose(walk, pose, Matrix4::Identity(), method);
+						} // per character
+					mesh->Skin();
+					benchmarkSink = mesh->skinnedVertices[0];
+					mesh->ClearPoses();
+					} // per iteration
+				})); // run
+	} // AddSkinningBenchmarks()
+
+// Matrix4 cases
+static void AddMatrixBenchmarks(std::vector<Benchmark>& benchmarks)
+	{ // AddMatrixBenchmarks()
+	benchmarks.push_back(Benchmark("matrix/Matrix4*Matrix4", [](long iterations)
+		{ // run
+		Matrix4 product = Matrix4::Identity();
+		Matrix4 rotation = Matrix4::RotateX(1.0f) * Matrix4::RotateZ(2.0f);
+		for (long i = 0; i < iterations; i++)
+			product = product * rotation;
+		benchmarkSink = product[0][0];
+		})); // run
+
+	benchmarks.push_back(Benchmark("matrix/Matrix4*Homogeneous4", [](long iterations)
+		{ // run
+		Matrix4 rotation = Matrix4::RotateX(1.0f) * Matrix4::RotateZ(2.0f);
+		Homogeneous4 point(1.0f, 2.0f, 3.0f, 1.0f);
+		for (long i = 0; i < iterations; i++)
+			point = rotation * point;
+		benchmarkSink = point.x;
+		})); // run
+
+	benchmarks.push_back(Benchmark("matrix/RotateXYZ", [](long iterations)
+		{ // run
+		float sum = 0.0f;
+		for (long i = 0; i < iterations; i++)
+			{ // per iteration
+			float angle = (float) (i & 1023);
+			Matrix4 rotation = Matrix4::RotateX(angle) * Matrix4::RotateY(angle) * Matrix4::RotateZ(angle);
+			sum += rotation[1][2];
+			} // per iteration
+		benchmarkSink = sum;
+		})); // run
+	} // AddMatrixBenchmarks()
+
+// the heights as Terrain kept them before they were stored in one block, a vector per row,
+// with the lookup that went with them, so that the two layouts can be compared
+class NestedHeights
+	{ // class NestedHeights
+	public:
+	std::vector<std::vector<float>> heightValues;
+	float xyScale;
+
+	// copy the heights out of a terrain
+	NestedHeights(const Terrain& terrain)
+		: heightValues(terrain.nRows, std::vector<float>(terrain.nColumns)), xyScale(terrain.xyScale)
+		{ // constructor
+		for (long row = 0; row < terrain.nRows; row++)
+			std::copy(terrain.heights + row * terrain.nColumns, terrain.heights + (row + 1) * terrain.nColumns, heightValues[row].begin());
+		} // constructor
+
+	// the same placement and arithmetic as the old Terrain::getHeight(), with no clamping
+	float getHeight(float x, float y) const
+		{ // getHeight()
+		long nRows = heightValues.size(), nColumns = heightValues[0].size();
+		long totalHeight = (nRows - 1) * xyScale;
+		x = x + (nColumns / 2) * xyScale;
+		y = totalHeight - (y + (nRows / 2) * xyScale);
+		long column = x / xyScale, row = y / xyScale;
+		float x_remainder = (x - xyScale * column) / xyScale;
+		float y_remainder = (y - xyScale * row) / xyScale;
+		if (x_remainder < y_remainder)
+			{ // LL triangle
+			float alpha = y_remainder, beta = (1.0 - y_remainder) * x_remainder, gamma = 1.0 - alpha - beta;
+			return alpha * heightValues[row][column] + beta * heightValues[row+1][column+1] + gamma * heightValues[row+1][column];
+			} // LL triangle
+		else
+			{ // UR triangle
+			float alpha = 1.0 - y_remainder, beta = x_remainder * y_remainder, gamma = 1.0 - alpha - beta;
+			return alpha * heightValues[row][column] + beta * heightValues[row+1][column+1] + gamma * heightValues[row][column+1];
+			} // UR triangle
+		} // getHeight()
+	}; // class NestedHeights
+
+// the nearest soup triangle that origin + t * direction meets for t in [0, maxT], testing every one, or -1
+static long BruteForceRaycast(const HomogeneousFaceSurface& surface, const Cartesian3& origin, const Cartesian3& direction, float maxT)
+	{ // BruteForceRaycast()
+	long nearest = -1;
+	for (size_t vertex = 0; vertex + 2 < surface.vertices.size(); vertex += 3)
+		{ // per triangle
+		Cartesian3 a = surface.vertices[vertex].Point(), b = surface.vertices[vertex + 1].Point(), c = surface.vertices[vertex + 2].Point();
+		Cartesian3 ab = b - a, ac = c - a, s = origin - a;
+		Cartesian3 p = direction.cross(ac), q = s.cross(ab);
+		float determinant = ab.dot(p);
+		if (determinant == 0.0f)
+			continue;
+		float u = s.dot(p) / determinant, v = direction.dot(q) / determinant, t = ac.dot(q) / determinant;
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < maxT)
+			{ // nearer hit
+			maxT = t;
+			nearest = vertex / 3;
+			} // nearer hit
+		} // per triangle
+	return nearest;
+	} // BruteForceRaycast()
+
+// terrain cases: loading, height queries at random points, rendering, culling, level of detail and rays
+static void AddTerrainBenchmarks(std::vector<Benchmark>& benchmarks, Terrain* terrain, std::vector<float>* queries, Matrix4 view)
+	{ // AddTerrainBenchmarks()
+	benchmarks.push_back(Benchmark("terrain/ReadFileTerrainData", [](long iterations)
+		{ // run
+		for (long i = 0; i < iterations; i++)
+			{ // per iteration
+			Terrain ground;
+			ground.ReadFileTerrainData(terrainFileName, 3);
+			benchmarkSink = ground.xyScale;
+			} // per iteration
+		})); // run
+
+	benchmarks.push_back(Benchmark("terrain/ReadFileTerrainData/indexed", [](long iterations)
+		{ // run
+		for (long i = 0; i < iterations; i++)
+			{ // per iteration
+			Terrain ground;
+			ground.ReadFileTerrainData(terrainFileName, 3, Terrain::INDEXED_MESH);
+			benchmarkSink = ground.xyScale;
+			} // per iteration
+		})); // run
+
+	benchmarks.push_back(Benchmark("terrain/getHeight/random", [terrain, queries](long iterations)
+		{ // run
+		size_t nQueries = queries->size() / 2;
+		float sum = 0.0f;
+		for (long i = 0; i < iterations; i++)
+			{ // per iteration
+			size_t query = i % nQueries;
+			sum += terrain->getHeight((*queries)[2 * query], (*queries)[2 * query + 1]);
+			} // per iteration
+		benchmarkSink = sum;
+		})); // run
+
+	// the same queries in batches, with x and y split into arrays as getHeights() takes them
+	std::shared_ptr<std::vector<float>> queryX = std::make_shared<std::vector<float>>(), queryY = std::make_shared<std::vector<float>>();
+	for (size_t query = 0; query < queries->size() / 2; query++)
+		{ // per query
+		queryX->push_back((*queries)[2 * query]);
+		queryY->push_back((*queries)[2 * query + 1]);
+		} // per query
+	for (int withNormals = 0; withNormals < 2; withNormals++)
+		benchmarks.push_back(Benchmark(withNormals ? "terrain/getHeights/batch/normals" : "terrain/getHeights/batch", [terrain, queryX, queryY, withNormals](long iterations)
+			{ // run
+			// an iteration is one query, so that the cost per query compares with getHeight()
+			long nQueries = queryX->size();
+			std::vector<float> heights(nQueries), normals(3 * nQueries);
+			for (long done = 0; done < iterations; done += nQueries)
+				terrain->getHeights(&(*queryX)[0], &(*queryY)[0], std::min(nQueries, iterations - done), &heights[0], withNormals ? &normals[0] : NULL);
+			benchmarkSink = heights[0] + normals[0];
+			})); // run
+
+	// the same queries against the old layout, copied once here rather than in the timed region
+	std::shared_ptr<NestedHeights> nested = std::make_shared<NestedHeights>(*terrain);
+	benchmarks.push_back(Benchmark("terrain/getHeight/random/nested", [nested, queries](long iterations)
+		{ // run
+		size_t nQueries = queries->size() / 2;
+		float sum = 0.0f;
+		for (long i = 0; i < iterations; i++)
+			{ // per iteration
+			size_t query = i % nQueries;
+			sum += nested->getHeight((*queries)[2 * query], (*queries)[2 * query + 1]);
+			} // per iteration
+		benchmarkSink = sum;
+		})); // run
+
+	// the same terrain as a triangle soup, loaded once here so that only drawing it is timed,
+	// and drawn once so that the first draw's upload is not timed either
+	Matrix4 firstView = Matrix4::Identity();
+	std::shared_ptr<Terrain> soup = std::make_shared<Terrain>();
+	soup->ReadFileTerrainData(terrainFileName, 3);
+	soup->Render(firstView);
+	benchmarks.push_back(Benchmark("terrain/Render", [soup](long iterations)
+		{ // run
+		Matrix4 view = Matrix4::Identity();
+		for (long i = 0; i < iterations; i++)
+			soup->Render(view);
+		})); // run
+
+	// and as an indexed mesh, whose index buffers are built here rather than charged to drawing:
+	// the first draw builds and uploads them
+	std::shared_ptr<Terrain> indexed = std::make_shared<Terrain>();
+	indexed->ReadFileTerrainData(terrainFileName, 3, Terrain::INDEXED_MESH);
+	indexed->Render(firstView);
+	benchmarks.push_back(Benchmark("terrain/Render/indexed", [indexed](long iterations)
+		{ // run
+		Matrix4 view = Matrix4::Identity();
+		for (long i = 0; i < iterations; i++)
+			indexed->Render(view);
+		})); // run
+
+	benchmarks.push_back(Benchmark("terrain/CullChunks", [terrain, view](long iterations)
+		{ // run
+		// the projection AnimationCycleWidget sets up for a square window
+		Matrix4 clip = Frustum::Perspective(90.0f, 1.0f, 0.1f, 100000.0f) * view;
+		long drawn = 0;
+		for (long i = 0; i < iterations; i++)
+			{ // per iteration
+			terrain->CullChunks(clip);
+			drawn += terrain->chunksDrawn;
+			} // per iteration
+		benchmarkSink = drawn;
+		})); // run
+
+	benchmarks.push_back(Benchmark("terrain/SelectLevels", [terrain, view](long iterations)
+		{ // run
+		Matrix4 projection = Frustum::Perspective(90.0f, 1.0f, 0.1f, 100000.0f);
+		long triangles = 0;
+		for (long i = 0; i < iterations; i++)
+			{ // per iteration
+			terrain->SelectLevels(projection, view, 600.0f);
+			triangles += terrain->trianglesDrawn;
+			} // per iteration
+		benchmarkSink = triangles;
+		})); // run
+
+	// rays for picking and line of sight: a third skim the ground from one point to another,
+	// the rest come down onto it from above, as the mouse or the camera would
+	long nRays = 1024;
+	std::shared_ptr<std::vector<Cartesian3>> origins = std::make_shared<std::vector<Cartesian3>>(nRays);
+	std::shared_ptr<std::vector<Cartesian3>> directions = std::make_shared<std::vector<Cartesian3>>(nRays);
+	float halfWidth = terrain->xyScale * (terrain->nColumns / 2 - 1), halfHeight = terrain->xyScale * (terrain->nRows / 2 - 1);
+	srand(54321);
+	for (long ray = 0; ray < nRays; ray++)
+		{ // per ray
+		Cartesian3 from(halfWidth * (2.0f * rand() / RAND_MAX - 1.0f), halfHeight * (2.0f * rand() / RAND_MAX - 1.0f), 0.0f);
+		Cartesian3 to(halfWidth * (2.0f * rand() / RAND_MAX - 1.0f), halfHeight * (2.0f * rand() / RAND_MAX - 1.0f), 0.0f);
+		bool skimming = (ray % 3 == 0);
+		from.z = terrain->getHeight(from.x, from.y) + (skimming ? 1.0f : 50.0f);
+		to.z = terrain->getHeight(to.x, to.y) + (skimming ? 1.0f : -1.0f);
+		(*origins)[ray] = from;
+		(*directions)[ray] = to - from;
+		} // per ray
+	terrain->BuildHeightPyramid();
+
+	benchmarks.push_back(Benchmark("terrain/Raycast", [terrain, origins, directions](long iterations)
+		{ // run
+		long nRays = origins->size(), hits = 0;
+		TerrainRayHit hit;
+		for (long i = 0; i < iterations; i++)
+			hits += terrain->Raycast((*origins)[i % nRays], (*directions)[i % nRays], 1.0f, hit);
+		benchmarkSink = hits;
+		})); // run
+
+	benchmarks.push_back(Benchmark("terrain/Raycasts/parallel", [terrain, origins, directions](long iterations)
+		{ // run
+		// an iteration is one ray, so that the cost per ray compares with Raycast()
+		long nRays = origins->size();
+		std::vector<TerrainRayHit> hits(nRays);
+		for (long done = 0; done < iterations; done += nRays)
+			terrain->Raycasts(&(*origins)[0], &(*directions)[0], std::min(nRays, iterations - done), 1.0f, &hits[0]);
+		benchmarkSink = hits[0].triangle;
+		})); // run
+
+	benchmarks.push_back(Benchmark("terrain/Raycast/bruteforce", [soup, origins, directions](long iterations)
+		{ // run
+		// every triangle of the soup loaded for terrain/Render, as there was nothing better before the pyramid
+		long nRays = origins->size(), hits = 0;
+		for (long i = 0; i < iterations; i++)
+			hits += BruteForceRaycast(*soup, (*origins)[i % nRays], (*directions)[i % nRays], 1.0f) >= 0;
+		benchmarkSink = hits;
+		})); // run
+	} // AddTerrainBenchmarks()
+
+// simulation cases: stepping a character, as SceneModel::Update() does
+static void AddSimulationBenchmarks(std::vector<Benchmark>& benchmarks, SceneModel* scene)
+	{ // AddSimulationBenchmarks()
+	benchmarks.push_back(Benchmark("simulation/Character::Step", [scene](long iterations)
+		{ // run
+		Character character;
+		for (long i = 0; i < iterations; i++)
+			{ // per iteration
+			// keep switching between walking and running so that blends are included
+			if (i % 48 == 0)
+				character.StartAnimation((i / 48) % 2 ? Character::RUNNING : Character::WALKING, true, (i / 48) % 2 == 0, 0);
+			// and stay on the terrain
+			if (i % 256 == 0)
+				character.Reset();
+			character.Step(scene->cycles, scene->retargetMaps, scene->groundModel);
+			} // per iteration
+		benchmarkSink = character.groundHeight;
+		})); // run
+	} // AddSimulationBenchmarks()
+
+// profiler cases: what a ScopedPhase costs, with the profiler off and on
+static void AddProfilerBenchmarks(std::vector<Benchmark>& benchmarks)
+	{ // AddProfilerBenchmarks()
+	for (int enable = 0; enable < 2; enable++)
+		benchmarks.push_back(Benchmark(enable ? "profiler/ScopedPhase/enabled" : "profiler/ScopedPhase/disabled", [enable](long iterations)
+			{ // run
+			FrameProfiler::enabled.store(enable != 0);
+			for (long i = 0; i < iterations; i++)
+				{ // per iteration
+				ScopedPhase timer(PHASE_POSE);
+				benchmarkSink = (float) i;
+				// a frame's worth of samples at a time, as the ring would be drained
+				if (enable && i % 1024 == 1023)
+					FrameProfiler::EndFrame();
+				} // per iteration
+			FrameProfiler::enabled.store(false);
+			})); // run
+	} // AddProfilerBenchmarks()
+
+int main(int argc, char **argv)
+	{ // main()
+	const char* outName = NULL;
+	std::string filter;
+	double secondsPerCase = 0.5;
+	int repeats = 5;
+
+	// parse the command line
+	for (int arg = 1; arg + 1 < argc; arg += 2)
+		{ // per argument
+		if (strcmp(argv[arg], "-o") == 0)
+			outName = argv[arg + 1];
+		else if (strcmp(argv[arg], "-f") == 0)
+			filter = argv[arg + 1];
+		else if (strcmp(argv[arg], "-t") == 0)
+			secondsPerCase = atof(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-r") == 0)
+			repeats = std::max(1, atoi(argv[arg + 1]));
+		else
+			{ // unknown
+			fprintf(stderr, "usage: %s [-o results.json] [-f filter] [-t seconds] [-r repeats]\n", argv[0]);
+			return 1;
+			} // unknown
+		} // per argument
+	if (argc % 2 == 0)
+		{ // dangling argument
+		fprintf(stderr, "usage: %s [-o results.json] [-f filter] [-t seconds] [-r repeats]\n", argv[0]);
+		return 1;
+		} // dangling argument
+
+	// shared data, loaded once, outside the timed regions
+	SceneModel scene;
+	std::vector<BVHData> clips(nClips);
+	for (int clip = 0; clip < nClips; clip++)
+		clips[clip].ReadFileBVH(ClipPath(clip).c_str());
+	std::vector<std::vector<Retarget>> maps(nClips, std::vector<Retarget>(nClips));
+	for (int to = 0; to < nClips; to++)
+		for (int from = 0; from < nClips; from++)
+			maps[to][from].Build(clips[to], clips[from]);
+
+	// a rig that differs from the bundled one, mapped both ways and checked before anything is timed
+	BVHData rig;
+	Retarget ontoClip, ontoRig;
+	if (!WriteSecondRig(ClipPath(rigClip).c_str(), rigFileName, rigDroppedJoint) || !rig.ReadFileBVH(rigFileName))
+		{ // failed
+		fprintf(stderr, "unable to write %s\n", rigFileName);
+		return 1;
+		} // failed
+	remove(rigFileName);
+	ontoClip.Build(clips[rigClip], rig);
+	ontoRig.Build(rig, clips[rigClip]);
+	int dropped = JointNamed(clips[rigClip], rigDroppedJoint);
+	bool passed = CheckRetarget("rig2 onto clip", ontoClip, clips[rigClip], rig, dropped, -1);
+	passed = CheckRetarget("clip onto rig2", ontoRig, rig, clips[rigClip], -1, dropped) && passed;
+	if (!passed)
+		return 1;
+
+	// a stand-in body, bound to the rest pose as the scene binds its own
+	SkinnedMesh body;
+	if (!WriteSyntheticBody(bodyFileName, clips[0], bodyVertices) || !body.ReadFileOBJ(bodyFileName))
+		{ // failed
+		fprintf(stderr, "unable to write %s\n", bodyFileName);
+		return 1;
+		} // failed
+	remove(bodyFileName);
+	body.Bind(clips[0], Character::scale);
+
+	// random query points, kept a cell away from the edge of the terrain
+	Terrain& ground = scene.groundModel;
+	float halfWidth = ground.xyScale * (ground.nColumns / 2 - 1);
+	float halfHeight = ground.xyScale * (ground.nRows / 2 - 1);
+	std::vector<float> queries(2 * 4096);
+	srand(12345);
+	for (size_t query = 0; query < queries.size() / 2; query++)
+		{ // per query
+		queries[2 * query] = halfWidth * (2.0f * rand() / (float) RAND_MAX - 1.0f);
+		queries[2 * query + 1] = halfHeight * (2.0f * rand() / (float) RAND_MAX - 1.0f);
+		} // per query
+
+	std::vector<Benchmark> benchmarks;
+	AddParserBenchmarks(benchmarks);
+	AddPoseBenchmarks(benchmarks, clips, maps, &rig, &ontoClip);
+	AddSkinningBenchmarks(benchmarks, &body, clips);
+	AddMatrixBenchmarks(benchmarks);
+	AddTerrainBenchmarks(benchmarks, &ground, &queries, scene.world2OpenGLMatrix * scene.CameraRotationMatrix * scene.CameraTranslateMatrix);
+	AddSimulationBenchmarks(benchmarks, &scene);
+	AddProfilerBenchmarks(benchmarks);
+
+	// run everything that matches the filter
+	std::vector<BenchmarkResult> results;
+	fprintf(stderr, "%-44s %12s %14s %14s\n", "case", "iterations", "ns / op", "min ns / op");
+	for (size_t i = 0; i < benchmarks.size(); i++)
+		{ // per case
+		if (!filter.empty() && benchmarks[i].name.find(filter) == std::string::npos)
+			continue;
+		BenchmarkResult result = Measure(benchmarks[i], secondsPerCase, repeats);
+		fprintf(stderr, "%-44s %12ld %14.1f %14.1f\n", result.name.c_str(), result.iterations, Median(result.nsPerOp), *std::min_element(result.nsPerOp.begin(), result.nsPerOp.end()));
+		results.push_back(result);
+		} // per case
+
+	// and write the JSON out
+	FILE* outFile = outName ? fopen(outName, "w") : stdout;
+	if (outFile == NULL)
+		{ // failed to open
+		fprintf(stderr, "unable to write %s\n", outName);
+		return 1;
+		} // failed to open
+	WriteJSON(outFile, results, secondsPerCase, repeats);
+	if (outName)
+		fclose(outFile);
+	return 0;
+	} // main()
@@ -0,0 +1,7 @@
+# micro-benchmarks for the parser, pose evaluation, blending and terrain
+TEMPLATE = app
+TARGET = bench
+
+include(../tools.pri)
+
+SOURCES += bench.cpp
@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	clipcompress.cpp
+//	------------------------
+//
+//	Compresses each BVH clip given on the command line and
+//	reports the compression ratio, the worst errors over
+//	every frame, and the cost of decoding a pose. The bounds
+//	are checked where they apply: the angular bound on each
+//	joint's rotation, the translation bound on the root's
+//	position. Joint positions have no bound of their own, as
+//	rotation errors add up down each chain, so their worst
+//	error is reported for information only
+//
+//	usage: clipcompress [-e degrees] [-t units] file.bvh ...
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "BVHData.h"
+#include "CompressedClip.h"
+
+// the clips we ship, used when no files are given
+static const char* defaultClips[] =
+	{ // defaultClips
+	"./models/stand.bvh",
+	"./models/walking.bvh",
+	"./models/fast_run.bvh",
+	"./models/veer_left.bvh",
+	"./models/veer_right.bvh"
+	}; // defaultClips
+
+int main(int argc, char **argv)
+	{ // main()
+	// default bounds: a tenth of a degree, and a tenth of a file unit (1 mm for our clips)
+	float angularError = 0.1f;
+	float translationError = 0.1f;
+	std::vector<std::string> fileNames;
+
+	// parse the command line
+	for (int arg = 1; arg < argc; arg++)
+		{ // per argument
+		if (strcmp(argv[arg], "-e") == 0 && arg + 1 < argc)
+			angularError = atof(argv[++arg]);
+		else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc)
+			translationError = atof(argv[++arg]);
+		else
+			fileNames.push_back(argv[arg]);
+		} // per argument
+	if (fileNames.empty())
+		fileNames.assign(defaultClips, defaultClips + sizeof(defaultClips) / sizeof(defaultClips[0]));
+
+	printf("angular bound %.3f degrees on each joint's rotation, translation bound %.3f units on the root's position\n", angularError, translationError);
+	printf("joint position error is not bounded, and is shown for information\n");
+	printf("%-28s %7s %7s %10s %10s %8s %8s %12s %12s %12s %12s\n", "clip", "frames", "joints", "raw B", "packed B", "ratio", "keys %", "max deg err", "max root err", "max pos err", "ns / pose");
+
+	size_t totalRaw = 0, totalPacked = 0;
+	float worstAngle = 0.0f, worstRoot = 0.0f, worstError = 0.0f;
+
+	for (size_t file = 0; file < fileNames.size(); file++)
+		{ // per file
+		BVHData clip;
+		if (!clip.ReadFileBVH(fileNames[file].c_str()) || clip.frame_count <= 0)
+			{ // failed to read
+			printf("%-28s unable to read\n", fileNames[file].c_str());
+			continue;
+			} // failed to read
+
+		CompressedClip packed;
+		if (!packed.Compress(clip, angularError, translationError))
+			{ // failed to compress
+			printf("%-28s too long to compress\n", fileNames[file].c_str());
+			continue;
+			} // failed to compress
+
+		// count surviving keys against the original number of samples
+		size_t keys = 0;
+		for (size_t joint = 0; joint < packed.rotationTracks.size(); joint++)
+			keys += packed.rotationTracks[joint].KeyCount();
+		float keyPercent = 100.0f * keys / (float) (packed.rotationTracks.size() * clip.frame_count);
+
+		// compare rotations, the root's position and joint positions frame by frame, in degrees and file units
+		std::vector<Matrix4> rawPose, packedPose;
+		std::vector<Cartesian3> rotations;
+		float maxAngle = 0.0f, maxRoot = 0.0f, maxError = 0.0f;
+		for (int frame = 0; frame < clip.frame_count; frame++)
+			{ // per frame
+			clip.EvaluatePose(clip.boneRotations[frame], Matrix4::Identity(), 1.0f, rawPose);
+			packed.SampleRotations(frame, rotations);
+			for (size_t joint = 0; joint < rotations.size(); joint++)
+				maxAngle = std::max(maxAngle, CompressedClip::AngleBetween(rotations[joint], clip.boneRotations[frame][joint]));
+			Cartesian3 rawRoot(0.0f, 0.0f, 0.0f);
+			const std::vector<std::string>& channels = clip.root.joint_channel;
+			for (size_t k = 0; k < channels.size() && k < clip.frames[frame].size(); k++)
+				{ // per channel
+				if (channels[k] == "Xposition")
+					rawRoot.x = clip.frames[frame][k];
+				else if (channels[k] == "Yposition")
+					rawRoot.y = clip.frames[frame][k];
+				else if (channels[k] == "Zposition")
+					rawRoot.z = clip.frames[frame][k];
+				} // per channel
+			maxRoot = std::max(maxRoot, (packed.SampleRootTranslation(frame) - rawRoot).length());
+			clip.EvaluatePose(rotations, Matrix4::Identity(), 1.0f, packedPose);
+			for (size_t joint = 0; joint < rawPose.size(); joint++)
+				{ // per joint
+				Cartesian3 rawPosition = rawPose[joint] * Cartesian3(0, 0, 0);
+				Cartesian3 packedPosition = packedPose[joint] * Cartesian3(0, 0, 0);
+				float error = (rawPosition - packedPosition).length();
+				if (error > maxError)
+					maxError = error;
+				} // per joint
+			} // per frame
+
+		// time decoding whole poses
+		int repeats = 1 + 200000 / clip.frame_count;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int repeat = 0; repeat < repeats; repeat++)
+			for (int frame = 0; frame < clip.frame_count; frame++)
+				packed.SampleRotations(frame, rotations);
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		double nsPerPose = elapsed.count() / ((double) repeats * clip.frame_count);
+
+		size_t raw = CompressedClip::RawMemoryBytes(clip);
+		size_t bytes = packed.MemoryBytes();
+		printf("%-28s %7d %7zu %10zu %10zu %7.2fx %7.1f%% %12.5f %12.5f %12.5f %12.1f\n", fileNames[file].c_str(), clip.frame_count, clip.all_joints.size(), raw, bytes, raw / (float) bytes, keyPercent, maxAngle, maxRoot, maxError, nsPerPose);
+
+		totalRaw += raw;
+		totalPacked += bytes;
+		worstAngle = std::max(worstAngle, maxAngle);
+		worstRoot = std::max(worstRoot, maxRoot);
+		worstError = std::max(worstError, maxError);
+		} // per file
+
+	if (totalPacked > 0)
+		printf("%-28s %7s %7s %10zu %10zu %7.2fx %8s %12.5f %12.5f %12.5f\n", "total", "", "", totalRaw, totalPacked, totalRaw / (float) totalPacked, "", worstAngle, worstRoot, worstError);
+
+	// a little slack for the single-precision arithmetic the error is measured with
+	bool withinBounds = (worstAngle <= angularError * 1.01f + 1E-3f) && (worstRoot <= translationError * 1.01f + 1E-4f);
+	printf("bounds %s\n", withinBounds ? "met" : "EXCEEDED");
+
+	return withinBounds ? 0 : 1;
+	} // main()
@@ -0,0 +1,7 @@
+# reports how well each clip compresses, and how much accuracy it loses
+TEMPLATE = app
+TARGET = clipcompress
+
+include(../tools.pri)
+
+SOURCES += clipcompress.cpp
@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	demconvert.cpp
+//	------------------------
+//
+//	Converts a .dem text file to the binary heightfield
+//	format (see BinaryDEM.h), as raw floats or, with -q,
+//	as 16-bit quantized samples. Then it reads both back
+//	and reports how long each took to load, how much
+//	touching every mapped height costs on top, and the
+//	largest difference between the two.
+//
+//	With -g, a synthetic DEM of the given size is written
+//	and converted instead, and both files are removed
+//	again afterwards.
+//
+//	usage: demconvert [-q] [-g rows columns] [file.dem [file.bdem]]
+//
+///////////////////////////////////////////////////
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Terrain.h"
+#include "SyntheticDEM.h"
+
+// the terrain we ship
+static const char* defaultTerrainName = "./models/randomland.dem";
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+	{ // SecondsSince()
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} // SecondsSince()
+
+// the size of a file in bytes, or -1 if it cannot be opened
+static long FileBytes(const char* fileName)
+	{ // FileBytes()
+	FILE* file = fopen(fileName, "rb");
+	if (file == NULL)
+		return -1;
+	fseek(file, 0, SEEK_END);
+	long bytes = ftell(file);
+	fclose(file);
+	return bytes;
+	} // FileBytes()
+
+int main(int argc, char **argv)
+	{ // main()
+	bool quantize = false;
+	long syntheticRows = 0, syntheticColumns = 0;
+	std::string inputName = defaultTerrainName, outputName;
+
+	// parse the command line
+	int named = 0;
+	for (int arg = 1; arg < argc; arg++)
+		{ // per argument
+		if (strcmp(argv[arg], "-q") == 0)
+			quantize = true;
+		else if (strcmp(argv[arg], "-g") == 0 && arg + 2 < argc)
+			{ // synthetic grid
+			syntheticRows = atol(argv[++arg]);
+			syntheticColumns = atol(argv[++arg]);
+			} // synthetic grid
+		else if (argv[arg][0] == '-' || named == 2)
+			{ // unknown
+			printf("usage: %s [-q] [-g rows columns] [file.dem [file.bdem]]\n", argv[0]);
+			return 1;
+			} // unknown
+		else if (named++ == 0)
+			inputName = argv[arg];
+		else
+			outputName = argv[arg];
+		} // per argument
+
+	// the synthetic grid is written next to where we were run, and removed again afterwards
+	bool synthetic = (syntheticRows > 1 && syntheticColumns > 1);
+	if (synthetic)
+		{ // synthetic grid
+		inputName = "demconvert-" + std::to_string(syntheticRows) + "x" + std::to_string(syntheticColumns) + ".dem";
+		if (!WriteSyntheticDEM(inputName.c_str(), syntheticRows, syntheticColumns))
+			{ // failed
+			printf("could not write %s\n", inputName.c_str());
+			return 1;
+			} // failed
+		} // synthetic grid
+
+	// by default the output goes next to the input, with the extension changed
+	if (outputName.empty())
+		{ // default output
+		size_t dot = inputName.find_last_of('.');
+		size_t slash = inputName.find_last_of('/');
+		outputName = ((dot != std::string::npos && (slash == std::string::npos || dot > slash)) ? inputName.substr(0, dot) : inputName) + ".bdem";
+		} // default output
+
+	// read the text
+	Terrain text;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!text.ReadHeights(inputName.c_str(), 1.0f) || text.heights == NULL)
+		{ // failed
+		printf("could not read %s\n", inputName.c_str());
+		return 1;
+		} // failed
+	double textSeconds = SecondsSince(start);
+
+	// write the binary
+	start = std::chrono::steady_clock::now();
+	if (!BinaryDEM::Write(outputName.c_str(), text.heights, text.nRows, text.nColumns, quantize))
+		{ // failed
+		printf("could not write %s\n", outputName.c_str());
+		return 1;
+		} // failed
+	double writeSeconds = SecondsSince(start);
+
+	// and read it back
+	Terrain binary;
+	start = std::chrono::steady_clock::now();
+	if (!binary.ReadHeights(outputName.c_str(), 1.0f) || binary.nRows != text.nRows || binary.nColumns != text.nColumns)
+		{ // failed
+		printf("could not read back %s\n", outputName.c_str());
+		return 1;
+		} // failed
+	double binarySeconds = SecondsSince(start);
+
+	// touching every height pages in whatever the OS has not read yet
+	start = std::chrono::steady_clock::now();
+	double worst = 0.0;
+	long samples = text.nRows * text.nColumns;
+	for (long sample = 0; sample < samples; sample++)
+		worst = std::max(worst, (double) fabs(binary.heights[sample] - text.heights[sample]));
+	double touchSeconds = SecondsSince(start);
+
+	printf("%s: %ld x %ld, %.2f MB of text read in %.3f s\n", inputName.c_str(), text.nRows, text.nColumns, FileBytes(inputName.c_str()) / 1048576.0, textSeconds);
+	printf("%s: %.2f MB of %s written in %.3f s\n", outputName.c_str(), FileBytes(outputName.c_str()) / 1048576.0, quantize ? "16-bit samples" : "floats", writeSeconds);
+	printf("binary %s in %.3f ms, every height compared in a further %.3f s\n", binary.heightFile.floatSamples != NULL ? "mapped" : "read and expanded", 1E3 * binarySeconds, touchSeconds);
+	printf("largest difference from the text %g\n", worst);
+
+	if (synthetic)
+		{ // synthetic grid
+		binary.heightFile.Close();
+		remove(inputName.c_str());
+		remove(outputName.c_str());
+		} // synthetic grid
+	return 0;
+	} // main()
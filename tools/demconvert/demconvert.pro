@@ -0,0 +1,7 @@
+# converts text DEMs to the binary heightfield format
+TEMPLATE = app
+TARGET = demconvert
+
+include(../tools.pri)
+
+SOURCES += demconvert.cpp
@@ -0,0 +1,237 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	headless.cpp
+//	------------------------
+//
+//	Steps N characters for M ticks with no window and no
+//	rendering, and reports how many ticks per second the
+//	simulation manages. Every couple of seconds of scene
+//	time each character switches to a random animation, so
+//	that blending is exercised as well as playback.
+//
+//	With -p, the frame profiler is enabled, a row of phase
+//	timings per tick is written to the given CSV file, and
+//	the mean and 99th percentile of each phase are reported.
+//	Setting ANIMATION_TRACE to a file name writes a Chrome
+//	trace of loading and of every tick to it.
+//
+//	With -k, every character's pose is skinned onto the
+//	mesh in the given OBJ file after every tick, as Render()
+//	skins those in view, and the vertices skinned per second
+//	are reported. -g writes a synthetic body of about the
+//	given number of vertices to skin instead, and -d picks
+//	linear blend or dual quaternion skinning.
+//
+//	usage: headless [-n characters] [-m ticks] [-s seed] [-p phases.csv] [-k model.obj] [-g vertices] [-d linear|dual]
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SceneModel.h"
+#include "FrameProfiler.h"
+#include "SyntheticBody.h"
+
+// ticks between random changes of animation (2s at 24fps)
+static const int ticksPerChange = 48;
+
+int main(int argc, char **argv)
+	{ // main()
+	int nCharacters = 100;
+	int nTicks = 2400;
+	unsigned int seed = 1;
+	const char *phaseFileName = NULL;
+	const char *meshFileName = NULL;
+	long syntheticVertices = 0;
+	int skinning = SkinnedMesh::LINEAR_BLEND;
+
+	// parse the command line
+	for (int arg = 1; arg + 1 < argc; arg += 2)
+		{ // per argument
+		if (strcmp(argv[arg], "-n") == 0)
+			nCharacters = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-m") == 0)
+			nTicks = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-s") == 0)
+			seed = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-p") == 0)
+			phaseFileName = argv[arg + 1];
+		else if (strcmp(argv[arg], "-k") == 0)
+			meshFileName = argv[arg + 1];
+		else if (strcmp(argv[arg], "-g") == 0)
+			syntheticVertices = atol(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-d") == 0 && (strcmp(argv[arg + 1], "linear") == 0 || strcmp(argv[arg + 1], "dual") == 0))
+			skinning = (strcmp(argv[arg + 1], "dual") == 0) ? SkinnedMesh::DUAL_QUATERNION : SkinnedMesh::LINEAR_BLEND;
+		else
+			{ // unknown
+			printf("usage: %s [-n characters] [-m ticks] [-s seed] [-p phases.csv] [-k model.obj] [-g vertices] [-d linear|dual]\n", argv[0]);
+			return 1;
+			} // unknown
+		} // per argument
+	if (argc % 2 == 0)
+		{ // dangling argument
+		printf("usage: %s [-n characters] [-m ticks] [-s seed] [-p phases.csv] [-k model.obj] [-g vertices] [-d linear|dual]\n", argv[0]);
+		return 1;
+		} // dangling argument
+	if (nCharacters < 1 || nTicks < 1)
+		{ // nothing to do
+		printf("need at least one character and one tick\n");
+		return 1;
+		} // nothing to do
+	srand(seed);
+
+	// a trace starts before loading, so that loading is in it
+	FrameProfiler::StartTraceFromEnvironment();
+
+	// loading is not part of the measurement
+	std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+	SceneModel scene;
+	double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+
+	// the synthetic body is written next to where we were run, and removed again afterwards
+	std::string syntheticName;
+	if (syntheticVertices > 0)
+		{ // synthetic body
+		syntheticName = "headless-body-" + std::to_string(syntheticVertices) + ".obj";
+		if (!WriteSyntheticBody(syntheticName.c_str(), scene.restPose, syntheticVertices))
+			{ // failed
+			printf("could not write %s\n", syntheticName.c_str());
+			return 1;
+			} // failed
+		meshFileName = syntheticName.c_str();
+		} // synthetic body
+
+	// a mesh given here replaces the scene's own, if it has one
+	if (meshFileName != NULL)
+		{ // mesh
+		bool read = scene.characterMesh.ReadFileOBJ(meshFileName);
+		if (!syntheticName.empty())
+			remove(syntheticName.c_str());
+		if (!read)
+			{ // failed
+			printf("could not read a mesh from %s\n", meshFileName);
+			return 1;
+			} // failed
+		scene.characterMesh.Bind(scene.restPose, Character::scale);
+		} // mesh
+	SkinnedMesh& mesh = scene.characterMesh;
+
+	// keep everyone well inside the terrain: two grid cells of margin covers several ticks of running
+	Terrain& ground = scene.groundModel;
+	float halfWidth = ground.xyScale * (ground.nColumns / 2 - 2);
+	float halfHeight = ground.xyScale * (ground.nRows / 2 - 2);
+
+	// spread the characters out on a square grid, two units apart
+	scene.characters.resize(nCharacters);
+	int gridSide = 1;
+	while (gridSide * gridSide < nCharacters)
+		gridSide++;
+	std::vector<Matrix4> homes(nCharacters);
+	for (int character = 0; character < nCharacters; character++)
+		{ // per character
+		float x = 2.0f * (character % gridSide - gridSide / 2);
+		float y = 2.0f * (character / gridSide - gridSide / 2);
+		homes[character] = Matrix4::Translate(Cartesian3(x, y, 0.0f));
+		scene.characters[character].characterTransform = homes[character];
+		scene.characters[character].skinning = skinning;
+		} // per character
+
+	// the profiler only runs when asked for
+	if (phaseFileName != NULL)
+		{ // profile
+		if (!FrameProfiler::OpenCSV(phaseFileName))
+			{ // failed
+			printf("could not write %s\n", phaseFileName);
+			return 1;
+			} // failed
+		FrameProfiler::enabled.store(true);
+		} // profile
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	long blends = 0, resets = 0;
+	long verticesSkinned = 0;
+	double skinSeconds = 0.0;
+	for (int tick = 0; tick < nTicks; tick++)
+		{ // per tick
+		// pick new animations, staggered so that they don't all blend on the same tick
+		for (int character = 0; character < nCharacters; character++)
+			if ((tick + character) % ticksPerChange == 0)
+				{ // time for a change
+				int anim = rand() % Character::N_ANIMATIONS;
+				bool move = (anim != Character::REST);
+				int turn = (anim == Character::TURN_LEFT) ? 1 : (anim == Character::TURN_RIGHT) ? 2 : 0;
+				if (scene.characters[character].StartAnimation(anim, move, anim == Character::WALKING, turn))
+					blends++;
+				} // time for a change
+
+		scene.Update();
+
+		// skin everyone, in view or not, in the poses just published
+		if (mesh.Bound())
+			{ // skin
+			const SceneSnapshot& snapshot = scene.snapshots.Read();
+			for (size_t character = 0; character < snapshot.characters.size(); character++)
+				snapshot.characters[character].Skin(mesh);
+			mesh.Skin();
+			mesh.ClearPoses();
+			verticesSkinned += mesh.verticesSkinned;
+			skinSeconds += mesh.skinSeconds;
+			} // skin
+
+		// anyone who has wandered towards the edge goes back home
+		for (int character = 0; character < nCharacters; character++)
+			{ // per character
+			Character& walker = scene.characters[character];
+			Cartesian3 position = walker.characterTransform * Cartesian3(0, 0, 0);
+			if (fabs(position.x) > halfWidth || fabs(position.y) > halfHeight)
+				{ // off the edge
+				walker.Reset();
+				walker.characterTransform = homes[character];
+				resets++;
+				} // off the edge
+			} // per character
+
+		if (FrameProfiler::enabled.load(std::memory_order_relaxed))
+			FrameProfiler::EndFrame();
+		} // per tick
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// a checksum of where everyone ended up, so runs can be compared
+	double checksum = 0.0;
+	for (int character = 0; character < nCharacters; character++)
+		{ // per character
+		Cartesian3 position = scene.characters[character].characterTransform * Cartesian3(0, 0, 0);
+		checksum += position.x + position.y + scene.characters[character].groundHeight;
+		} // per character
+
+	printf("loaded scene in %.3f s\n", loadSeconds);
+	printf("%d characters, %d ticks, %ld blends started, %ld resets\n", nCharacters, nTicks, blends, resets);
+	printf("%.3f s: %.1f ticks / s, %.0f character-ticks / s, %.3f us per character-tick\n", seconds, nTicks / seconds, (double) nCharacters * nTicks / seconds, 1E6 * seconds / ((double) nCharacters * nTicks));
+	printf("checksum %.4f\n", checksum);
+	if (mesh.Bound())
+		printf("skinned %ld vertices, %ld triangles, by %s, for every character every tick: %.3f s, %.1f M vertices / s\n",
+			mesh.vertexCount, (long) mesh.triangles.size() / 3, skinning == SkinnedMesh::DUAL_QUATERNION ? "dual quaternions" : "linear blend", skinSeconds, skinSeconds > 0.0 ? 1E-6 * verticesSkinned / skinSeconds : 0.0);
+
+	if (FrameProfiler::Tracing())
+		{ // trace
+		FrameProfiler::StopTrace();
+		printf("trace written to %s\n", getenv("ANIMATION_TRACE"));
+		} // trace
+	if (phaseFileName != NULL)
+		{ // phases
+		FrameProfiler::CloseCSV();
+		printf("phase timings over the last %ld ticks, written per tick to %s\n", std::min(FrameProfiler::FramesGathered(), (long) FrameProfiler::HISTORY_FRAMES), phaseFileName);
+		for (int phase = 0; phase < N_PHASES; phase++)
+			printf("  %-8s mean %8.3f ms  p99 %8.3f ms\n", FrameProfiler::PhaseName(phase), FrameProfiler::AverageMilliseconds(phase), FrameProfiler::Percentile99Milliseconds(phase));
+		if (FrameProfiler::SamplesDropped() > 0)
+			printf("  %ld samples dropped\n", FrameProfiler::SamplesDropped());
+		} // phases
+	return 0;
+	} // main()
@@ -0,0 +1,7 @@
+# steps the simulation with no window, and reports ticks per second
+TEMPLATE = app
+TARGET = headless
+
+include(../tools.pri)
+
+SOURCES += headless.cpp
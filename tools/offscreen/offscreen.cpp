@@ -0,0 +1,318 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	offscreen.cpp
+//	------------------------
+//
+//	Renders the scene with no window: an OpenGL context is
+//	made through EGL, on Mesa's surfaceless platform when
+//	there is one (so llvmpipe serves on a machine with no
+//	GPU and no display), and the scene is drawn into a
+//	framebuffer object of the size asked for, then read
+//	back into memory.
+//
+//	In batch mode N frames are stepped, rendered and read
+//	back as fast as they go, and the frames per second of
+//	each stage are reported, so that changes to the render
+//	path can be measured on CI machines. If a file prefix
+//	is given, each frame is captured as an image instead,
+//	by a FrameCapture with the given number of workers and
+//	buffers, which either waits for the workers when they
+//	fall behind or drops frames, and its sustained
+//	throughput is reported as well.
+//
+//	With -k, the characters are drawn as the mesh in the
+//	given OBJ file, skinned to their poses, rather than as
+//	bones, and the vertices skinned per second are reported;
+//	-d picks linear blend or dual quaternion skinning.
+//
+//	usage: offscreen [-w width] [-h height] [-n frames] [-c characters] [-m boneMode] [-k model.obj] [-d linear|dual]
+//		[-o prefix] [-f ppm|png] [-t workers] [-b buffers] [-p wait|drop]
+//
+///////////////////////////////////////////////////
+
+#include "GLSupport.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SceneModel.h"
+#include "FrameCapture.h"
+
+// how far apart the characters stand, in world units
+static const float characterSpacing = 8.0f;
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+	{ // SecondsSince()
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} // SecondsSince()
+
+// an OpenGL context with nothing to draw to but the framebuffer object we make for it
+class OffscreenContext
+	{ // class OffscreenContext
+	public:
+	EGLDisplay display;
+	EGLContext context;
+	GLuint framebuffer, colourBuffer, depthBuffer;
+
+	// constructor will initialise to safe values
+	OffscreenContext()
+		: display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT), framebuffer(0), colourBuffer(0), depthBuffer(0)
+		{ // constructor
+		} // constructor
+
+	// make the context current with a width x height framebuffer bound: returns false, saying why, if it cannot
+	bool Create(int width, int height)
+		{ // Create()
+		// Mesa's surfaceless platform needs neither a display server nor a GPU
+		const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (clientExtensions != NULL && strstr(clientExtensions, "EGL_MESA_platform_surfaceless") != NULL && getPlatformDisplay != NULL)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY)
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		EGLint major, minor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+			{ // no display
+			printf("could not open an EGL display\n");
+			return false;
+			} // no display
+
+		// desktop OpenGL, since the scene draws with the fixed-function pipeline (the surface type
+		// would otherwise default to windows, which the surfaceless platform has none of)
+		EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		EGLConfig config;
+		EGLint nConfigs = 0;
+		if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(display, configAttributes, &config, 1, &nConfigs) || nConfigs == 0)
+			{ // no config
+			printf("EGL %d.%d has no desktop OpenGL\n", major, minor);
+			return false;
+			} // no config
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+		if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+			{ // no context
+			printf("could not make a context current without a surface\n");
+			return false;
+			} // no context
+
+		// and something to draw into
+		if (!GLSupport::HasVersion(3, 0) && !GLSupport::HasExtension("GL_ARB_framebuffer_object"))
+			{ // no FBOs
+			printf("%s has no framebuffer objects\n", (const char *) glGetString(GL_RENDERER));
+			return false;
+			} // no FBOs
+		glGenRenderbuffers(1, &colourBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, colourBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colourBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			{ // incomplete
+			printf("could not make a %d x %d framebuffer\n", width, height);
+			return false;
+			} // incomplete
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		return true;
+		} // Create()
+
+	// destructor releases the context
+	~OffscreenContext()
+		{ // destructor
+		if (framebuffer != 0)
+			{ // framebuffer
+			glDeleteFramebuffers(1, &framebuffer);
+			glDeleteRenderbuffers(1, &colourBuffer);
+			glDeleteRenderbuffers(1, &depthBuffer);
+			} // framebuffer
+		if (display != EGL_NO_DISPLAY)
+			{ // display
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (context != EGL_NO_CONTEXT)
+				eglDestroyContext(display, context);
+			eglTerminate(display);
+			} // display
+		} // destructor
+	}; // class OffscreenContext
+
+// how to use us
+static int Usage(const char *name)
+	{ // Usage()
+	printf("usage: %s [-w width] [-h height] [-n frames] [-c characters] [-m boneMode] [-k model.obj] [-d linear|dual] [-o prefix] [-f ppm|png] [-t workers] [-b buffers] [-p wait|drop]\n", name);
+	return 1;
+	} // Usage()
+
+int main(int argc, char **argv)
+	{ // main()
+	int width = 600, height = 600;
+	int nFrames = 240;
+	int nCharacters = 1;
+	int boneMode = BoneRenderer::AUTOMATIC;
+	const char *meshFileName = NULL;
+	int skinning = SkinnedMesh::LINEAR_BLEND;
+	const char *prefix = NULL;
+	int format = FrameCapture::PPM, policy = FrameCapture::WAIT;
+	int nWorkers = 2, nBuffers = 8;
+
+	// parse the command line
+	for (int arg = 1; arg + 1 < argc; arg += 2)
+		{ // per argument
+		if (strcmp(argv[arg], "-w") == 0)
+			width = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-h") == 0)
+			height = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-n") == 0)
+			nFrames = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-c") == 0)
+			nCharacters = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-m") == 0)
+			boneMode = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-k") == 0)
+			meshFileName = argv[arg + 1];
+		else if (strcmp(argv[arg], "-d") == 0 && (strcmp(argv[arg + 1], "linear") == 0 || strcmp(argv[arg + 1], "dual") == 0))
+			skinning = (strcmp(argv[arg + 1], "dual") == 0) ? SkinnedMesh::DUAL_QUATERNION : SkinnedMesh::LINEAR_BLEND;
+		else if (strcmp(argv[arg], "-o") == 0)
+			prefix = argv[arg + 1];
+		else if (strcmp(argv[arg], "-f") == 0 && (strcmp(argv[arg + 1], "ppm") == 0 || strcmp(argv[arg + 1], "png") == 0))
+			format = (strcmp(argv[arg + 1], "png") == 0) ? FrameCapture::PNG : FrameCapture::PPM;
+		else if (strcmp(argv[arg], "-t") == 0)
+			nWorkers = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-b") == 0)
+			nBuffers = atoi(argv[arg + 1]);
+		else if (strcmp(argv[arg], "-p") == 0 && (strcmp(argv[arg + 1], "wait") == 0 || strcmp(argv[arg + 1], "drop") == 0))
+			policy = (strcmp(argv[arg + 1], "drop") == 0) ? FrameCapture::DROP : FrameCapture::WAIT;
+		else
+			return Usage(argv[0]);
+		} // per argument
+	if (argc % 2 == 0 || width < 1 || height < 1 || nFrames < 1 || nCharacters < 1 || boneMode < BoneRenderer::AUTOMATIC || boneMode > BoneRenderer::DISPLAY_LIST || nWorkers < 1 || nBuffers < 1)
+		return Usage(argv[0]);
+
+	OffscreenContext offscreen;
+	if (!offscreen.Create(width, height))
+		return 1;
+
+	// the same projection the window sets up
+	glViewport(0, 0, width, height);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluPerspective(90.0, (float) width / (float) height, 0.1, 100000);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	// load the scene as the application does
+	std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+	SceneModel scene;
+	double loadSeconds = SecondsSince(loadStart);
+	scene.bones.drawMode = boneMode;
+
+	// a mesh given here replaces the scene's own, if it has one
+	if (meshFileName != NULL)
+		{ // mesh
+		if (!scene.characterMesh.ReadFileOBJ(meshFileName))
+			{ // failed
+			printf("could not read a mesh from %s\n", meshFileName);
+			return 1;
+			} // failed
+		scene.characterMesh.Bind(scene.restPose, Character::scale);
+		} // mesh
+	SkinnedMesh& mesh = scene.characterMesh;
+
+	// the user's character runs, and any others stand on a grid in front of the camera, far
+	// enough apart not to overlap, each playing one of the clips in turn, so that every frame differs
+	scene.characters.resize(nCharacters);
+	int gridSide = 1;
+	while (gridSide * gridSide < nCharacters)
+		gridSide++;
+	for (int character = 1; character < nCharacters; character++)
+		{ // per character
+		scene.characters[character].characterTransform = Matrix4::Translate(Cartesian3(characterSpacing * (character % gridSide - gridSide / 2), characterSpacing * (character / gridSide), 0.0f));
+		scene.characters[character].StartAnimation(character % Character::N_ANIMATIONS, false, false, 0);
+		} // per character
+	for (int character = 0; character < nCharacters; character++)
+		scene.characters[character].skinning = skinning;
+	scene.PostEvent(SceneModel::EVENT_CHARACTER_FORWARD);
+
+	// every frame is stepped, drawn, and read back or captured, each timed on its own
+	std::vector<unsigned char> pixels(3L * width * height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	FrameCapture capture;
+	if (prefix != NULL)
+		capture.Start(prefix, format, policy, nWorkers, nBuffers);
+	double updateSeconds = 0.0, renderSeconds = 0.0, readSeconds = 0.0, skinSeconds = 0.0;
+	long verticesSkinned = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < nFrames; frame++)
+		{ // per frame
+		std::chrono::steady_clock::time_point stageStart = std::chrono::steady_clock::now();
+		scene.Update();
+		updateSeconds += SecondsSince(stageStart);
+
+		// glFinish() so that the time is the drawing, not just the queueing of it
+		stageStart = std::chrono::steady_clock::now();
+		scene.Render();
+		glFinish();
+		renderSeconds += SecondsSince(stageStart);
+		skinSeconds += mesh.skinSeconds;
+		verticesSkinned += mesh.verticesSkinned;
+
+		// capturing reads back too, and includes any wait for the workers
+		stageStart = std::chrono::steady_clock::now();
+		if (capture.Active())
+			capture.Capture(width, height);
+		else
+			glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+		readSeconds += SecondsSince(stageStart);
+		} // per frame
+	double seconds = SecondsSince(start);
+
+	// the workers may still be writing the last few
+	capture.Finish();
+	double drainedSeconds = SecondsSince(start);
+
+	// free what the scene gave OpenGL before the context goes, checking that doing so raised no error
+	scene.ReleaseBuffers();
+	GLenum error = glGetError();
+	static const char *modeNames[] = { "automatic", "instanced", "streamed", "display list" };
+	printf("%s, OpenGL %s\n", (const char *) glGetString(GL_RENDERER), (const char *) glGetString(GL_VERSION));
+	printf("loaded scene in %.3f s\n", loadSeconds);
+	printf("%d frames of %d x %d, %d characters, bones drawn as %s: %ld draw calls, %ld vertices, %ld characters in view in the last frame\n",
+		nFrames, width, height, nCharacters, modeNames[scene.bones.drawMode], scene.bones.drawCalls, scene.bones.verticesSubmitted, scene.charactersDrawn);
+	printf("%.3f s: %.1f frames / s\n", seconds, nFrames / seconds);
+	printf("  update %8.3f ms / frame\n", 1E3 * updateSeconds / nFrames);
+	printf("  render %8.3f ms / frame (%.1f frames / s)\n", 1E3 * renderSeconds / nFrames, nFrames / renderSeconds);
+	if (mesh.Bound())
+		printf("    skin %8.3f ms / frame (%.1f M vertices / s) by %s of a mesh of %ld vertices and %ld triangles, %ld draw calls in the last frame\n",
+			1E3 * skinSeconds / nFrames, skinSeconds > 0.0 ? 1E-6 * verticesSkinned / skinSeconds : 0.0,
+			skinning == SkinnedMesh::DUAL_QUATERNION ? "dual quaternions" : "linear blend", mesh.vertexCount, (long) mesh.triangles.size() / 3, mesh.drawCalls);
+	printf("  %s %8.3f ms / frame\n", prefix != NULL ? "capture" : "read   ", 1E3 * readSeconds / nFrames);
+	if (prefix != NULL)
+		{ // capture
+		printf("captured %ld frames to %s onwards, %ld dropped, %ld not written, with %d workers and %d buffers (at most %ld waiting)\n",
+			capture.FramesCaptured(), capture.FileName(0).c_str(), capture.FramesDropped(), capture.WriteFailures(), nWorkers, nBuffers, capture.PeakQueued());
+		printf("  %.1f frames / s, %.1f MB / s written, %.3f s after the last frame to finish\n",
+			capture.FramesPerSecond(), capture.MegabytesWritten() / drainedSeconds, drainedSeconds - seconds);
+		if (capture.WriteFailures() > 0)
+			return 1;
+		} // capture
+	if (error != GL_NO_ERROR)
+		{ // error
+		printf("OpenGL error 0x%x\n", error);
+		return 1;
+		} // error
+	return 0;
+	} // main()
@@ -0,0 +1,13 @@
+# renders the scene with no window and reports frames per second
+# unlike the other tools it draws with a real OpenGL, made through EGL (Mesa's
+# software renderer will do), so it links libEGL and libGL rather than the stubs
+TEMPLATE = app
+TARGET = offscreen
+CONFIG += console
+CONFIG -= qt app_bundle
+
+include(../../core.pri)
+
+LIBS += -lEGL -lGL -lGLU
+
+SOURCES += offscreen.cpp
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	terrainmesh.cpp
+//	------------------------
+//
+//	Loads each DEM as a triangle soup and as an indexed
+//	mesh, and reports how long each takes to build and how
+//	much memory it holds. With -g, a synthetic DEM of the
+//	given size is written out first, so that grids far
+//	larger than the one we ship can be measured.
+//
+//	It also reports how many chunks of the indexed mesh
+//	survive frustum culling from the scene's starting
+//	camera, with the 90 degree projection the widget uses,
+//	and how many triangles level of detail leaves as the
+//	camera backs away from the centre of the terrain.
+//
+//	usage: terrainmesh [-g rows columns] [-s scale] [-c chunk] [-p pixels] [file.dem ...]
+//
+///////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SceneModel.h"
+#include "SyntheticDEM.h"
+
+// the terrain we ship
+static const char* defaultTerrainName = "./models/randomland.dem";
+
+// load the file in one mode, returning the seconds taken and the bytes held
+static bool Measure(Terrain& ground, const char* fileName, float scale, int mode, double& seconds, size_t& bytes, long& samples)
+	{ // Measure()
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!ground.ReadFileTerrainData(fileName, scale, mode) || ground.heights == NULL)
+		return false;
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	bytes = ground.MemoryBytes();
+	samples = ground.nRows * ground.nColumns;
+	return true;
+	} // Measure()
+
+int main(int argc, char **argv)
+	{ // main()
+	float scale = 3.0f;
+	int chunkSize = 32;
+	float maxPixelError = 2.0f;
+	long syntheticRows = 0, syntheticColumns = 0;
+	std::vector<std::string> fileNames;
+
+	// parse the command line
+	for (int arg = 1; arg < argc; arg++)
+		{ // per argument
+		if (strcmp(argv[arg], "-g") == 0 && arg + 2 < argc)
+			{ // synthetic grid
+			syntheticRows = atol(argv[++arg]);
+			syntheticColumns = atol(argv[++arg]);
+			} // synthetic grid
+		else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+			scale = atof(argv[++arg]);
+		else if (strcmp(argv[arg], "-c") == 0 && arg + 1 < argc)
+			chunkSize = atoi(argv[++arg]);
+		else if (strcmp(argv[arg], "-p") == 0 && arg + 1 < argc)
+			maxPixelError = atof(argv[++arg]);
+		else if (argv[arg][0] == '-')
+			{ // unknown
+			printf("usage: %s [-g rows columns] [-s scale] [-c chunk] [-p pixels] [file.dem ...]\n", argv[0]);
+			return 1;
+			} // unknown
+		else
+			fileNames.push_back(argv[arg]);
+		} // per argument
+
+	// the synthetic grid is written next to where we were run, and removed again afterwards
+	std::string syntheticName;
+	if (syntheticRows > 1 && syntheticColumns > 1)
+		{ // synthetic grid
+		syntheticName = "terrainmesh-" + std::to_string(syntheticRows) + "x" + std::to_string(syntheticColumns) + ".dem";
+		if (!WriteSyntheticDEM(syntheticName.c_str(), syntheticRows, syntheticColumns))
+			{ // failed
+			printf("could not write %s\n", syntheticName.c_str());
+			return 1;
+			} // failed
+		fileNames.push_back(syntheticName);
+		} // synthetic grid
+	if (fileNames.empty())
+		fileNames.push_back(defaultTerrainName);
+
+	// the camera the scene starts with, and the widget's projection for a square window
+	SceneModel scene;
+	Matrix4 projectionMatrix = Frustum::Perspective(90.0f, 1.0f, 0.1f, 100000.0f);
+	Matrix4 clipMatrix = projectionMatrix * scene.world2OpenGLMatrix * scene.CameraRotationMatrix * scene.CameraTranslateMatrix;
+
+	printf("%-32s %10s %10s %12s %10s %12s %10s %8s\n", "file", "samples", "soup s", "soup MB", "indexed s", "indexed MB", "bytes/pt", "ratio");
+	int status = 0;
+	for (size_t file = 0; file < fileNames.size(); file++)
+		{ // per file
+		double soupSeconds = 0.0, indexedSeconds = 0.0;
+		size_t soupBytes = 0, indexedBytes = 0;
+		long samples = 0;
+		Terrain soup, indexed;
+		indexed.chunkSize = chunkSize;
+		indexed.maxPixelError = maxPixelError;
+		if (!Measure(soup, fileNames[file].c_str(), scale, Terrain::SOUP_MESH, soupSeconds, soupBytes, samples)
+			|| !Measure(indexed, fileNames[file].c_str(), scale, Terrain::INDEXED_MESH, indexedSeconds, indexedBytes, samples))
+			{ // failed
+			printf("%-32s could not be read\n", fileNames[file].c_str());
+			status = 1;
+			continue;
+			} // failed
+		printf("%-32s %10ld %10.3f %12.2f %10.3f %12.2f %10.1f %7.2fx\n", fileNames[file].c_str(), samples,
+			soupSeconds, soupBytes / 1048576.0, indexedSeconds, indexedBytes / 1048576.0,
+			(double) indexedBytes / samples, (double) soupBytes / indexedBytes);
+
+		indexed.CullChunks(clipMatrix);
+		printf("%-32s %ld chunks of %d x %d squares: %ld tested, %ld culled, %ld drawn\n", "", (long) indexed.chunks.size(),
+			chunkSize, chunkSize, indexed.chunksTested, indexed.chunksCulled, indexed.chunksDrawn);
+
+		// look at the centre with the starting camera's orientation, from further and further away
+		printf("%-32s %10s %8s %14s %14s %8s\n", "", "distance", "chunks", "full triangles", "LOD triangles", "ratio");
+		long lastTriangles = -1;
+		for (float distance = 12.5f; distance < 100000.0f; distance *= 2.0f)
+			{ // per distance
+			Matrix4 view = Matrix4::Translate(Cartesian3(0.0f, 0.0f, -distance)) * scene.world2OpenGLMatrix * scene.CameraRotationMatrix;
+			indexed.SelectLevels(projectionMatrix, view, 600.0f);
+			long fullTriangles = 0;
+			for (size_t visible = 0; visible < indexed.visibleChunks.size(); visible++)
+				fullTriangles += indexed.chunks[indexed.visibleChunks[visible]].indexCount / 3;
+			printf("%-32s %10.1f %8ld %14ld %14ld %7.2fx\n", "", distance, indexed.chunksDrawn, fullTriangles, indexed.trianglesDrawn,
+				indexed.trianglesDrawn > 0 ? (double) fullTriangles / indexed.trianglesDrawn : 0.0);
+			// once everything is in view at the coarsest level, there is nothing more to see
+			if (indexed.chunksDrawn == (long) indexed.chunks.size() && indexed.trianglesDrawn == lastTriangles)
+				break;
+			lastTriangles = indexed.trianglesDrawn;
+			} // per distance
+		} // per file
+
+	if (!syntheticName.empty())
+		remove(syntheticName.c_str());
+	return status;
+	} // main()
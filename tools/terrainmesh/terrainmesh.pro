@@ -0,0 +1,7 @@
+# compares the memory and build time of the terrain mesh modes
+TEMPLATE = app
+TARGET = terrainmesh
+
+include(../tools.pri)
+
+SOURCES += terrainmesh.cpp
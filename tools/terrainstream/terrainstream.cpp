@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	terrainstream.cpp
+//	------------------------
+//
+//	Opens a DEM as a streamed tile store, then walks a
+//	viewer across it corner to corner, asking for the
+//	tiles around it every step and querying heights near
+//	it. Reports how soon heights were available, how many
+//	queries had to fall back to the overview and by how
+//	much, and how the memory stayed within the budget.
+//
+//	usage: terrainstream [-g rows columns] [-t tile] [-b megabytes] [-n steps] [file.dem]
+//
+///////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "TerrainTileStore.h"
+#include "SyntheticDEM.h"
+
+// the terrain we ship
+static const char* defaultTerrainName = "./models/randomland.dem";
+
+// the scale SceneModel reads the terrain with
+static const float terrainScale = 3.0f;
+
+// queries per step, scattered around the viewer
+static const int queriesPerStep = 64;
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+	{ // SecondsSince()
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} // SecondsSince()
+
+int main(int argc, char **argv)
+	{ // main()
+	long syntheticRows = 0, syntheticColumns = 0;
+	int tileSize = 128;
+	long budgetMegabytes = 16;
+	int nSteps = 2000;
+	std::string fileName = defaultTerrainName;
+
+	// parse the command line
+	for (int arg = 1; arg < argc; arg++)
+		{ // per argument
+		if (strcmp(argv[arg], "-g") == 0 && arg + 2 < argc)
+			{ // synthetic grid
+			syntheticRows = atol(argv[++arg]);
+			syntheticColumns = atol(argv[++arg]);
+			} // synthetic grid
+		else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc)
+			tileSize = atoi(argv[++arg]);
+		else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc)
+			budgetMegabytes = atol(argv[++arg]);
+		else if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+			nSteps = std::max(1, atoi(argv[++arg]));
+		else if (argv[arg][0] == '-')
+			{ // unknown
+			printf("usage: %s [-g rows columns] [-t tile] [-b megabytes] [-n steps] [file.dem]\n", argv[0]);
+			return 1;
+			} // unknown
+		else
+			fileName = argv[arg];
+		} // per argument
+
+	// the synthetic grid is written next to where we were run, and removed again afterwards
+	bool synthetic = (syntheticRows > 1 && syntheticColumns > 1);
+	if (synthetic)
+		{ // synthetic grid
+		fileName = "terrainstream-" + std::to_string(syntheticRows) + "x" + std::to_string(syntheticColumns) + ".dem";
+		if (!WriteSyntheticDEM(fileName.c_str(), syntheticRows, syntheticColumns))
+			{ // failed
+			printf("could not write %s\n", fileName.c_str());
+			return 1;
+			} // failed
+		} // synthetic grid
+
+	TerrainTileStore store;
+	std::chrono::steady_clock::time_point openStart = std::chrono::steady_clock::now();
+	if (!store.Open(fileName.c_str(), terrainScale, tileSize, (size_t) budgetMegabytes << 20))
+		{ // failed
+		printf("could not open %s\n", fileName.c_str());
+		return 1;
+		} // failed
+	// a query straight away never waits for the file
+	float firstHeight = store.getHeight(0.0f, 0.0f);
+	double firstQuerySeconds = SecondsSince(openStart);
+	store.WaitUntilIdle();
+	double scanSeconds = SecondsSince(openStart);
+	if (!store.ready)
+		{ // failed
+		printf("could not read %s\n", fileName.c_str());
+		return 1;
+		} // failed
+	size_t scanBytes = store.MemoryBytes();
+	printf("%s: %ld x %ld, %ld x %ld tiles of %d squares, %ld MB budget\n", fileName.c_str(), store.nRows, store.nColumns,
+		store.tileRows, store.tileColumns, tileSize, budgetMegabytes);
+	printf("first query answered after %.3f ms (height %.2f before the scan), scan done in %.3f s\n", 1E3 * firstQuerySeconds, firstHeight, scanSeconds);
+	printf("overview and offsets: %.2f MB, against %.2f MB for every height\n", scanBytes / 1048576.0, store.nRows * store.nColumns * sizeof(float) / 1048576.0);
+
+	// walk corner to corner, a step per tick, looking a few tiles around
+	float halfWidth = terrainScale * (store.nColumns / 2 - 1), halfHeight = terrainScale * (store.nRows / 2 - 1);
+	float radius = 2.0f * terrainScale * tileSize;
+	srand(1);
+	long fallbacks = 0;
+	double worstFallback = 0.0;
+	size_t peakBytes = 0;
+	std::chrono::steady_clock::time_point walkStart = std::chrono::steady_clock::now();
+	for (int step = 0; step < nSteps; step++)
+		{ // per step
+		float t = step / (float) (nSteps - 1);
+		float x = -halfWidth + 2.0f * halfWidth * t, y = -halfHeight + 2.0f * halfHeight * t;
+		store.RequestTilesAround(x, y, radius);
+		for (int query = 0; query < queriesPerStep; query++)
+			{ // per query
+			float qx = x + radius * (2.0f * rand() / (float) RAND_MAX - 1.0f);
+			float qy = y + radius * (2.0f * rand() / (float) RAND_MAX - 1.0f);
+			long overviewBefore = store.overviewQueries;
+			float height = store.getHeight(qx, qy);
+			// when the overview had to answer, compare with the real height once it arrives
+			if (store.overviewQueries != overviewBefore)
+				{ // fallback
+				fallbacks++;
+				store.WaitUntilIdle();
+				worstFallback = std::max(worstFallback, (double) fabs(store.getHeight(qx, qy) - height));
+				} // fallback
+			} // per query
+		peakBytes = std::max(peakBytes, store.MemoryBytes());
+		} // per step
+	double walkSeconds = SecondsSince(walkStart);
+
+	printf("%d steps, %d queries each, in %.3f s\n", nSteps, queriesPerStep, walkSeconds);
+	printf("%ld tiles loaded, %ld evicted; peak memory %.2f MB, of which %.2f MB in tiles\n", store.tilesLoaded, store.tilesEvicted,
+		peakBytes / 1048576.0, (peakBytes - scanBytes) / 1048576.0);
+	long queries = (long) nSteps * queriesPerStep;
+	printf("%ld queries from tiles, %ld from the overview, worst overview error %.4f\n", queries - fallbacks, fallbacks, worstFallback);
+
+	store.Close();
+	if (synthetic)
+		remove(fileName.c_str());
+	return 0;
+	} // main()
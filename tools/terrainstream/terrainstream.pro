@@ -0,0 +1,7 @@
+# walks across a streamed terrain and reports how the tile store keeps up
+TEMPLATE = app
+TARGET = terrainstream
+
+include(../tools.pri)
+
+SOURCES += terrainstream.cpp
@@ -0,0 +1,13 @@
+# settings shared by every command-line tool
+CONFIG += console
+CONFIG -= qt app_bundle
+
+include(../core.pri)
+
+# the tools link against no-op OpenGL entry points instead of a real driver
+SOURCES += $$PWD/GLStubs.cpp
+
+# and share generators for large test terrains and stand-in character meshes
+INCLUDEPATH += $$PWD
+HEADERS += $$PWD/SyntheticBody.h $$PWD/SyntheticDEM.h
+SOURCES += $$PWD/SyntheticBody.cpp $$PWD/SyntheticDEM.cpp
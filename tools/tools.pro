@@ -0,0 +1,7 @@
+# the command-line tools: none of them need Qt, a window or a GPU
+TEMPLATE = subdirs
+SUBDIRS = bake bench clipcompress demconvert headless terrainmesh terrainstream
+
+# and the offscreen renderer, which needs no GPU either, but does need EGL and a
+# real OpenGL (Mesa's will do), so is only built on Linux
+unix:!macx: SUBDIRS += offscreen